@@ -10,6 +10,36 @@ const std::vector<std::string> LovenseProtocol::LOVENSE_SERVICE_UUID_PATTERNS =
   "a6920e4c5653",  // Third generation - pattern ending
 };
 
+#define LOVENSE_COMMAND(text) {text, sizeof(text) - 1}
+#define LOVENSE_LEVELS_0_20(prefix)                                                                                            \
+  LOVENSE_COMMAND(prefix "0;"), LOVENSE_COMMAND(prefix "1;"), LOVENSE_COMMAND(prefix "2;"), LOVENSE_COMMAND(prefix "3;"),     \
+    LOVENSE_COMMAND(prefix "4;"), LOVENSE_COMMAND(prefix "5;"), LOVENSE_COMMAND(prefix "6;"), LOVENSE_COMMAND(prefix "7;"),   \
+    LOVENSE_COMMAND(prefix "8;"), LOVENSE_COMMAND(prefix "9;"), LOVENSE_COMMAND(prefix "10;"), LOVENSE_COMMAND(prefix "11;"), \
+    LOVENSE_COMMAND(prefix "12;"), LOVENSE_COMMAND(prefix "13;"), LOVENSE_COMMAND(prefix "14;"), LOVENSE_COMMAND(prefix "15;"), \
+    LOVENSE_COMMAND(prefix "16;"), LOVENSE_COMMAND(prefix "17;"), LOVENSE_COMMAND(prefix "18;"), LOVENSE_COMMAND(prefix "19;"), \
+    LOVENSE_COMMAND(prefix "20;")
+
+// Every level command the toys take, indexed by level, so the output path never formats a string or touches the heap
+static constexpr LovenseCommand VIBRATE_COMMANDS[] = {LOVENSE_LEVELS_0_20("Vibrate:")};
+static constexpr LovenseCommand ROTATE_COMMANDS[] = {LOVENSE_LEVELS_0_20("Rotate:")};
+static constexpr LovenseCommand AIR_LEVEL_COMMANDS[] = {
+  LOVENSE_COMMAND("Air:Level:0;"), LOVENSE_COMMAND("Air:Level:1;"), LOVENSE_COMMAND("Air:Level:2;"),
+  LOVENSE_COMMAND("Air:Level:3;"), LOVENSE_COMMAND("Air:Level:4;"),
+};
+static constexpr LovenseCommand AIR_IN_COMMANDS[] = {
+  LOVENSE_COMMAND("Air:In:1;"), LOVENSE_COMMAND("Air:In:2;"), LOVENSE_COMMAND("Air:In:3;"), LOVENSE_COMMAND("Air:In:4;"),
+};
+static constexpr LovenseCommand AIR_OUT_COMMANDS[] = {
+  LOVENSE_COMMAND("Air:Out:1;"), LOVENSE_COMMAND("Air:Out:2;"), LOVENSE_COMMAND("Air:Out:3;"), LOVENSE_COMMAND("Air:Out:4;"),
+};
+static constexpr LovenseCommand ROTATE_CHANGE_COMMAND = LOVENSE_COMMAND("RotateChange;");
+static constexpr LovenseCommand POWER_OFF_COMMAND = LOVENSE_COMMAND("PowerOff;");
+static constexpr LovenseCommand DEVICE_TYPE_COMMAND = LOVENSE_COMMAND("DeviceType;");
+static constexpr LovenseCommand BATTERY_COMMAND = LOVENSE_COMMAND("Battery;");
+
+static_assert(sizeof(VIBRATE_COMMANDS) / sizeof(VIBRATE_COMMANDS[0]) == 21, "one vibrate command per level 0-20");
+static_assert(sizeof(ROTATE_COMMANDS) / sizeof(ROTATE_COMMANDS[0]) == 21, "one rotate command per level 0-20");
+
 LovenseProtocol::LovenseProtocol() = default;
 
 // DeviceProtocol interface implementation
@@ -23,6 +53,11 @@ bool LovenseProtocol::isCompatibleDevice(const std::string& deviceName)
   return isLovenseDevice(deviceName);
 }
 
+bool LovenseProtocol::isCompatibleDevice(const char* name, const size_t length)
+{
+  return isLovenseDevice(name, length);
+}
+
 // Static methods
 bool LovenseProtocol::isLovenseServiceUUID(const std::string& uuid)
 {
@@ -43,14 +78,29 @@ bool LovenseProtocol::isLovenseServiceUUID(const std::string& uuid)
 
 bool LovenseProtocol::isLovenseDevice(const std::string& deviceName)
 {
-  if (deviceName.find("LVS") != std::string::npos || deviceName.find("Lovense") != std::string::npos || deviceName.find("LLS") != std::string::npos)
+  return isLovenseDevice(deviceName.data(), deviceName.length());
+}
+
+// substring search without a copy, names are a few dozen bytes at most
+static bool containsText(const char* text, const size_t length, const char* needle)
+{
+  const size_t needleLength = strlen(needle);
+  for (size_t i = 0; i + needleLength <= length; i++)
   {
-    return true;
+    if (memcmp(text + i, needle, needleLength) == 0)
+    {
+      return true;
+    }
   }
 
   return false;
 }
 
+bool LovenseProtocol::isLovenseDevice(const char* name, const size_t length)
+{
+  return containsText(name, length, "LVS") || containsText(name, length, "Lovense") || containsText(name, length, "LLS");
+}
+
 void LovenseProtocol::setTxCharacteristic(NimBLERemoteCharacteristic* txChar)
 {
   _txCharacteristic = txChar;
@@ -63,11 +113,14 @@ void LovenseProtocol::setRxCharacteristic(NimBLERemoteCharacteristic* rxChar, Ni
   // Set up notifications if the RX characteristic supports it
   if (_rxCharacteristic && _rxCharacteristic->canNotify())
   {
+    // runs on the BLE host task, nothing is parsed here
     _rxCharacteristic->subscribe(true,
       [this](NimBLERemoteCharacteristic* pChar, uint8_t* pData, const size_t length, bool isNotify)
       {
-        const std::string response(reinterpret_cast<char*>(pData), length);
-        this->handleResponse(response);
+        if (_notificationCallback)
+        {
+          _notificationCallback(pData, length);
+        }
       });
   }
 }
@@ -89,16 +142,165 @@ bool LovenseProtocol::isReady() const
   return _txCharacteristic != nullptr && _txCharacteristic->canWrite();
 }
 
-bool LovenseProtocol::sendCommand(const std::string& command) const
+bool LovenseProtocol::sendCommand(const char* command, const size_t length, const LovenseReply reply, const bool stop, const int8_t channel,
+  const uint8_t level)
 {
+  // an origin applies to the next command only, without one the write itself is the origin
+  const uint32_t now = NogasmClock::micros();
+  const uint32_t origin = _hasCommandOrigin ? _commandOrigin : now;
+  _hasCommandOrigin = false;
+
   if (!isReady())
   {
     Util::logInfo("Lovense protocol not ready to send commands");
     return false;
   }
 
-  Util::logTrace("LovenseProtocol::command: %s", command.c_str());
-  return _txCharacteristic->writeValue(command.c_str());
+  // queue before writing, the reply may come in before writeValue() returns
+  portENTER_CRITICAL(&_pendingLock);
+  expirePending(now);
+  if (_pendingCount == LOVENSE_PENDING_CAPACITY)
+  {
+    // the oldest command is not going to get its reply anymore
+    _pendingHead = (_pendingHead + 1) % LOVENSE_PENDING_CAPACITY;
+    _pendingCount--;
+    _unacknowledgedCount++;
+  }
+  const bool scan = _scanRunning.load(std::memory_order_relaxed);
+  _pending[(_pendingHead + _pendingCount) % LOVENSE_PENDING_CAPACITY] = {reply, origin, now, stop, channel, level, scan};
+  _pendingCount++;
+  portEXIT_CRITICAL(&_pendingLock);
+
+  Util::logTrace("LovenseProtocol::command: %.*s", static_cast<int>(length), command);
+  if (_txCharacteristic->writeValue(reinterpret_cast<const uint8_t*>(command), length))
+  {
+    return true;
+  }
+
+  portENTER_CRITICAL(&_pendingLock);
+  if (_pendingCount > 0)
+  {
+    _pendingCount--;
+  }
+  _writeFailedCount++;
+  portEXIT_CRITICAL(&_pendingLock);
+
+  return false;
+}
+
+void LovenseProtocol::expirePending(const uint32_t now)
+{
+  while (_pendingCount > 0 && now - _pending[_pendingHead].originUs > LOVENSE_REPLY_TIMEOUT_US)
+  {
+    _pendingHead = (_pendingHead + 1) % LOVENSE_PENDING_CAPACITY;
+    _pendingCount--;
+    _unacknowledgedCount++;
+  }
+}
+
+bool LovenseProtocol::completePending(const LovenseReply reply, const uint32_t now)
+{
+  bool matched = false;
+
+  portENTER_CRITICAL(&_pendingLock);
+  expirePending(now);
+  for (uint8_t i = 0; i < _pendingCount; i++)
+  {
+    const LovensePendingCommand& pending = _pending[(_pendingHead + i) % LOVENSE_PENDING_CAPACITY];
+    if (pending.reply != reply)
+    {
+      continue;
+    }
+
+    // replies arrive in order, commands queued before the match were skipped by the toy
+    _unacknowledgedCount += i;
+    _acknowledgedCount++;
+    _latency.record(now - pending.originUs);
+    if (pending.scan)
+    {
+      _scanLatency.record(now - pending.originUs);
+    }
+
+    // ERR also lands here, a channel the toy does not have is as settled as it gets
+    if (pending.channel >= 0)
+    {
+      _confirmedLevels[pending.channel] = pending.level;
+    }
+
+    // the stop is done once the last of its channels answered
+    if (pending.stop && _stopRepliesPending > 0 && --_stopRepliesPending == 0)
+    {
+      _stopAckMicros.store(now, std::memory_order_relaxed);
+      _stopAcknowledged.store(true, std::memory_order_release);
+    }
+
+    _pendingHead = (_pendingHead + i + 1) % LOVENSE_PENDING_CAPACITY;
+    _pendingCount -= i + 1;
+    matched = true;
+    break;
+  }
+  portEXIT_CRITICAL(&_pendingLock);
+
+  return matched;
+}
+
+void LovenseProtocol::setCommandOrigin(const unsigned long originMicros)
+{
+  _commandOrigin = originMicros;
+  _hasCommandOrigin = true;
+}
+
+CommandLatencyStats LovenseProtocol::getLatencyStats() const
+{
+  CommandLatencyStats stats;
+
+  portENTER_CRITICAL(&_pendingLock);
+  stats.p50Us = _latency.percentile(50);
+  stats.p95Us = _latency.percentile(95);
+  stats.p99Us = _latency.percentile(99);
+  stats.samples = _latency.count();
+  stats.acknowledged = _acknowledgedCount;
+  stats.unacknowledged = _unacknowledgedCount;
+  stats.writeFailed = _writeFailedCount;
+  stats.pending = _pendingCount;
+  stats.scanP50Us = _scanLatency.percentile(50);
+  stats.scanP99Us = _scanLatency.percentile(99);
+  stats.scanSamples = _scanLatency.count();
+  portEXIT_CRITICAL(&_pendingLock);
+
+  return stats;
+}
+
+void LovenseProtocol::setScanRunning(const bool running)
+{
+  _scanRunning.store(running, std::memory_order_relaxed);
+}
+
+int16_t LovenseProtocol::getConfirmedLevel(const DeviceChannel channel) const
+{
+  portENTER_CRITICAL(&_pendingLock);
+  const int16_t level = _confirmedLevels[static_cast<uint8_t>(channel)];
+  portEXIT_CRITICAL(&_pendingLock);
+
+  return level;
+}
+
+uint8_t LovenseProtocol::getInFlightCount(const uint32_t maxAgeUs) const
+{
+  const uint32_t now = NogasmClock::micros();
+  uint8_t count = 0;
+
+  portENTER_CRITICAL(&_pendingLock);
+  for (uint8_t i = 0; i < _pendingCount; i++)
+  {
+    if (now - _pending[(_pendingHead + i) % LOVENSE_PENDING_CAPACITY].sentUs < maxAgeUs)
+    {
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&_pendingLock);
+
+  return count;
 }
 
 String LovenseProtocol::getModelDisplayName() const
@@ -107,6 +309,11 @@ String LovenseProtocol::getModelDisplayName() const
 }
 
 // Callback setters
+void LovenseProtocol::setNotificationCallback(const std::function<void(const uint8_t*, size_t)> callback)
+{
+  _notificationCallback = callback;
+}
+
 void LovenseProtocol::setDeviceInfoCallback(const std::function<void(const DeviceInfo&)> callback)
 {
   _deviceInfoCallback = callback;
@@ -118,6 +325,12 @@ void LovenseProtocol::setBatteryLevelCallback(const std::function<void(int)> cal
 }
 
 // Command implementations
+const LovenseCommand& LovenseProtocol::vibrateCommand(const uint8_t level)
+{
+  // Ensure level is between 0-20 (Lovense range)
+  return VIBRATE_COMMANDS[level > 20 ? 20 : level];
+}
+
 bool LovenseProtocol::setVibration(uint8_t level)
 {
   // Ensure level is between 0-20 (Lovense range)
@@ -133,8 +346,7 @@ bool LovenseProtocol::setVibration(uint8_t level)
   //   command = "Vibrate1:" + std::to_string(level) + ";";
   // }
 
-  const std::string command = "Vibrate:" + std::to_string(level) + ";";
-  return sendCommand(command);
+  return sendCommand(vibrateCommand(level), LovenseReply::OK, false, static_cast<int8_t>(DeviceChannel::VIBRATE), level);
 }
 
 bool LovenseProtocol::setRotation(uint8_t level)
@@ -145,14 +357,13 @@ bool LovenseProtocol::setRotation(uint8_t level)
     level = 20;
   }
 
-  const std::string command = "Rotate:" + std::to_string(level) + ";";
-  return sendCommand(command);
+  return sendCommand(ROTATE_COMMANDS[level], LovenseReply::OK, false, static_cast<int8_t>(DeviceChannel::ROTATE), level);
 }
 
 bool LovenseProtocol::changeRotationDirection()
 {
   // Only applicable for toys with rotation like Nora
-  return sendCommand("RotateChange;");
+  return sendCommand(ROTATE_CHANGE_COMMAND);
 }
 
 bool LovenseProtocol::setAirLevel(uint8_t level)
@@ -161,8 +372,7 @@ bool LovenseProtocol::setAirLevel(uint8_t level)
   if (level > 4)
     level = 4;
 
-  const std::string command = "Air:Level:" + std::to_string(level) + ";";
-  return sendCommand(command);
+  return sendCommand(AIR_LEVEL_COMMANDS[level], LovenseReply::OK, false, static_cast<int8_t>(DeviceChannel::AIR_LEVEL), level);
 }
 
 bool LovenseProtocol::adjustAirLevelRelative(const bool inflate, uint8_t amount)
@@ -178,28 +388,85 @@ bool LovenseProtocol::adjustAirLevelRelative(const bool inflate, uint8_t amount)
     amount = 4;
   }
 
-  const std::string direction = inflate ? "In" : "Out";
-  const std::string command = "Air:" + direction + ":" + std::to_string(amount) + ";";
-  return sendCommand(command);
+  return sendCommand(inflate ? AIR_IN_COMMANDS[amount - 1] : AIR_OUT_COMMANDS[amount - 1]);
 }
 
 bool LovenseProtocol::powerOff()
 {
-  return sendCommand("PowerOff;");
+  return sendCommand(POWER_OFF_COMMAND);
+}
+
+bool LovenseProtocol::stop()
+{
+  // Vibrate:0 covers every vibration motor, rotation and air have their own command on the toys that have them
+  static const LovenseCommand* const STOP_COMMANDS[DEVICE_CHANNELS] = {&VIBRATE_COMMANDS[0], &ROTATE_COMMANDS[0], &AIR_LEVEL_COMMANDS[0]};
+  const uint8_t channels = _stopChannels.load(std::memory_order_relaxed);
+
+  uint8_t count = 0;
+  for (uint8_t channel = 0; channel < DEVICE_CHANNELS; channel++)
+  {
+    count += (channels >> channel) & 1;
+  }
+
+  portENTER_CRITICAL(&_pendingLock);
+  // replies to an earlier stop must not count towards this one
+  for (uint8_t i = 0; i < _pendingCount; i++)
+  {
+    _pending[(_pendingHead + i) % LOVENSE_PENDING_CAPACITY].stop = false;
+  }
+  _stopRepliesPending = count;
+  portEXIT_CRITICAL(&_pendingLock);
+  _stopAcknowledged.store(false, std::memory_order_relaxed);
+
+  // the origin applies to one command only, all of them belong to the same stop
+  const bool hasOrigin = _hasCommandOrigin;
+  const uint32_t origin = _commandOrigin;
+
+  bool sent = true;
+  for (uint8_t channel = 0; channel < DEVICE_CHANNELS; channel++)
+  {
+    if (((channels >> channel) & 1) == 0)
+    {
+      continue;
+    }
+
+    _hasCommandOrigin = hasOrigin;
+    _commandOrigin = origin;
+    sent = sendCommand(*STOP_COMMANDS[channel], LovenseReply::OK, true, static_cast<int8_t>(channel), 0) && sent;
+  }
+
+  return sent;
+}
+
+bool LovenseProtocol::isStopAcknowledged(uint32_t& ackMicros) const
+{
+  if (!_stopAcknowledged.load(std::memory_order_acquire))
+  {
+    return false;
+  }
+
+  ackMicros = _stopAckMicros.load(std::memory_order_relaxed);
+  return true;
 }
 
 // Query functions
 bool LovenseProtocol::queryDeviceType()
 {
-  return sendCommand("DeviceType;");
+  return sendCommand(DEVICE_TYPE_COMMAND, LovenseReply::DEVICE_TYPE);
 }
 
 bool LovenseProtocol::queryBatteryLevel()
 {
-  return sendCommand("Battery;");
+  return sendCommand(BATTERY_COMMAND, LovenseReply::BATTERY);
 }
 
-void LovenseProtocol::handleResponse(const std::string& response)
+void LovenseProtocol::handleNotification(const uint8_t* data, const size_t length, const uint32_t receivedMicros)
+{
+  const std::string response(reinterpret_cast<const char*>(data), length);
+  handleResponse(response, receivedMicros);
+}
+
+void LovenseProtocol::handleResponse(const std::string& response, const uint32_t receivedMicros)
 {
   // Check if the response contains a semicolon as per protocol
   if (response.find(';') == std::string::npos)
@@ -214,6 +481,7 @@ void LovenseProtocol::handleResponse(const std::string& response)
     if (colonCount == 2 && response[1] == ':')
     {
       // DeviceType response format: "C:11:0082059AD3BD;"
+      completePending(LovenseReply::DEVICE_TYPE, receivedMicros);
       parseDeviceTypeResponse(response);
     }
     else
@@ -221,12 +489,17 @@ void LovenseProtocol::handleResponse(const std::string& response)
       Util::logInfo("Don't know how to handle response: %s", response.c_str());
     }
   }
+  else if (response == "OK;" || response == "ERR;")
+  {
+    // control commands are answered with OK, or ERR when the toy lacks the feature, both end the round trip
+    completePending(LovenseReply::OK, receivedMicros);
+    Util::logTrace("LovenseProtocol::reply: %s", response.c_str());
+  }
   else
   {
-    // Simple numeric response (e.g., battery level or status)
-    // todo: to handle status we would need to know which command we issued first, not going to implement that now...
-    //  since the responses look exactly the same
-    if (isdigit(response[0]) && response[response.length() - 1] == ';')
+    // Simple numeric response (battery level or status), they look exactly the same,
+    // the pending commands tell us whether we asked for the battery level
+    if (isdigit(response[0]) && response[response.length() - 1] == ';' && completePending(LovenseReply::BATTERY, receivedMicros))
     {
       parseBatteryResponse(response);
     }
@@ -254,6 +527,22 @@ void LovenseProtocol::parseDeviceTypeResponse(const std::string& response)
     _lovenseDeviceInfo.macAddress = resp.substring(secondColon + 1, semicolon);
     _lovenseDeviceInfo.model = modelLetterToEnum(_lovenseDeviceInfo.modelLetter);
 
+    // from now on a stop only goes to the outputs this model has
+    uint8_t channels = 1 << static_cast<uint8_t>(DeviceChannel::VIBRATE);
+    if (_lovenseDeviceInfo.model == LovenseModel::NORA)
+    {
+      channels |= 1 << static_cast<uint8_t>(DeviceChannel::ROTATE);
+    }
+    else if (_lovenseDeviceInfo.model == LovenseModel::MAX)
+    {
+      channels |= 1 << static_cast<uint8_t>(DeviceChannel::AIR_LEVEL);
+    }
+    else if (_lovenseDeviceInfo.model == LovenseModel::UNKNOWN)
+    {
+      channels = (1 << DEVICE_CHANNELS) - 1;
+    }
+    _stopChannels.store(channels, std::memory_order_relaxed);
+
     // Convert to common DeviceInfo and call callback
     if (_deviceInfoCallback)
     {
@@ -2,11 +2,16 @@
 #define LOVENSE_PROTOCOL_H
 
 #include <Arduino.h>
-#include <NimBLEDevice.h>
+#include "BLEStack.h"
 #include <string>
 #include <vector>
 #include <functional>
+#include <atomic>
 #include "DeviceProtocol.h"
+#include "LatencyHistogram.h"
+
+#define LOVENSE_PENDING_CAPACITY 8
+#define LOVENSE_REPLY_TIMEOUT_US 2000000  // commands without a reply after this are counted as unacknowledged
 
 enum class LovenseModel
 {
@@ -22,6 +27,32 @@ enum class LovenseModel
   TENERA  // Q
 };
 
+// What a written command expects back, the toy answers in order
+enum class LovenseReply : uint8_t
+{
+  OK,           // "OK;" for control commands
+  DEVICE_TYPE,  // "C:11:0082059AD3BD;"
+  BATTERY       // "85;"
+};
+
+struct LovensePendingCommand
+{
+  LovenseReply reply;
+  uint32_t originUs;
+  uint32_t sentUs;
+  bool stop;       // the reply acknowledges an emergency stop
+  int8_t channel;  // DeviceChannel the command sets, -1 for anything else
+  uint8_t level;
+  bool scan;       // written while a scan was running
+};
+
+// A complete command as written to the toy, without the terminator, the text lives in flash
+struct LovenseCommand
+{
+  const char* text;
+  uint8_t length;
+};
+
 // Specific Lovense device info
 struct LovenseDeviceInfo
 {
@@ -43,14 +74,18 @@ class LovenseProtocol : public DeviceProtocol
   void setRxCharacteristic(NimBLERemoteCharacteristic* rxChar, NimBLEClient* client) override;
   void clearCharacteristics() override;
   bool isReady() const override;
+  void setNotificationCallback(std::function<void(const uint8_t*, size_t)> callback) override;
+  void handleNotification(const uint8_t* data, size_t length, uint32_t receivedMicros) override;
 
   // Device identification
   bool isCompatibleServiceUUID(const std::string& uuid) override;
   static bool isCompatibleDevice(const std::string& deviceName);
+  static bool isCompatibleDevice(const char* name, size_t length);
 
   // Static helpers for identification
   static bool isLovenseServiceUUID(const std::string& uuid);
   static bool isLovenseDevice(const std::string& deviceName);
+  static bool isLovenseDevice(const char* name, size_t length);  // not nul terminated, e.g. straight from an advertisement
 
   // Control commands
   bool setVibration(uint8_t level) override;
@@ -59,6 +94,8 @@ class LovenseProtocol : public DeviceProtocol
   bool setAirLevel(uint8_t level) override;
   bool adjustAirLevelRelative(bool inflate, uint8_t amount) override;
   bool powerOff() override;
+  bool stop() override;
+  bool isStopAcknowledged(uint32_t& ackMicros) const override;
 
   // Query functions
   bool queryDeviceType() override;
@@ -67,6 +104,13 @@ class LovenseProtocol : public DeviceProtocol
   // Info functions
   String getModelDisplayName() const override;
 
+  // Latency tracking
+  void setCommandOrigin(unsigned long originMicros) override;
+  CommandLatencyStats getLatencyStats() const override;
+  void setScanRunning(bool running) override;
+  int16_t getConfirmedLevel(DeviceChannel channel) const override;
+  uint8_t getInFlightCount(uint32_t maxAgeUs) const override;
+
   // Callbacks
   void setDeviceInfoCallback(std::function<void(const DeviceInfo&)> callback) override;
   void setBatteryLevelCallback(std::function<void(int)> callback) override;
@@ -75,12 +119,26 @@ class LovenseProtocol : public DeviceProtocol
   static LovenseModel modelLetterToEnum(const String& letter);
   static String enumToModelDisplay(LovenseModel model);
 
+  // the table entry setVibration() writes for a level, levels above 20 get 20
+  static const LovenseCommand& vibrateCommand(uint8_t level);
+
   // Process received data
-  void handleResponse(const std::string& response);
+  void handleResponse(const std::string& response, uint32_t receivedMicros);
 
  private:
   // Send a command to the device
-  bool sendCommand(const std::string& command) const;
+  bool sendCommand(const char* command, size_t length, LovenseReply reply = LovenseReply::OK, bool stop = false, int8_t channel = -1,
+    uint8_t level = 0);
+
+  bool sendCommand(const LovenseCommand& command, const LovenseReply reply = LovenseReply::OK, const bool stop = false,
+    const int8_t channel = -1, const uint8_t level = 0)
+  {
+    return sendCommand(command.text, command.length, reply, stop, channel, level);
+  }
+
+  // Match a reply against the oldest command waiting for that kind of reply, false if nothing was waiting
+  bool completePending(LovenseReply reply, uint32_t now);
+  void expirePending(uint32_t now);
 
   // Parse responses
   void parseDeviceTypeResponse(const std::string& response);
@@ -91,7 +149,32 @@ class LovenseProtocol : public DeviceProtocol
   NimBLERemoteCharacteristic* _rxCharacteristic = nullptr;
   LovenseDeviceInfo _lovenseDeviceInfo;
 
+  // written commands waiting for their reply, written by the writer task and completed from the BLE host task
+  mutable portMUX_TYPE _pendingLock = portMUX_INITIALIZER_UNLOCKED;
+  LovensePendingCommand _pending[LOVENSE_PENDING_CAPACITY] = {};
+  uint8_t _pendingHead = 0;
+  uint8_t _pendingCount = 0;
+  uint32_t _commandOrigin = 0;
+  bool _hasCommandOrigin = false;
+  LatencyHistogram _latency;
+  LatencyHistogram _scanLatency;  // a subset of _latency
+  uint32_t _acknowledgedCount = 0;
+  uint32_t _unacknowledgedCount = 0;
+  uint32_t _writeFailedCount = 0;
+  int16_t _confirmedLevels[DEVICE_CHANNELS] = {-1, -1, -1};
+
+  // set once every command of a stop() got its reply, cleared by the next stop()
+  std::atomic<bool> _stopAcknowledged{false};
+  std::atomic<uint32_t> _stopAckMicros{0};
+  uint8_t _stopRepliesPending = 0;  // guarded by _pendingLock
+
+  // DeviceChannel bits a stop() silences, every channel until the device type reply names the model
+  std::atomic<uint8_t> _stopChannels{(1 << DEVICE_CHANNELS) - 1};
+
+  std::atomic<bool> _scanRunning{false};
+
   // Callback functions
+  std::function<void(const uint8_t*, size_t)> _notificationCallback;
   std::function<void(const DeviceInfo&)> _deviceInfoCallback;
   std::function<void(int)> _batteryLevelCallback;
 
@@ -0,0 +1,206 @@
+#include "Arduino.h"
+#include <cctype>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+HostSerial Serial;
+
+static const std::chrono::steady_clock::time_point START_TIME = std::chrono::steady_clock::now();
+static uint16_t pinValues[64];
+
+String::String(const double value, const unsigned int decimals)
+{
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%.*f", static_cast<int>(decimals), value);
+  assign(buffer);
+}
+
+bool String::equalsIgnoreCase(const String& other) const
+{
+  return length() == other.length() &&
+         std::equal(begin(), end(), other.begin(), [](const char a, const char b) { return tolower(a) == tolower(b); });
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+  // Arduino swaps a reversed range instead of failing
+  if (from > to)
+  {
+    std::swap(from, to);
+  }
+
+  if (from >= length())
+  {
+    return String();
+  }
+
+  return String(substr(from, std::min<size_t>(to, length()) - from));
+}
+
+void String::trim()
+{
+  const size_t first = find_first_not_of(" \t\r\n");
+  if (first == npos)
+  {
+    clear();
+    return;
+  }
+
+  assign(substr(first, find_last_not_of(" \t\r\n") - first + 1));
+}
+
+void String::toUpperCase()
+{
+  std::transform(begin(), end(), begin(), [](const char c) { return static_cast<char>(toupper(c)); });
+}
+
+void String::toLowerCase()
+{
+  std::transform(begin(), end(), begin(), [](const char c) { return static_cast<char>(tolower(c)); });
+}
+
+std::string String::format(const long value, const unsigned char base)
+{
+  if (value < 0 && base == DEC)
+  {
+    return "-" + format(static_cast<unsigned long>(-value), base);
+  }
+
+  return format(static_cast<unsigned long>(value), base);
+}
+
+std::string String::format(unsigned long value, const unsigned char base)
+{
+  std::string digits;
+  do
+  {
+    const unsigned long digit = value % base;
+    digits.insert(digits.begin(), static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10));
+    value /= base;
+  } while (value > 0);
+
+  return digits;
+}
+
+// tasks print from several threads, whole lines stay together
+static std::mutex& serialLock()
+{
+  static std::mutex lock;
+  return lock;
+}
+
+size_t HostSerial::print(const char* text)
+{
+  std::lock_guard<std::mutex> guard(serialLock());
+  return fwrite(text, 1, strlen(text), stdout);
+}
+
+size_t HostSerial::println(const char* text)
+{
+  std::lock_guard<std::mutex> guard(serialLock());
+  const size_t written = fwrite(text, 1, strlen(text), stdout);
+  fputc('\n', stdout);
+  return written + 1;
+}
+
+size_t HostSerial::printf(const char* format, ...)
+{
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return print(buffer);
+}
+
+unsigned long millis()
+{
+  return static_cast<unsigned long>(micros() / 1000);
+}
+
+unsigned long micros()
+{
+  return static_cast<unsigned long>(
+    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START_TIME).count());
+}
+
+void delay(const uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(const uint32_t us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield()
+{
+  std::this_thread::yield();
+}
+
+// fixed seed, so a failing run repeats
+static std::mt19937& generator()
+{
+  static std::mt19937 value(0x6e6f6761);
+  return value;
+}
+
+long random(const long max)
+{
+  return max > 0 ? random(0, max) : 0;
+}
+
+long random(const long min, const long max)
+{
+  if (max <= min)
+  {
+    return min;
+  }
+
+  return min + static_cast<long>(generator()() % static_cast<unsigned long>(max - min));
+}
+
+void randomSeed(const unsigned long seed)
+{
+  generator().seed(static_cast<uint32_t>(seed));
+}
+
+uint32_t esp_random()
+{
+  return generator()();
+}
+
+long map(const long x, const long in_min, const long in_max, const long out_min, const long out_max)
+{
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+void pinMode(const uint8_t pin, const uint8_t mode) {}
+
+void digitalWrite(const uint8_t pin, const uint8_t value)
+{
+  hostSetPinValue(pin, value);
+}
+
+int digitalRead(const uint8_t pin)
+{
+  return pin < 64 && pinValues[pin] != 0 ? HIGH : LOW;
+}
+
+uint16_t analogRead(const uint8_t pin)
+{
+  return pin < 64 ? pinValues[pin] : 0;
+}
+
+void analogReadResolution(const uint8_t bits) {}
+
+void hostSetPinValue(const uint8_t pin, const uint16_t value)
+{
+  if (pin < 64)
+  {
+    pinValues[pin] = value;
+  }
+}
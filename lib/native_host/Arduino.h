@@ -0,0 +1,170 @@
+#ifndef NATIVE_HOST_ARDUINO_H
+#define NATIVE_HOST_ARDUINO_H
+
+/**
+ * The part of the Arduino-ESP32 core the libraries use, for the native test env.
+ * Time is host time since start, tasks are threads (HostRTOS.h). Nothing here is built for the device.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "HostRTOS.h"
+
+#define IRAM_ATTR
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+#define DEC 10
+#define HEX 16
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// std::string underneath, so ArduinoJson and the std::string call sites take it like the real one
+class String : public std::string
+{
+ public:
+  String() = default;
+  String(const char* value) : std::string(value != nullptr ? value : "") {}  // NOLINT(*-explicit-constructor)
+  String(const std::string& value) : std::string(value) {}                   // NOLINT(*-explicit-constructor)
+  explicit String(char value) : std::string(1, value) {}
+  explicit String(int value, unsigned char base = DEC) : std::string(format(static_cast<long>(value), base)) {}
+  explicit String(unsigned int value, unsigned char base = DEC) : std::string(format(static_cast<unsigned long>(value), base)) {}
+  explicit String(long value, unsigned char base = DEC) : std::string(format(value, base)) {}
+  explicit String(unsigned long value, unsigned char base = DEC) : std::string(format(value, base)) {}
+  explicit String(float value, unsigned int decimals = 2) : String(static_cast<double>(value), decimals) {}
+  explicit String(double value, unsigned int decimals = 2);
+
+  bool isEmpty() const
+  {
+    return empty();
+  }
+
+  char charAt(const unsigned int index) const
+  {
+    return index < length() ? at(index) : '\0';
+  }
+
+  bool equals(const String& other) const
+  {
+    return *this == other;
+  }
+
+  bool equalsIgnoreCase(const String& other) const;
+
+  bool startsWith(const String& prefix) const
+  {
+    return compare(0, prefix.length(), prefix) == 0;
+  }
+
+  bool endsWith(const String& suffix) const
+  {
+    return length() >= suffix.length() && compare(length() - suffix.length(), suffix.length(), suffix) == 0;
+  }
+
+  int indexOf(char value, unsigned int from = 0) const
+  {
+    return toIndex(find(value, from));
+  }
+
+  int indexOf(const String& value, unsigned int from = 0) const
+  {
+    return toIndex(find(value, from));
+  }
+
+  int lastIndexOf(char value) const
+  {
+    return toIndex(rfind(value));
+  }
+
+  String substring(unsigned int from) const
+  {
+    return from < length() ? String(substr(from)) : String();
+  }
+
+  String substring(unsigned int from, unsigned int to) const;
+
+  bool concat(const String& value)
+  {
+    append(value);
+    return true;
+  }
+
+  long toInt() const
+  {
+    return strtol(c_str(), nullptr, 10);
+  }
+
+  float toFloat() const
+  {
+    return strtof(c_str(), nullptr);
+  }
+
+  void trim();
+  void toUpperCase();
+  void toLowerCase();
+
+ private:
+  static std::string format(long value, unsigned char base);
+  static std::string format(unsigned long value, unsigned char base);
+
+  static int toIndex(const size_t position)
+  {
+    return position == npos ? -1 : static_cast<int>(position);
+  }
+};
+
+class HostSerial
+{
+ public:
+  void begin(unsigned long baud) {}
+  size_t print(const char* text);
+  size_t print(const String& text)
+  {
+    return print(text.c_str());
+  }
+  size_t println(const char* text = "");
+  size_t println(const String& text)
+  {
+    return println(text.c_str());
+  }
+  size_t printf(const char* format, ...);
+};
+
+extern HostSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+// no pins on the host, inputs read the value the test put there
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+void analogReadResolution(uint8_t bits);
+void hostSetPinValue(uint8_t pin, uint16_t value);
+
+#endif
@@ -0,0 +1,58 @@
+#include "FS.h"
+
+int File::read()
+{
+  uint8_t value;
+  return read(&value, 1) == 1 ? value : -1;
+}
+
+size_t File::read(uint8_t* buffer, const size_t length)
+{
+  if (!_data || _write)
+  {
+    return 0;
+  }
+
+  const size_t count = std::min(length, _data->size() - _position);
+  memcpy(buffer, _data->data() + _position, count);
+  _position += count;
+  return count;
+}
+
+size_t File::write(const uint8_t* buffer, const size_t length)
+{
+  if (!_data || !_write)
+  {
+    return 0;
+  }
+
+  _data->insert(_data->end(), buffer, buffer + length);
+  return length;
+}
+
+namespace fs
+{
+File FS::open(const char* path, const char* mode)
+{
+  // "w" starts the file over, anything else reads an existing one
+  if (mode[0] == 'w')
+  {
+    auto& data = _files[path];
+    data = std::make_shared<std::vector<uint8_t>>();
+    return File(data, true);
+  }
+
+  const auto it = _files.find(path);
+  return it != _files.end() ? File(it->second, false) : File();
+}
+
+bool FS::exists(const char* path) const
+{
+  return _files.count(path) > 0;
+}
+
+bool FS::remove(const char* path)
+{
+  return _files.erase(path) > 0;
+}
+}  // namespace fs
@@ -0,0 +1,76 @@
+#ifndef NATIVE_HOST_FS_H
+#define NATIVE_HOST_FS_H
+
+/**
+ * An in-memory fs::FS for the native test env, files live as long as the FS object.
+ * Only what the libraries call: open for "r" or "w", exists and remove.
+ */
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class File
+{
+ public:
+  File() = default;
+  File(std::shared_ptr<std::vector<uint8_t>> data, bool write) : _data(std::move(data)), _write(write) {}
+
+  explicit operator bool() const
+  {
+    return _data != nullptr;
+  }
+
+  size_t size() const
+  {
+    return _data ? _data->size() : 0;
+  }
+
+  int available() const
+  {
+    return _data ? static_cast<int>(_data->size() - _position) : 0;
+  }
+
+  int read();
+  size_t read(uint8_t* buffer, size_t length);
+
+  size_t readBytes(char* buffer, const size_t length)
+  {
+    return read(reinterpret_cast<uint8_t*>(buffer), length);
+  }
+
+  size_t write(uint8_t value)
+  {
+    return write(&value, 1);
+  }
+
+  size_t write(const uint8_t* buffer, size_t length);
+
+  void close()
+  {
+    _data = nullptr;
+  }
+
+ private:
+  std::shared_ptr<std::vector<uint8_t>> _data;
+  size_t _position = 0;
+  bool _write = false;
+};
+
+namespace fs
+{
+class FS
+{
+ public:
+  File open(const char* path, const char* mode = "r");
+  bool exists(const char* path) const;
+  bool remove(const char* path);
+
+ private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> _files;
+};
+}  // namespace fs
+
+#endif
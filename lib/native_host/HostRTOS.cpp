@@ -0,0 +1,194 @@
+#include "HostRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <vector>
+
+struct HostTask
+{
+  std::mutex lock;
+  std::condition_variable notified;
+  uint32_t notifications = 0;
+};
+
+struct HostQueue
+{
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  size_t length;
+  size_t itemSize;
+};
+
+struct HostMutex
+{
+  std::timed_mutex mutex;
+};
+
+// threads the tasks did not create (the test's main thread) get a handle on first use
+static TaskHandle_t& currentTask()
+{
+  static thread_local TaskHandle_t task = nullptr;
+  return task;
+}
+
+// waits until ready() holds or the ticks run out, portMAX_DELAY waits for good
+template <typename Predicate>
+static bool waitFor(std::condition_variable& condition, std::unique_lock<std::mutex>& lock, const TickType_t ticks, Predicate ready)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    condition.wait(lock, ready);
+    return true;
+  }
+
+  return condition.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+BaseType_t xTaskCreate(const TaskFunction_t function, const char* name, const uint32_t stackDepth, void* parameter,
+  const UBaseType_t priority, TaskHandle_t* handle)
+{
+  return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+BaseType_t xTaskCreatePinnedToCore(const TaskFunction_t function, const char* name, const uint32_t stackDepth, void* parameter,
+  const UBaseType_t priority, TaskHandle_t* handle, const BaseType_t core)
+{
+  // the handle exists before the thread runs, the creator may notify it right away
+  TaskHandle_t task = new HostTask();
+  if (handle != nullptr)
+  {
+    *handle = task;
+  }
+
+  std::thread(
+    [function, parameter, task]()
+    {
+      currentTask() = task;
+      function(parameter);
+    })
+    .detach();
+
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  TaskHandle_t& task = currentTask();
+  if (task == nullptr)
+  {
+    task = new HostTask();
+  }
+
+  return task;
+}
+
+void vTaskDelay(const TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void xTaskNotifyGive(const TaskHandle_t task)
+{
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+  task->notified.notify_one();
+}
+
+void vTaskNotifyGiveFromISR(const TaskHandle_t task, BaseType_t* higherPriorityTaskWoken)
+{
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken != nullptr)
+  {
+    *higherPriorityTaskWoken = pdFALSE;
+  }
+}
+
+uint32_t ulTaskNotifyTake(const BaseType_t clearOnExit, const TickType_t ticks)
+{
+  HostTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->lock);
+  waitFor(task->notified, lock, ticks, [task]() { return task->notifications > 0; });
+
+  const uint32_t value = task->notifications;
+  if (value > 0)
+  {
+    task->notifications = clearOnExit == pdTRUE ? 0 : value - 1;
+  }
+
+  return value;
+}
+
+QueueHandle_t xQueueCreate(const UBaseType_t length, const UBaseType_t itemSize)
+{
+  HostQueue* queue = new HostQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+BaseType_t xQueueSend(const QueueHandle_t queue, const void* item, const TickType_t ticks)
+{
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitFor(queue->changed, lock, ticks, [queue]() { return queue->items.size() < queue->length; }))
+  {
+    return pdFALSE;
+  }
+
+  const auto* bytes = static_cast<const uint8_t*>(item);
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(const QueueHandle_t queue, void* item, const TickType_t ticks)
+{
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitFor(queue->changed, lock, ticks, [queue]() { return !queue->items.empty(); }))
+  {
+    return pdFALSE;
+  }
+
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(const QueueHandle_t queue)
+{
+  {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    queue->items.clear();
+  }
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return new HostMutex();
+}
+
+BaseType_t xSemaphoreTake(const SemaphoreHandle_t semaphore, const TickType_t ticks)
+{
+  if (ticks == portMAX_DELAY)
+  {
+    semaphore->mutex.lock();
+    return pdTRUE;
+  }
+
+  return semaphore->mutex.try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(const SemaphoreHandle_t semaphore)
+{
+  semaphore->mutex.unlock();
+  return pdTRUE;
+}
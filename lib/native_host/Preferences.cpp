@@ -0,0 +1,106 @@
+#include "Preferences.h"
+#include <map>
+#include <mutex>
+#include <vector>
+
+// namespace -> key -> value
+using HostNamespaces = std::map<std::string, std::map<std::string, std::vector<uint8_t>>>;
+
+static HostNamespaces& storage()
+{
+  static HostNamespaces value;
+  return value;
+}
+
+static std::mutex& storageLock()
+{
+  static std::mutex lock;
+  return lock;
+}
+
+bool Preferences::begin(const char* name, const bool readOnly)
+{
+  if (_open)
+  {
+    return false;
+  }
+
+  _namespace = name;
+  _readOnly = readOnly;
+  _open = true;
+  return true;
+}
+
+void Preferences::end()
+{
+  _open = false;
+}
+
+bool Preferences::isKey(const char* key) const
+{
+  std::lock_guard<std::mutex> guard(storageLock());
+  return _open && storage()[_namespace].count(key) > 0;
+}
+
+bool Preferences::remove(const char* key)
+{
+  std::lock_guard<std::mutex> guard(storageLock());
+  return _open && !_readOnly && storage()[_namespace].erase(key) > 0;
+}
+
+bool Preferences::clear()
+{
+  std::lock_guard<std::mutex> guard(storageLock());
+  if (!_open || _readOnly)
+  {
+    return false;
+  }
+
+  storage()[_namespace].clear();
+  return true;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, const size_t length)
+{
+  std::lock_guard<std::mutex> guard(storageLock());
+  if (!_open || _readOnly)
+  {
+    return 0;
+  }
+
+  const auto* bytes = static_cast<const uint8_t*>(value);
+  storage()[_namespace][key].assign(bytes, bytes + length);
+  return length;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, const size_t maxLength) const
+{
+  std::lock_guard<std::mutex> guard(storageLock());
+  if (!_open)
+  {
+    return 0;
+  }
+
+  const auto& keys = storage()[_namespace];
+  const auto it = keys.find(key);
+  if (it == keys.end() || it->second.size() > maxLength)
+  {
+    return 0;
+  }
+
+  memcpy(buffer, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key) const
+{
+  std::lock_guard<std::mutex> guard(storageLock());
+  if (!_open)
+  {
+    return 0;
+  }
+
+  const auto& keys = storage()[_namespace];
+  const auto it = keys.find(key);
+  return it != keys.end() ? it->second.size() : 0;
+}
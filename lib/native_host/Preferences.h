@@ -0,0 +1,31 @@
+#ifndef NATIVE_HOST_PREFERENCES_H
+#define NATIVE_HOST_PREFERENCES_H
+
+/**
+ * NVS Preferences for the native test env, kept in memory for the life of the process.
+ * Like NVS, every instance opening a namespace sees the same keys.
+ */
+
+#include <Arduino.h>
+
+class Preferences
+{
+ public:
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+
+  bool isKey(const char* key) const;
+  bool remove(const char* key);
+  bool clear();
+
+  size_t putBytes(const char* key, const void* value, size_t length);
+  size_t getBytes(const char* key, void* buffer, size_t maxLength) const;
+  size_t getBytesLength(const char* key) const;
+
+ private:
+  std::string _namespace;
+  bool _open = false;
+  bool _readOnly = false;
+};
+
+#endif
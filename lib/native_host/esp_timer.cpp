@@ -0,0 +1,152 @@
+#include "esp_timer.h"
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct HostTimer
+{
+  esp_timer_cb_t callback = nullptr;
+  void* arg = nullptr;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::thread thread;
+  bool running = false;
+  bool periodic = false;
+  bool deleted = false;
+  uint64_t periodUs = 0;
+  uint32_t generation = 0;  // bumped by every start and stop, a sleeping thread then starts over
+};
+
+static void runTimer(HostTimer* timer)
+{
+  std::unique_lock<std::mutex> lock(timer->lock);
+  while (!timer->deleted)
+  {
+    if (!timer->running)
+    {
+      timer->changed.wait(lock);
+      continue;
+    }
+
+    const uint32_t generation = timer->generation;
+    const auto dueAt = std::chrono::steady_clock::now() + std::chrono::microseconds(timer->periodUs);
+    if (timer->changed.wait_until(lock, dueAt, [timer, generation]() { return timer->generation != generation || timer->deleted; }))
+    {
+      continue;
+    }
+
+    timer->running = timer->periodic;
+
+    // unlocked, the callback may stop or restart its own timer
+    lock.unlock();
+    timer->callback(timer->arg);
+    lock.lock();
+  }
+}
+
+static esp_err_t startTimer(const esp_timer_handle_t timer, const uint64_t periodUs, const bool periodic)
+{
+  if (timer == nullptr)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(timer->lock);
+    if (timer->running)
+    {
+      return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->running = true;
+    timer->periodic = periodic;
+    timer->periodUs = periodUs;
+    timer->generation++;
+  }
+  timer->changed.notify_all();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+  if (args == nullptr || args->callback == nullptr || handle == nullptr)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  auto* timer = new HostTimer();
+  timer->callback = args->callback;
+  timer->arg = args->arg;
+  timer->thread = std::thread(runTimer, timer);
+  *handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(const esp_timer_handle_t timer, const uint64_t timeoutUs)
+{
+  return startTimer(timer, timeoutUs, false);
+}
+
+esp_err_t esp_timer_start_periodic(const esp_timer_handle_t timer, const uint64_t periodUs)
+{
+  return startTimer(timer, periodUs, true);
+}
+
+esp_err_t esp_timer_stop(const esp_timer_handle_t timer)
+{
+  if (timer == nullptr)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(timer->lock);
+    if (!timer->running)
+    {
+      return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->running = false;
+    timer->generation++;
+  }
+  timer->changed.notify_all();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(const esp_timer_handle_t timer)
+{
+  if (timer == nullptr)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(timer->lock);
+    if (timer->running)
+    {
+      return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->deleted = true;
+  }
+  timer->changed.notify_all();
+
+  // deleting from its own callback leaves the thread to finish on its own
+  if (timer->thread.get_id() == std::this_thread::get_id())
+  {
+    timer->thread.detach();
+    return ESP_OK;
+  }
+
+  timer->thread.join();
+  delete timer;
+  return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+  return static_cast<int64_t>(micros());
+}
@@ -0,0 +1,587 @@
+#include "BLECommandWriter.h"
+#include "Util.h"
+
+BLECommandWriter::BLECommandWriter()
+{
+  for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+  {
+    _epochs[link].store(0, std::memory_order_relaxed);
+    _lastLevelWrite[link].store(0, std::memory_order_relaxed);
+    for (uint8_t i = 0; i < BLE_WRITER_SLOTS; i++)
+    {
+      _slots[link][i] = -1;
+      _slotOrigins[link][i] = 0;
+      _written[link][i] = {-1, 0, 0, 0, 0};
+    }
+  }
+}
+
+void BLECommandWriter::begin()
+{
+  if (_task != nullptr)
+  {
+    return;
+  }
+
+  _queue = xQueueCreate(BLE_WRITER_QUEUE_LENGTH, sizeof(QueuedCommand));
+  _protocolMutex = xSemaphoreCreateMutex();
+  xTaskCreate(taskEntry, "ble_writer", BLE_WRITER_TASK_STACK, this, BLE_WRITER_TASK_PRIORITY, &_task);
+
+  Util::logDebug("BLECommandWriter started");
+}
+
+void BLECommandWriter::setProtocol(const uint8_t link, DeviceProtocol* protocol)
+{
+  if (link >= BLE_MAX_LINKS)
+  {
+    return;
+  }
+
+  if (_protocolMutex == nullptr)
+  {
+    _protocols[link] = protocol;
+    return;
+  }
+
+  xSemaphoreTake(_protocolMutex, portMAX_DELAY);
+  _protocols[link] = protocol;
+  xSemaphoreGive(_protocolMutex);
+}
+
+bool BLECommandWriter::submit(const DeviceCommand& command)
+{
+  if (_task == nullptr || command.link >= BLE_MAX_LINKS)
+  {
+    return false;
+  }
+
+  const uint32_t now = NogasmClock::micros();
+  if (isLevelCommand(command.type))
+  {
+    portENTER_CRITICAL(&_slotLock);
+    int16_t& slot = _slots[command.link][static_cast<uint8_t>(command.type)];
+    const bool coalesced = slot >= 0;
+    slot = command.value;
+    _slotOrigins[command.link][static_cast<uint8_t>(command.type)] = now;
+    portEXIT_CRITICAL(&_slotLock);
+
+    if (coalesced)
+    {
+      _coalescedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  else
+  {
+    const QueuedCommand queued = {command, _epochs[command.link].load(std::memory_order_relaxed), now};
+    if (xQueueSend(_queue, &queued, 0) != pdTRUE)
+    {
+      _droppedCount.fetch_add(1, std::memory_order_relaxed);
+      Util::logInfo("BLECommandWriter::queue full, dropping command %d", static_cast<int>(command.type));
+      return false;
+    }
+  }
+
+  xTaskNotifyGive(_task);
+  return true;
+}
+
+bool BLECommandWriter::submitBatch(const DeviceCommandType type, const int16_t* levels)
+{
+  if (_task == nullptr || !isLevelCommand(type))
+  {
+    return false;
+  }
+
+  uint32_t coalesced = 0;
+  const uint32_t now = NogasmClock::micros();
+
+  // the task takes the slots under the same lock, so it never sees half a batch
+  portENTER_CRITICAL(&_slotLock);
+  for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+  {
+    if (levels[link] < 0)
+    {
+      continue;
+    }
+
+    int16_t& slot = _slots[link][static_cast<uint8_t>(type)];
+    if (slot >= 0)
+    {
+      coalesced++;
+    }
+    slot = levels[link];
+    _slotOrigins[link][static_cast<uint8_t>(type)] = now;
+  }
+  portEXIT_CRITICAL(&_slotLock);
+
+  if (coalesced > 0)
+  {
+    _coalescedCount.fetch_add(coalesced, std::memory_order_relaxed);
+  }
+
+  xTaskNotifyGive(_task);
+  return true;
+}
+
+void BLECommandWriter::clear(const uint8_t link)
+{
+  if (link >= BLE_MAX_LINKS)
+  {
+    return;
+  }
+
+  portENTER_CRITICAL(&_slotLock);
+  for (auto& slot : _slots[link])
+  {
+    slot = -1;
+  }
+  portEXIT_CRITICAL(&_slotLock);
+
+  // queued one-shot commands of other links stay, this link's are skipped when they come up
+  _epochs[link].fetch_add(1, std::memory_order_relaxed);
+}
+
+void BLECommandWriter::emergencyStop()
+{
+  if (_task == nullptr)
+  {
+    return;
+  }
+
+  portENTER_CRITICAL(&_slotLock);
+  requestStop();
+  portEXIT_CRITICAL(&_slotLock);
+
+  xTaskNotifyGive(_task);
+}
+
+void BLECommandWriter::emergencyStopFromISR()
+{
+  if (_task == nullptr)
+  {
+    return;
+  }
+
+  portENTER_CRITICAL_ISR(&_slotLock);
+  requestStop();
+  portEXIT_CRITICAL_ISR(&_slotLock);
+
+  // the writer runs at the next scheduler tick at the latest, no yield so this also works from a timer task
+  vTaskNotifyGiveFromISR(_task, nullptr);
+}
+
+void BLECommandWriter::requestStop()
+{
+  // the origin goes first, the task reads it once it sees the flag
+  _stopOriginUs.store(NogasmClock::micros(), std::memory_order_relaxed);
+  _stopRequested.store(true, std::memory_order_release);
+
+  for (auto& slots : _slots)
+  {
+    for (auto& slot : slots)
+    {
+      slot = -1;
+    }
+  }
+
+  // one-shot commands submitted from here on, e.g. a power off right after the stop, still go out
+  for (auto& epoch : _epochs)
+  {
+    epoch.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool BLECommandWriter::isLinkQuiet(const uint8_t link, const unsigned long quietMs) const
+{
+  if (link >= BLE_MAX_LINKS || _stopRequested.load(std::memory_order_relaxed))
+  {
+    return false;
+  }
+
+  bool pending = false;
+  portENTER_CRITICAL(&_slotLock);
+  for (const auto slot : _slots[link])
+  {
+    pending |= slot >= 0;
+  }
+  portEXIT_CRITICAL(&_slotLock);
+
+  return !pending && NogasmClock::millis() - _lastLevelWrite[link].load(std::memory_order_relaxed) >= quietMs;
+}
+
+void BLECommandWriter::setWriteMode(const BLEWriteMode mode)
+{
+  if (_writeMode.exchange(mode, std::memory_order_relaxed) != mode && _task != nullptr)
+  {
+    xTaskNotifyGive(_task);
+  }
+}
+
+BLEStopStats BLECommandWriter::getStopStats() const
+{
+  portENTER_CRITICAL(&_stopLock);
+  BLEStopStats stats = _stopStats;
+  stats.p50Us = _stopLatency.percentile(50);
+  stats.p99Us = _stopLatency.percentile(99);
+  portEXIT_CRITICAL(&_stopLock);
+
+  return stats;
+}
+
+void BLECommandWriter::taskEntry(void* parameter)
+{
+  static_cast<BLECommandWriter*>(parameter)->run();
+}
+
+bool BLECommandWriter::takeSlots(int16_t (&levels)[BLE_MAX_LINKS][BLE_WRITER_SLOTS], uint32_t (&origins)[BLE_MAX_LINKS][BLE_WRITER_SLOTS],
+  uint8_t (&epochs)[BLE_MAX_LINKS])
+{
+  bool pending = false;
+
+  portENTER_CRITICAL(&_slotLock);
+  for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+  {
+    epochs[link] = _epochs[link].load(std::memory_order_relaxed);
+    for (uint8_t i = 0; i < BLE_WRITER_SLOTS; i++)
+    {
+      levels[link][i] = _slots[link][i];
+      origins[link][i] = _slotOrigins[link][i];
+      _slots[link][i] = -1;
+      pending |= levels[link][i] >= 0;
+    }
+  }
+  portEXIT_CRITICAL(&_slotLock);
+
+  return pending;
+}
+
+void BLECommandWriter::run()
+{
+  bool outstanding = false;
+
+  for (;;)
+  {
+    // unconfirmed levels are looked at again even when nothing new comes in
+    ulTaskNotifyTake(pdTRUE, outstanding ? pdMS_TO_TICKS(BLE_ACK_POLL_MS) : portMAX_DELAY);
+
+    if (_stopRequested.load(std::memory_order_acquire))
+    {
+      runStop();
+    }
+
+    // keep going until both the FIFO and the slots are empty, one FIFO entry per pass keeps levels responsive
+    bool wrote;
+    bool held = false;
+    do
+    {
+      wrote = false;
+
+      QueuedCommand queued{};
+      if (xQueueReceive(_queue, &queued, 0) == pdTRUE)
+      {
+        if (queued.epoch == _epochs[queued.command.link].load(std::memory_order_relaxed))
+        {
+          execute(queued.command, queued.originUs);
+        }
+        wrote = true;
+      }
+
+      // kind by kind across all links, so the devices of a batch get their writes back to back
+      int16_t levels[BLE_MAX_LINKS][BLE_WRITER_SLOTS];
+      uint32_t origins[BLE_MAX_LINKS][BLE_WRITER_SLOTS];
+      uint8_t epochs[BLE_MAX_LINKS];
+      if (takeSlots(levels, origins, epochs))
+      {
+        const bool acknowledged = _writeMode.load(std::memory_order_relaxed) == BLEWriteMode::ACKNOWLEDGED;
+        for (uint8_t i = 0; i < BLE_WRITER_SLOTS; i++)
+        {
+          for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+          {
+            if (levels[link][i] < 0)
+            {
+              continue;
+            }
+
+            // the level goes back into its slot, where newer values keep replacing it until the window opens
+            if (acknowledged && isWindowFull(link))
+            {
+              restoreSlot(link, i, levels[link][i], origins[link][i], epochs[link]);
+              _windowWaitCount.fetch_add(1, std::memory_order_relaxed);
+              held = true;
+              continue;
+            }
+
+            writeLevel(link, i, levels[link][i], origins[link][i], 1);
+            wrote = true;
+          }
+        }
+      }
+    } while (wrote);
+
+    outstanding = checkUnconfirmed() || held;
+  }
+}
+
+void BLECommandWriter::writeLevel(const uint8_t link, const uint8_t kind, const int16_t level, const uint32_t originUs, const uint8_t attempts)
+{
+  execute({static_cast<DeviceCommandType>(kind), static_cast<uint8_t>(level), false, link}, originUs);
+
+  if (_writeMode.load(std::memory_order_relaxed) == BLEWriteMode::ACKNOWLEDGED)
+  {
+    const uint32_t now = NogasmClock::micros();
+    _written[link][kind] = {level, _epochs[link].load(std::memory_order_relaxed), attempts, now, originUs};
+  }
+}
+
+bool BLECommandWriter::isWindowFull(const uint8_t link)
+{
+  xSemaphoreTake(_protocolMutex, portMAX_DELAY);
+  DeviceProtocol* protocol = _protocols[link];
+  const bool full = protocol != nullptr && protocol->getInFlightCount(BLE_ACK_TIMEOUT_MS * 1000UL) >= BLE_ACK_WINDOW;
+  xSemaphoreGive(_protocolMutex);
+
+  return full;
+}
+
+void BLECommandWriter::restoreSlot(const uint8_t link, const uint8_t kind, const int16_t level, const uint32_t originUs, const uint8_t epoch)
+{
+  // a clear() or stop since the slots were taken wins over the held level
+  portENTER_CRITICAL(&_slotLock);
+  if (_slots[link][kind] < 0 && _epochs[link].load(std::memory_order_relaxed) == epoch)
+  {
+    _slots[link][kind] = level;
+    _slotOrigins[link][kind] = originUs;
+  }
+  portEXIT_CRITICAL(&_slotLock);
+}
+
+bool BLECommandWriter::checkUnconfirmed()
+{
+  const bool acknowledged = _writeMode.load(std::memory_order_relaxed) == BLEWriteMode::ACKNOWLEDGED;
+  bool outstanding = false;
+
+  for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+  {
+    for (uint8_t i = 0; i < BLE_WRITER_SLOTS; i++)
+    {
+      WrittenLevel& written = _written[link][i];
+      if (written.level < 0)
+      {
+        continue;
+      }
+
+      // cleared, stopped or switched back to unacknowledged writes, nothing left to confirm
+      if (!acknowledged || written.epoch != _epochs[link].load(std::memory_order_relaxed))
+      {
+        written.level = -1;
+        continue;
+      }
+
+      xSemaphoreTake(_protocolMutex, portMAX_DELAY);
+      DeviceProtocol* protocol = _protocols[link];
+      const bool ready = protocol != nullptr && protocol->isReady();
+      const bool confirmed = ready && protocol->getConfirmedLevel(static_cast<DeviceChannel>(i)) == written.level;
+      xSemaphoreGive(_protocolMutex);
+
+      // a device that went away stops on its own, the next connection starts from scratch
+      if (!ready || confirmed)
+      {
+        written.level = -1;
+        continue;
+      }
+
+      portENTER_CRITICAL(&_slotLock);
+      const bool superseded = _slots[link][i] >= 0;
+      portEXIT_CRITICAL(&_slotLock);
+
+      // still within its timeout, or a newer level is about to be written anyway
+      if (superseded || NogasmClock::micros() - written.sentUs < BLE_ACK_TIMEOUT_MS * 1000UL)
+      {
+        outstanding = true;
+        continue;
+      }
+
+      if (written.attempts >= BLE_ACK_MAX_ATTEMPTS)
+      {
+        _unconfirmedCount.fetch_add(1, std::memory_order_relaxed);
+        Util::logInfo("BLECommandWriter::level %d not confirmed on link %d", written.level, link);
+        written.level = -1;
+        continue;
+      }
+
+      if (isWindowFull(link))
+      {
+        outstanding = true;
+        continue;
+      }
+
+      _retransmitCount.fetch_add(1, std::memory_order_relaxed);
+      writeLevel(link, i, written.level, written.originUs, written.attempts + 1);
+      outstanding = true;
+    }
+  }
+
+  return outstanding;
+}
+
+void BLECommandWriter::runStop()
+{
+  uint8_t attempts[BLE_MAX_LINKS] = {};
+  uint32_t sentAt[BLE_MAX_LINKS] = {};
+  bool pending[BLE_MAX_LINKS] = {};
+  uint32_t originUs = 0;
+  bool anyPending;
+
+  do
+  {
+    // a stop requested while the last one is still unconfirmed starts over on every link
+    if (_stopRequested.exchange(false, std::memory_order_acquire))
+    {
+      originUs = _stopOriginUs.load(std::memory_order_relaxed);
+      for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+      {
+        attempts[link] = 0;
+        pending[link] = true;
+      }
+
+      portENTER_CRITICAL(&_stopLock);
+      _stopStats.count++;
+      portEXIT_CRITICAL(&_stopLock);
+    }
+
+    anyPending = false;
+    const uint32_t now = NogasmClock::micros();
+
+    xSemaphoreTake(_protocolMutex, portMAX_DELAY);
+    for (uint8_t link = 0; link < BLE_MAX_LINKS; link++)
+    {
+      if (!pending[link])
+      {
+        continue;
+      }
+
+      // nothing to silence on a link that is down, its device stops on its own when the connection drops
+      DeviceProtocol* protocol = _protocols[link];
+      if (protocol == nullptr || !protocol->isReady())
+      {
+        pending[link] = false;
+        continue;
+      }
+
+      uint32_t ackUs = 0;
+      if (attempts[link] > 0 && protocol->isStopAcknowledged(ackUs))
+      {
+        pending[link] = false;
+        recordStop(ackUs - originUs);
+        continue;
+      }
+
+      if (attempts[link] > 0 && now - sentAt[link] < BLE_STOP_RETRY_MS * 1000UL)
+      {
+        anyPending = true;
+        continue;
+      }
+
+      if (attempts[link] >= BLE_STOP_MAX_ATTEMPTS)
+      {
+        pending[link] = false;
+        portENTER_CRITICAL(&_stopLock);
+        _stopStats.unacknowledged++;
+        portEXIT_CRITICAL(&_stopLock);
+        Util::logInfo("BLECommandWriter::stop not confirmed on link %d", link);
+        continue;
+      }
+
+      if (attempts[link] > 0)
+      {
+        portENTER_CRITICAL(&_stopLock);
+        _stopStats.retransmits++;
+        portEXIT_CRITICAL(&_stopLock);
+      }
+
+      protocol->setCommandOrigin(originUs);
+      if (protocol->stop())
+      {
+        _writeCount.fetch_add(1, std::memory_order_relaxed);
+      }
+      _lastLevelWrite[link].store(NogasmClock::millis(), std::memory_order_relaxed);
+      attempts[link]++;
+      sentAt[link] = now;
+      anyPending = true;
+    }
+    xSemaphoreGive(_protocolMutex);
+
+    if (anyPending)
+    {
+      vTaskDelay(pdMS_TO_TICKS(BLE_STOP_POLL_MS));
+    }
+  } while (anyPending || _stopRequested.load(std::memory_order_acquire));
+}
+
+void BLECommandWriter::recordStop(const uint32_t latencyUs)
+{
+  portENTER_CRITICAL(&_stopLock);
+  _stopStats.acknowledged++;
+  _stopStats.lastUs = latencyUs;
+  if (latencyUs > _stopStats.maxUs)
+  {
+    _stopStats.maxUs = latencyUs;
+  }
+  _stopLatency.record(latencyUs);
+  portEXIT_CRITICAL(&_stopLock);
+}
+
+bool BLECommandWriter::execute(const DeviceCommand& command, const uint32_t originUs)
+{
+  xSemaphoreTake(_protocolMutex, portMAX_DELAY);
+
+  bool success = false;
+  DeviceProtocol* protocol = _protocols[command.link];
+  if (protocol != nullptr && protocol->isReady())
+  {
+    // latency is measured from the submit, time spent waiting here included
+    protocol->setCommandOrigin(originUs);
+
+    switch (command.type)
+    {
+      case DeviceCommandType::VIBRATE:
+        success = protocol->setVibration(command.value);
+        break;
+      case DeviceCommandType::ROTATE:
+        success = protocol->setRotation(command.value);
+        break;
+      case DeviceCommandType::AIR_LEVEL:
+        success = protocol->setAirLevel(command.value);
+        break;
+      case DeviceCommandType::ROTATE_CHANGE:
+        success = protocol->changeRotationDirection();
+        break;
+      case DeviceCommandType::AIR_ADJUST:
+        success = protocol->adjustAirLevelRelative(command.inflate, command.value);
+        break;
+      case DeviceCommandType::POWER_OFF:
+        success = protocol->powerOff();
+        break;
+      case DeviceCommandType::QUERY_DEVICE_TYPE:
+        success = protocol->queryDeviceType();
+        break;
+      case DeviceCommandType::QUERY_BATTERY:
+        success = protocol->queryBatteryLevel();
+        break;
+    }
+  }
+
+  xSemaphoreGive(_protocolMutex);
+
+  if (isLevelCommand(command.type))
+  {
+    _lastLevelWrite[command.link].store(NogasmClock::millis(), std::memory_order_relaxed);
+  }
+
+  if (success)
+  {
+    _writeCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return success;
+}
@@ -0,0 +1,216 @@
+#ifndef BLE_COMMAND_WRITER_H
+#define BLE_COMMAND_WRITER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "DeviceProtocol.h"
+#include "LatencyHistogram.h"
+
+#define BLE_MAX_LINKS 3  // concurrent device connections, must not exceed CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define BLE_WRITER_TASK_STACK 4096
+#define BLE_WRITER_TASK_PRIORITY 2  // above loop() so queued writes go out promptly
+#define BLE_WRITER_QUEUE_LENGTH 8
+#define BLE_STOP_RETRY_MS 100    // resend the stop when the device has not confirmed it by then
+#define BLE_STOP_MAX_ATTEMPTS 5
+#define BLE_STOP_POLL_MS 5       // how often the task checks for the confirmation
+#define BLE_ACK_WINDOW 2         // acknowledged mode, unanswered commands per link before new levels wait
+#define BLE_ACK_TIMEOUT_MS 150   // acknowledged mode, resend a level the device has not confirmed by then
+#define BLE_ACK_MAX_ATTEMPTS 3
+#define BLE_ACK_POLL_MS 10       // how often the task looks at unconfirmed levels
+
+// Whether level writes are checked against the device's replies
+enum class BLEWriteMode : uint8_t
+{
+  UNACKNOWLEDGED,  // fire and forget, the replies only feed the latency stats
+  ACKNOWLEDGED     // at most BLE_ACK_WINDOW replies outstanding per link, unconfirmed levels are resent
+};
+
+enum class DeviceCommandType : uint8_t
+{
+  // level commands, only the newest value is written
+  VIBRATE,
+  ROTATE,
+  AIR_LEVEL,
+
+  // one-shot commands, written in order
+  ROTATE_CHANGE,
+  AIR_ADJUST,
+  POWER_OFF,
+  QUERY_DEVICE_TYPE,
+  QUERY_BATTERY
+};
+
+#define BLE_WRITER_SLOTS 3  // number of level commands (VIBRATE, ROTATE, AIR_LEVEL)
+
+struct BLEStopStats
+{
+  uint32_t count = 0;           // emergency stops requested
+  uint32_t acknowledged = 0;    // per link, confirmed by the device
+  uint32_t unacknowledged = 0;  // per link, still unconfirmed after BLE_STOP_MAX_ATTEMPTS
+  uint32_t retransmits = 0;
+  uint32_t lastUs = 0;          // request to confirmation of the most recent acknowledged stop
+  uint32_t p50Us = 0;
+  uint32_t p99Us = 0;
+  uint32_t maxUs = 0;
+};
+
+struct DeviceCommand
+{
+  DeviceCommandType type;
+  uint8_t value;
+  bool inflate;  // AIR_ADJUST only
+  uint8_t link;  // index of the device link the command is for
+};
+
+/**
+ * Owns all writes to the connected devices from a dedicated task.
+ * Level commands go into one slot per link and kind where a newer value replaces an unsent one,
+ * one-shot commands go through a FIFO. Callers never block on the BLE stack.
+ */
+class BLECommandWriter
+{
+ public:
+  BLECommandWriter();
+
+  void begin();
+
+  // attach or detach the protocol the task writes to for a link, waits for an in-flight write to finish
+  void setProtocol(uint8_t link, DeviceProtocol* protocol);
+
+  bool submit(const DeviceCommand& command);
+
+  /**
+   * Sets one level command on several links at once, levels[i] < 0 leaves link i untouched.
+   * The task picks the whole batch up in a single pass and writes it back to back.
+   */
+  bool submitBatch(DeviceCommandType type, const int16_t* levels);
+
+  // drop everything that has not been written to a link yet
+  void clear(uint8_t link);
+
+  /**
+   * Drops everything queued for every link and has the task write a stop ahead of anything else,
+   * resent until each device confirms it. Safe from any task.
+   */
+  void emergencyStop();
+
+  // same from an ISR or timer callback, only atomics, the slot spinlock and a notify without yielding
+  void emergencyStopFromISR();
+
+  BLEStopStats getStopStats() const;
+
+  // nothing pending for the link and its last level write is at least quietMs ago
+  bool isLinkQuiet(uint8_t link, unsigned long quietMs) const;
+
+  // takes effect on the next pass of the task
+  void setWriteMode(BLEWriteMode mode);
+
+  BLEWriteMode getWriteMode() const
+  {
+    return _writeMode.load(std::memory_order_relaxed);
+  }
+
+  uint32_t getWriteCount() const
+  {
+    return _writeCount.load(std::memory_order_relaxed);
+  }
+
+  // level commands replaced before they were written
+  uint32_t getCoalescedCount() const
+  {
+    return _coalescedCount.load(std::memory_order_relaxed);
+  }
+
+  // one-shot commands rejected because the queue was full
+  uint32_t getDroppedCount() const
+  {
+    return _droppedCount.load(std::memory_order_relaxed);
+  }
+
+  // acknowledged mode, levels written again because their confirmation did not arrive in time
+  uint32_t getRetransmitCount() const
+  {
+    return _retransmitCount.load(std::memory_order_relaxed);
+  }
+
+  // acknowledged mode, levels still unconfirmed after BLE_ACK_MAX_ATTEMPTS
+  uint32_t getUnconfirmedCount() const
+  {
+    return _unconfirmedCount.load(std::memory_order_relaxed);
+  }
+
+  // acknowledged mode, levels held back because the link's window was full
+  uint32_t getWindowWaitCount() const
+  {
+    return _windowWaitCount.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct QueuedCommand
+  {
+    DeviceCommand command;
+    uint8_t epoch;      // commands from before the last clear() of their link are skipped
+    uint32_t originUs;  // when the command was submitted, for latency tracking
+  };
+
+  // acknowledged mode, the last level written per link and kind until the device confirms it
+  struct WrittenLevel
+  {
+    int16_t level;  // -1 when confirmed or given up
+    uint8_t epoch;
+    uint8_t attempts;
+    uint32_t sentUs;
+    uint32_t originUs;
+  };
+
+  static void taskEntry(void* parameter);
+  void run();
+  bool takeSlots(int16_t (&levels)[BLE_MAX_LINKS][BLE_WRITER_SLOTS], uint32_t (&origins)[BLE_MAX_LINKS][BLE_WRITER_SLOTS],
+    uint8_t (&epochs)[BLE_MAX_LINKS]);
+  bool execute(const DeviceCommand& command, uint32_t originUs);
+  void writeLevel(uint8_t link, uint8_t kind, int16_t level, uint32_t originUs, uint8_t attempts);
+  bool isWindowFull(uint8_t link);
+  void restoreSlot(uint8_t link, uint8_t kind, int16_t level, uint32_t originUs, uint8_t epoch);
+  bool checkUnconfirmed();
+  void requestStop();
+  void runStop();
+  void recordStop(uint32_t latencyUs);
+
+  static bool isLevelCommand(const DeviceCommandType type)
+  {
+    return static_cast<uint8_t>(type) < BLE_WRITER_SLOTS;
+  }
+
+  TaskHandle_t _task = nullptr;
+  QueueHandle_t _queue = nullptr;
+  SemaphoreHandle_t _protocolMutex = nullptr;
+  DeviceProtocol* _protocols[BLE_MAX_LINKS] = {};
+  std::atomic<uint8_t> _epochs[BLE_MAX_LINKS];
+
+  // latest pending level per link and command kind, -1 when empty, guarded by _slotLock
+  mutable portMUX_TYPE _slotLock = portMUX_INITIALIZER_UNLOCKED;
+  int16_t _slots[BLE_MAX_LINKS][BLE_WRITER_SLOTS];
+  uint32_t _slotOrigins[BLE_MAX_LINKS][BLE_WRITER_SLOTS];  // submit time of the pending level
+
+  std::atomic<uint32_t> _writeCount{0};
+  std::atomic<uint32_t> _coalescedCount{0};
+  std::atomic<uint32_t> _droppedCount{0};
+  std::atomic<uint32_t> _lastLevelWrite[BLE_MAX_LINKS];  // millis of the last level or stop write per link
+
+  std::atomic<BLEWriteMode> _writeMode{BLEWriteMode::UNACKNOWLEDGED};
+  std::atomic<uint32_t> _retransmitCount{0};
+  std::atomic<uint32_t> _unconfirmedCount{0};
+  std::atomic<uint32_t> _windowWaitCount{0};
+  WrittenLevel _written[BLE_MAX_LINKS][BLE_WRITER_SLOTS];  // only touched by the task
+
+  // set by emergencyStop(), taken by the task before it looks at the FIFO or the slots
+  std::atomic<bool> _stopRequested{false};
+  std::atomic<uint32_t> _stopOriginUs{0};
+
+  // guarded by _stopLock, read by the status pages
+  mutable portMUX_TYPE _stopLock = portMUX_INITIALIZER_UNLOCKED;
+  BLEStopStats _stopStats;
+  LatencyHistogram _stopLatency;
+};
+
+#endif
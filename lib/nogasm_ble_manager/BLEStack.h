@@ -0,0 +1,8 @@
+#pragma once
+
+// Resolved at compile time like NogasmClock, the device build includes NimBLE directly
+#if defined(NOGASM_SIMULATED_BLE)
+#include "SimulatedNimBLE.h"
+#else
+#include <NimBLEDevice.h>
+#endif
@@ -0,0 +1,65 @@
+#include "ConnectionTimings.h"
+
+void ConnectionTimings::record(const uint64_t address, const ConnectionTiming& timing)
+{
+  DeviceHistory* history = find(address);
+  if (history == nullptr)
+  {
+    if (_deviceCount < BLE_TIMING_DEVICES)
+    {
+      history = &_devices[_deviceCount++];
+    }
+    else
+    {
+      history = &_devices[0];
+      for (auto& device : _devices)
+      {
+        if (device.lastUsed < history->lastUsed)
+        {
+          history = &device;
+        }
+      }
+    }
+
+    *history = DeviceHistory();
+    history->address = address;
+  }
+
+  history->entries[history->head] = timing;
+  history->head = (history->head + 1) % BLE_TIMING_HISTORY;
+  if (history->count < BLE_TIMING_HISTORY)
+  {
+    history->count++;
+  }
+  history->lastUsed = timing.startedAt;
+}
+
+void ConnectionTimings::updateLatest(const uint64_t address, const ConnectionTiming& timing)
+{
+  DeviceHistory* history = find(address);
+  if (history == nullptr || history->count == 0)
+  {
+    return;
+  }
+
+  history->entries[(history->head + BLE_TIMING_HISTORY - 1) % BLE_TIMING_HISTORY] = timing;
+}
+
+const ConnectionTiming& ConnectionTimings::get(const size_t device, const size_t index) const
+{
+  const DeviceHistory& history = _devices[device];
+  return history.entries[(history.head + BLE_TIMING_HISTORY - 1 - index) % BLE_TIMING_HISTORY];
+}
+
+ConnectionTimings::DeviceHistory* ConnectionTimings::find(const uint64_t address)
+{
+  for (size_t i = 0; i < _deviceCount; i++)
+  {
+    if (_devices[i].address == address)
+    {
+      return &_devices[i];
+    }
+  }
+
+  return nullptr;
+}
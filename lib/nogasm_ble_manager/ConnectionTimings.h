@@ -0,0 +1,71 @@
+#ifndef CONNECTION_TIMINGS_H
+#define CONNECTION_TIMINGS_H
+
+#include <Arduino.h>
+
+#define BLE_TIMING_DEVICES 4  // devices with a history, the least recently connected one makes room
+#define BLE_TIMING_HISTORY 4  // connection setups kept per device
+
+// where one connection setup spent its time in microseconds, 0 for a phase that did not happen (yet)
+struct ConnectionTiming
+{
+  unsigned long startedAt = 0;  // millis of the connect() call
+  uint32_t connectUs = 0;       // connect() until the link was up
+  uint32_t mtuUs = 0;           // link up until the MTU exchange completed
+  uint32_t settleUs = 0;        // link up until attribute lookup started, the settle and retry waits
+  uint32_t discoveryUs = 0;     // every discovery attempt, or the targeted lookup of cached attributes
+  uint32_t lookupUs = 0;        // picking service and characteristics out of a full discovery
+  uint32_t subscribeUs = 0;     // enabling notifications on the reply characteristic
+  uint32_t totalUs = 0;         // connect() until connected
+  uint32_t deviceInfoUs = 0;    // connected until the first device info reply
+  uint8_t discoveryAttempts = 0;
+  bool cached = false;          // the attributes came from the GATT cache
+};
+
+/**
+ * The last few connection setups of every recently connected device, so a slow reconnect can be
+ * pinned on the radio, the discovery, the settle waits or the toy itself.
+ */
+class ConnectionTimings
+{
+ public:
+  void record(uint64_t address, const ConnectionTiming& timing);
+
+  // replaces the newest entry of the device, for phases that complete after the link is up
+  void updateLatest(uint64_t address, const ConnectionTiming& timing);
+
+  size_t getDeviceCount() const
+  {
+    return _deviceCount;
+  }
+
+  uint64_t getAddress(size_t device) const
+  {
+    return _devices[device].address;
+  }
+
+  size_t getCount(size_t device) const
+  {
+    return _devices[device].count;
+  }
+
+  // 0 is the most recent setup
+  const ConnectionTiming& get(size_t device, size_t index) const;
+
+ private:
+  struct DeviceHistory
+  {
+    uint64_t address = 0;
+    unsigned long lastUsed = 0;
+    ConnectionTiming entries[BLE_TIMING_HISTORY];
+    size_t head = 0;
+    size_t count = 0;
+  };
+
+  DeviceHistory* find(uint64_t address);
+
+  DeviceHistory _devices[BLE_TIMING_DEVICES];
+  size_t _deviceCount = 0;
+};
+
+#endif
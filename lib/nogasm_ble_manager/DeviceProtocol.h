@@ -2,10 +2,16 @@
 #define DEVICE_PROTOCOL_H
 
 #include <Arduino.h>
-#include <NimBLEDevice.h>
+#include "BLEStack.h"
 #include <string>
 #include <functional>
 
+enum  CompatibleDeviceProtocol
+{
+  UNKNOWN,
+  LOVENSE
+};
+
 // Forward declaration for device info callback
 struct DeviceInfo
 {
@@ -15,6 +21,34 @@ struct DeviceInfo
   int batteryLevel = -1;
 };
 
+// Outputs set by level commands, in the order of the command writer's level slots
+enum class DeviceChannel : uint8_t
+{
+  VIBRATE,
+  ROTATE,
+  AIR_LEVEL
+};
+
+#define DEVICE_CHANNELS 3
+
+// Round trip of commands the device acknowledges, from the request until the reply arrived
+struct CommandLatencyStats
+{
+  uint32_t p50Us = 0;
+  uint32_t p95Us = 0;
+  uint32_t p99Us = 0;
+  uint32_t samples = 0;         // in the histogram window
+  uint32_t acknowledged = 0;
+  uint32_t unacknowledged = 0;  // skipped by the device or timed out
+  uint32_t writeFailed = 0;
+  uint8_t pending = 0;
+
+  // the same for commands written while a scan shared the radio
+  uint32_t scanP50Us = 0;
+  uint32_t scanP99Us = 0;
+  uint32_t scanSamples = 0;
+};
+
 // Device protocol interface
 class DeviceProtocol
 {
@@ -27,6 +61,11 @@ class DeviceProtocol
   virtual void clearCharacteristics() = 0;
   virtual bool isReady() const = 0;
 
+  // Notifications arrive on the BLE host task, the callback only copies them out,
+  // the owner hands them back through handleNotification() from its own task
+  virtual void setNotificationCallback(std::function<void(const uint8_t*, size_t)> callback) = 0;
+  virtual void handleNotification(const uint8_t* data, size_t length, uint32_t receivedMicros) = 0;
+
   // Device identification
   virtual bool isCompatibleServiceUUID(const std::string& uuid) = 0;
 
@@ -38,6 +77,11 @@ class DeviceProtocol
   virtual bool adjustAirLevelRelative(bool inflate, uint8_t amount) = 0;
   virtual bool powerOff() = 0;
 
+  // Emergency stop of every output the device has, always written even if the device should already be silent.
+  // Acknowledged once the device confirmed all of it, ackMicros is when the last confirmation arrived
+  virtual bool stop() = 0;
+  virtual bool isStopAcknowledged(uint32_t& ackMicros) const = 0;
+
   // Query functions
   virtual bool queryDeviceType() = 0;
   virtual bool queryBatteryLevel() = 0;
@@ -45,6 +89,19 @@ class DeviceProtocol
   // Info functions
   virtual String getModelDisplayName() const = 0;
 
+  // Latency tracking, the origin is when the next command was requested (it may sit in a queue before the write)
+  virtual void setCommandOrigin(unsigned long originMicros) = 0;
+  virtual CommandLatencyStats getLatencyStats() const = 0;
+
+  // commands written from now on count towards the scan latency as well
+  virtual void setScanRunning(bool running) = 0;
+
+  // Acknowledgement tracking, the level the device last confirmed on a channel, -1 before the first confirmation
+  virtual int16_t getConfirmedLevel(DeviceChannel channel) const = 0;
+
+  // commands written less than maxAgeUs ago that still wait for their reply
+  virtual uint8_t getInFlightCount(uint32_t maxAgeUs) const = 0;
+
   // Callbacks
   virtual void setDeviceInfoCallback(std::function<void(const DeviceInfo&)> callback) = 0;
   virtual void setBatteryLevelCallback(std::function<void(int)> callback) = 0;
@@ -0,0 +1,223 @@
+#include "DeviceTable.h"
+#include "BLEStack.h"
+
+DeviceTableEntry* DeviceTable::find(const uint64_t address)
+{
+  for (auto& entry : _entries)
+  {
+    if (entry.address == address)
+    {
+      return &entry;
+    }
+  }
+
+  return nullptr;
+}
+
+const DeviceTableEntry* DeviceTable::find(const uint64_t address) const
+{
+  for (const auto& entry : _entries)
+  {
+    if (entry.address == address)
+    {
+      return &entry;
+    }
+  }
+
+  return nullptr;
+}
+
+DeviceTableEntry* DeviceTable::insert(
+  const uint64_t address, const uint8_t addressType, const CompatibleDeviceProtocol protocol, const char* name, const unsigned long now)
+{
+  if (address == 0)
+  {
+    return nullptr;
+  }
+
+  DeviceTableEntry* existing = find(address);
+  if (existing != nullptr)
+  {
+    return existing;
+  }
+
+  // take a free entry, or evict the device we heard from longest ago
+  DeviceTableEntry* target = nullptr;
+  for (auto& entry : _entries)
+  {
+    if (!entry.isUsed())
+    {
+      target = &entry;
+      break;
+    }
+
+    if (!entry.connected && (target == nullptr || now - entry.lastSeen > now - target->lastSeen))
+    {
+      target = &entry;
+    }
+  }
+
+  if (target == nullptr)
+  {
+    return nullptr;
+  }
+
+  // the address goes in last, readers skip the entry until it is complete
+  target->address = 0;
+  target->addressType = addressType;
+  target->protocol = protocol;
+  strncpy(target->name, name, BLE_DEVICE_NAME_LENGTH - 1);
+  target->name[BLE_DEVICE_NAME_LENGTH - 1] = '\0';
+  target->rssi = 0;
+  target->lastSeen = now;
+  target->connected = false;
+  target->address = address;
+  _generation++;
+
+  return target;
+}
+
+void DeviceTable::updateRssi(DeviceTableEntry& entry, const int8_t rssi, const unsigned long now)
+{
+  const long shown = lroundf(entry.rssi);
+
+  // the first sample after insert() seeds the average
+  if (entry.rssi == 0)
+  {
+    entry.rssi = rssi;
+  }
+  else
+  {
+    entry.rssi += BLE_DEVICE_RSSI_SMOOTHING * (static_cast<float>(rssi) - entry.rssi);
+  }
+
+  entry.lastSeen = now;
+
+  if (lroundf(entry.rssi) != shown)
+  {
+    _generation++;
+  }
+}
+
+void DeviceTable::setConnected(const uint64_t address, const bool connected)
+{
+  DeviceTableEntry* entry = find(address);
+  if (entry != nullptr && entry->connected != connected)
+  {
+    entry->connected = connected;
+    _generation++;
+  }
+}
+
+size_t DeviceTable::age(const unsigned long now, const unsigned long maxAgeMs)
+{
+  size_t dropped = 0;
+  for (auto& entry : _entries)
+  {
+    if (entry.isUsed() && !entry.connected && now - entry.lastSeen > maxAgeMs)
+    {
+      entry.address = 0;
+      dropped++;
+    }
+  }
+
+  if (dropped > 0)
+  {
+    _generation++;
+  }
+
+  return dropped;
+}
+
+size_t DeviceTable::countSeenSince(const unsigned long since) const
+{
+  size_t count = 0;
+  for (const auto& entry : _entries)
+  {
+    if (entry.isUsed() && static_cast<long>(entry.lastSeen - since) >= 0)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+bool DeviceTable::isEmpty() const
+{
+  for (const auto& entry : _entries)
+  {
+    if (entry.isUsed())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void DeviceTable::copyTo(DeviceTableSnapshot& snapshot, const unsigned long now) const
+{
+  snapshot.takenAt = now;
+  for (size_t i = 0; i < BLE_DEVICE_TABLE_CAPACITY; i++)
+  {
+    snapshot.entries[i] = _entries[i];
+  }
+}
+
+uint64_t DeviceTable::packAddress(const std::string& address)
+{
+  uint64_t packed = 0;
+  int digits = 0;
+
+  for (const char c : address)
+  {
+    if (c == ':')
+    {
+      continue;
+    }
+
+    uint8_t nibble;
+    if (c >= '0' && c <= '9')
+    {
+      nibble = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+      nibble = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+      nibble = c - 'A' + 10;
+    }
+    else
+    {
+      return 0;
+    }
+
+    packed = packed << 4 | nibble;
+    digits++;
+  }
+
+  return digits == 12 ? packed : 0;
+}
+
+void DeviceTable::formatAddress(const uint64_t address, char* buffer)
+{
+  snprintf(buffer, BLE_DEVICE_ADDRESS_LENGTH, "%02x:%02x:%02x:%02x:%02x:%02x",  //
+    static_cast<uint8_t>(address >> 40), static_cast<uint8_t>(address >> 32), static_cast<uint8_t>(address >> 24),
+    static_cast<uint8_t>(address >> 16), static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address));
+}
+
+const char* DeviceTable::addressTypeString(const uint8_t addressType)
+{
+  switch (addressType)
+  {
+    case BLE_ADDR_PUBLIC:
+      return "PUBLIC";
+    case BLE_ADDR_RANDOM:
+      return "RANDOM";
+    default:
+      return "UNKNOWN";
+  }
+}
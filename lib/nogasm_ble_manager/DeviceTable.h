@@ -0,0 +1,90 @@
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <Arduino.h>
+#include "DeviceProtocol.h"
+
+#define BLE_DEVICE_TABLE_CAPACITY 16
+#define BLE_DEVICE_NAME_LENGTH 32
+#define BLE_DEVICE_ADDRESS_LENGTH 18    // "aa:bb:cc:dd:ee:ff" plus terminator
+#define BLE_DEVICE_RSSI_SMOOTHING 0.25f  // weight of a new advertisement in the smoothed rssi
+#define BLE_DEVICE_MAX_AGE_MS 60000      // devices not heard from for this long are dropped
+#define BLE_DEVICE_SNAPSHOT_INTERVAL_MS 250  // changes are published at most this often
+#define BLE_DEVICE_SNAPSHOT_REFRESH_MS 1000  // and at least this often while the table is not empty
+
+struct DeviceTableEntry
+{
+  uint64_t address = 0;  // packed 48 bit address, 0 marks a free entry
+  uint8_t addressType = 0;
+  CompatibleDeviceProtocol protocol = UNKNOWN;
+  char name[BLE_DEVICE_NAME_LENGTH] = {};
+  float rssi = 0;
+  unsigned long lastSeen = 0;
+  bool connected = false;
+
+  bool isUsed() const
+  {
+    return address != 0;
+  }
+};
+
+// a copy of all entries for readers on other tasks, ages are relative to takenAt
+struct DeviceTableSnapshot
+{
+  unsigned long takenAt = 0;
+  DeviceTableEntry entries[BLE_DEVICE_TABLE_CAPACITY];
+};
+
+/**
+ * Compatible devices seen by any scan, in a fixed array so advertisements never allocate.
+ * Entries survive across scans and age out when a device stops advertising, connected devices never age out.
+ * Only the main loop touches the table, other tasks read a published DeviceTableSnapshot.
+ */
+class DeviceTable
+{
+ public:
+  DeviceTableEntry* find(uint64_t address);
+  const DeviceTableEntry* find(uint64_t address) const;
+
+  // adds a device or returns the existing entry, nullptr when every entry holds a connected device
+  DeviceTableEntry* insert(uint64_t address, uint8_t addressType, CompatibleDeviceProtocol protocol, const char* name, unsigned long now);
+
+  void updateRssi(DeviceTableEntry& entry, int8_t rssi, unsigned long now);
+  void setConnected(uint64_t address, bool connected);
+
+  // frees entries not seen for maxAgeMs, returns how many were dropped
+  size_t age(unsigned long now, unsigned long maxAgeMs);
+
+  // devices seen at or after the given time
+  size_t countSeenSince(unsigned long since) const;
+  bool isEmpty() const;
+
+  // changes whenever an entry is added, dropped or changes what readers would show
+  uint32_t generation() const
+  {
+    return _generation;
+  }
+
+  void copyTo(DeviceTableSnapshot& snapshot, unsigned long now) const;
+
+  static constexpr size_t capacity()
+  {
+    return BLE_DEVICE_TABLE_CAPACITY;
+  }
+
+  const DeviceTableEntry& at(const size_t index) const
+  {
+    return _entries[index];
+  }
+
+  // "aa:bb:cc:dd:ee:ff" as NimBLEAddress::toString() prints it, 0 if it does not parse
+  static uint64_t packAddress(const std::string& address);
+  static void formatAddress(uint64_t address, char* buffer);
+  static const char* addressTypeString(uint8_t addressType);
+
+ private:
+  DeviceTableEntry _entries[BLE_DEVICE_TABLE_CAPACITY];
+  uint32_t _generation = 0;
+};
+
+#endif
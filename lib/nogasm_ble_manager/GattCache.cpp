@@ -0,0 +1,74 @@
+#include "GattCache.h"
+#include <Preferences.h>
+#include "Util.h"
+
+bool GattCache::load(const uint64_t address, GattCacheEntry& entry)
+{
+  char key[13];
+  makeKey(address, key);
+
+  Preferences preferences;
+  if (!preferences.begin(GATT_CACHE_NAMESPACE, true))
+  {
+    return false;
+  }
+
+  // entries written by an older layout are ignored and replaced after the next discovery
+  bool found = false;
+  if (preferences.isKey(key) && preferences.getBytesLength(key) == sizeof(GattCacheEntry))
+  {
+    found = preferences.getBytes(key, &entry, sizeof(GattCacheEntry)) == sizeof(GattCacheEntry) && entry.isValid();
+  }
+
+  preferences.end();
+
+  if (!found)
+  {
+    entry = GattCacheEntry();
+  }
+
+  return found;
+}
+
+bool GattCache::store(const uint64_t address, const GattCacheEntry& entry)
+{
+  char key[13];
+  makeKey(address, key);
+
+  Preferences preferences;
+  if (!preferences.begin(GATT_CACHE_NAMESPACE, false))
+  {
+    Util::logDebug("  > Cannot open gatt cache for writing");
+    return false;
+  }
+
+  const bool stored = preferences.putBytes(key, &entry, sizeof(GattCacheEntry)) == sizeof(GattCacheEntry);
+  preferences.end();
+
+  Util::logDebug("  > Gatt cache %s for %s", stored ? "updated" : "write failed", key);
+  return stored;
+}
+
+void GattCache::remove(const uint64_t address)
+{
+  char key[13];
+  makeKey(address, key);
+
+  Preferences preferences;
+  if (!preferences.begin(GATT_CACHE_NAMESPACE, false))
+  {
+    return;
+  }
+
+  if (preferences.isKey(key))
+  {
+    preferences.remove(key);
+  }
+
+  preferences.end();
+}
+
+void GattCache::makeKey(const uint64_t address, char* key)
+{
+  snprintf(key, 13, "%012llx", static_cast<unsigned long long>(address & 0xFFFFFFFFFFFFULL));
+}
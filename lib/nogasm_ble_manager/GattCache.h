@@ -0,0 +1,45 @@
+#ifndef GATT_CACHE_H
+#define GATT_CACHE_H
+
+#include <Arduino.h>
+
+#define GATT_CACHE_NAMESPACE "gatt"
+#define GATT_CACHE_VERSION 1
+#define GATT_CACHE_UUID_LENGTH 37   // 128 bit uuid string plus terminator
+#define GATT_CACHE_MODEL_LENGTH 16
+
+// what discovery found on a device, stored per address so a reconnect can skip it
+struct GattCacheEntry
+{
+  uint8_t version = 0;  // 0 marks an empty entry
+  char serviceUuid[GATT_CACHE_UUID_LENGTH] = {};
+  char writeUuid[GATT_CACHE_UUID_LENGTH] = {};
+  char notifyUuid[GATT_CACHE_UUID_LENGTH] = {};  // empty when the device has no notify characteristic
+  uint16_t serviceHandle = 0;
+  uint16_t writeHandle = 0;
+  uint16_t notifyHandle = 0;
+  char model[GATT_CACHE_MODEL_LENGTH] = {};
+
+  bool isValid() const
+  {
+    return version == GATT_CACHE_VERSION && serviceUuid[0] != '\0' && writeUuid[0] != '\0';
+  }
+};
+
+/**
+ * Service and characteristic handles of known devices in NVS, keyed by device address.
+ * Only touched from the main loop, entries are small blobs so a lookup is a single NVS read.
+ */
+class GattCache
+{
+ public:
+  bool load(uint64_t address, GattCacheEntry& entry);
+  bool store(uint64_t address, const GattCacheEntry& entry);
+  void remove(uint64_t address);
+
+ private:
+  // NVS keys are limited to 15 characters, the 12 hex digits of the address fit
+  static void makeKey(uint64_t address, char* key);
+};
+
+#endif
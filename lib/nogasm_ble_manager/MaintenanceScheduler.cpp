@@ -0,0 +1,97 @@
+#include "MaintenanceScheduler.h"
+
+void MaintenanceScheduler::reset(const unsigned long now)
+{
+  _deviceInfoDueAt = now;
+  _deviceInfoAttempts = 0;
+  _deviceInfoKnown = false;
+
+  // a reconnect keeps the learned battery interval, the toy did not get charged in between
+  _batteryDueAt = now;
+  _batteryAwaiting = false;
+
+  _rssiDueAt = now + BLE_RSSI_INTERVAL_MS;
+  _waiting = MaintenanceTask::NONE;
+}
+
+MaintenanceTask MaintenanceScheduler::next(const unsigned long now) const
+{
+  if (!_deviceInfoKnown && _deviceInfoAttempts < BLE_DEVICE_INFO_ATTEMPTS && isDue(now, _deviceInfoDueAt))
+  {
+    return MaintenanceTask::DEVICE_INFO;
+  }
+
+  if (isDue(now, _batteryDueAt))
+  {
+    return MaintenanceTask::BATTERY;
+  }
+
+  if (isDue(now, _rssiDueAt))
+  {
+    return MaintenanceTask::RSSI;
+  }
+
+  return MaintenanceTask::NONE;
+}
+
+void MaintenanceScheduler::deferred(const MaintenanceTask task)
+{
+  if (task != _waiting)
+  {
+    _waiting = task;
+    _deferredCount++;
+  }
+}
+
+void MaintenanceScheduler::issued(const MaintenanceTask task, const unsigned long now, const bool sessionActive)
+{
+  _waiting = MaintenanceTask::NONE;
+
+  switch (task)
+  {
+    case MaintenanceTask::DEVICE_INFO:
+      _deviceInfoDueAt = now + (BLE_DEVICE_INFO_RETRY_MS << _deviceInfoAttempts);
+      _deviceInfoAttempts++;
+      break;
+
+    case MaintenanceTask::BATTERY:
+      // the previous query went unanswered, ask less often
+      if (_batteryAwaiting && _batteryIntervalMs < BLE_BATTERY_MAX_INTERVAL_MS)
+      {
+        _batteryIntervalMs = min(_batteryIntervalMs * 2, static_cast<unsigned long>(BLE_BATTERY_MAX_INTERVAL_MS));
+      }
+      _batteryAwaiting = true;
+      _batteryDueAt = now + _batteryIntervalMs * (sessionActive ? BLE_BATTERY_SESSION_FACTOR : 1);
+      break;
+
+    case MaintenanceTask::RSSI:
+      _lastRssiAt = now;
+      _rssiDueAt = now + (sessionActive ? BLE_RSSI_SESSION_INTERVAL_MS : BLE_RSSI_INTERVAL_MS);
+      break;
+
+    case MaintenanceTask::NONE:
+      break;
+  }
+}
+
+void MaintenanceScheduler::deviceInfoReceived()
+{
+  _deviceInfoKnown = true;
+}
+
+void MaintenanceScheduler::batteryReceived(const int level, const unsigned long now)
+{
+  // a level that does not move needs no close watch, any change goes back to the base interval
+  if (level == _lastBatteryLevel)
+  {
+    _batteryIntervalMs = min(_batteryIntervalMs * 2, static_cast<unsigned long>(BLE_BATTERY_MAX_INTERVAL_MS));
+  }
+  else
+  {
+    _batteryIntervalMs = BLE_BATTERY_INTERVAL_MS;
+  }
+
+  _lastBatteryLevel = level;
+  _lastBatteryAt = now;
+  _batteryAwaiting = false;
+}
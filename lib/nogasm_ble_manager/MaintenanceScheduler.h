@@ -0,0 +1,89 @@
+#ifndef MAINTENANCE_SCHEDULER_H
+#define MAINTENANCE_SCHEDULER_H
+
+#include <Arduino.h>
+
+#define BLE_MAINTENANCE_QUIET_MS 250          // no housekeeping this soon after a level write to the link
+#define BLE_RSSI_INTERVAL_MS 2000
+#define BLE_RSSI_SESSION_INTERVAL_MS 10000
+#define BLE_BATTERY_INTERVAL_MS 60000         // doubles while the level stays the same or the toy does not answer
+#define BLE_BATTERY_MAX_INTERVAL_MS 960000
+#define BLE_BATTERY_SESSION_FACTOR 4          // battery polls are this much rarer while a session runs
+#define BLE_DEVICE_INFO_RETRY_MS 5000         // doubles with every unanswered query
+#define BLE_DEVICE_INFO_ATTEMPTS 4
+
+enum class MaintenanceTask : uint8_t
+{
+  NONE,
+  DEVICE_INFO,
+  BATTERY,
+  RSSI
+};
+
+/**
+ * Housekeeping of one connected link: device info, battery and signal strength.
+ * Decides what is due, the manager only runs it when the link had no level write for a while,
+ * so these queries never sit between the toy and a vibration change.
+ */
+class MaintenanceScheduler
+{
+ public:
+  // a new connection, device info and battery are due right away, rssi after its interval
+  void reset(unsigned long now);
+
+  // the most important task that is due, one per slot so a quiet gap carries a single query
+  MaintenanceTask next(unsigned long now) const;
+
+  // a task was due but the link was busy, counted once per task
+  void deferred(MaintenanceTask task);
+
+  void issued(MaintenanceTask task, unsigned long now, bool sessionActive);
+
+  void deviceInfoReceived();
+  void batteryReceived(int level, unsigned long now);
+
+  unsigned long getBatteryIntervalMs() const
+  {
+    return _batteryIntervalMs;
+  }
+
+  // when the last answer arrived, 0 before the first one
+  unsigned long getLastBatteryAt() const
+  {
+    return _lastBatteryAt;
+  }
+
+  unsigned long getLastRssiAt() const
+  {
+    return _lastRssiAt;
+  }
+
+  uint32_t getDeferredCount() const
+  {
+    return _deferredCount;
+  }
+
+ private:
+  static bool isDue(unsigned long now, unsigned long dueAt)
+  {
+    return static_cast<long>(now - dueAt) >= 0;
+  }
+
+  unsigned long _deviceInfoDueAt = 0;
+  uint8_t _deviceInfoAttempts = 0;
+  bool _deviceInfoKnown = false;
+
+  unsigned long _batteryDueAt = 0;
+  unsigned long _batteryIntervalMs = BLE_BATTERY_INTERVAL_MS;
+  unsigned long _lastBatteryAt = 0;
+  int _lastBatteryLevel = -1;
+  bool _batteryAwaiting = false;
+
+  unsigned long _rssiDueAt = 0;
+  unsigned long _lastRssiAt = 0;
+
+  MaintenanceTask _waiting = MaintenanceTask::NONE;
+  uint32_t _deferredCount = 0;
+};
+
+#endif
@@ -12,7 +12,11 @@ static NogasmBLEManager* s_instance = nullptr;
 NogasmBLEManager::NogasmBLEManager(NogasmConfig& config) : _config(config)
 {
   _scanCallbacks = new ScanCallbacks(this);
-  _clientCallbacks = new ClientCallbacks(this);
+  for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+  {
+    _links[i].index = i;
+    _clientCallbacks[i] = new ClientCallbacks(this, i, 0);
+  }
 
   // Set configuration parameters
   _connectionTimeoutMs = config.getConnectionTimeout();
@@ -24,10 +28,16 @@ NogasmBLEManager::NogasmBLEManager(NogasmConfig& config) : _config(config)
 
 NogasmBLEManager::~NogasmBLEManager()
 {
-  disconnectAndCleanupClient();
+  for (auto& link : _links)
+  {
+    disconnectAndCleanupClient(link);
+  }
 
   delete _scanCallbacks;
-  delete _clientCallbacks;
+  for (const auto* callbacks : _clientCallbacks)
+  {
+    delete callbacks;
+  }
 
   s_instance = nullptr;
 }
@@ -36,28 +46,119 @@ NogasmBLEManager::~NogasmBLEManager()
 void NogasmBLEManager::begin(const char* deviceName) // NOLINT(*-convert-member-functions-to-static)
 {
   NimBLEDevice::init(deviceName);
+  _commandWriter.begin();
   Util::logInfo("Nogasm BLE Manager initialized with name: %s", deviceName);
 }
 
 void NogasmBLEManager::startScan(const uint32_t durationMs)
 {
-  // we can only start scans from idle or failed states
-  if (_state != BLE_IDLE && _state != BLE_FAILED)
+  // connected links may stay up while we look for more devices, links that are still connecting may not
+  if (_scanActive || isAnyLinkBusy())
   {
-    Util::logInfo("Cannot start scan, BLE is busy. Current state: %s", getStateString(_state).c_str());
+    Util::logInfo("Cannot start scan, BLE is busy. Current state: %s", getStateString(getState()).c_str());
     return;
   }
 
+  // failed links are done with, release them before the scan
+  for (auto& link : _links)
+  {
+    if (link.state == BLE_FAILED)
+    {
+      disconnectAndCleanupClient(link);
+      link.state = BLE_IDLE;
+    }
+  }
+
   Util::logDebug("Starting BLE scan for compatible devices...");
 
+  // replaces a running background scan, start() restarts the scanner with the new parameters
+  _backgroundScanActive = false;
+
+  // the scan ends early once the last device answers, unless it already has a link
+  const String lastDevice = _config.getLastConnectedDevice();
+  _lastDeviceSeen = false;
+  _lastDeviceAddress = 0;
+  if (_autoConnectEnabled && !lastDevice.isEmpty() && findLink(lastDevice.c_str()) == nullptr)
+  {
+    _lastDeviceAddress = DeviceTable::packAddress(lastDevice.c_str());
+  }
+
   NimBLEScan* pScan = NimBLEDevice::getScan();
   pScan->setScanCallbacks(_scanCallbacks);
-  pScan->setActiveScan(true);
+  configureUserScan(pScan);
   pScan->setMaxResults(0);
   pScan->start(durationMs, false, true);
 
   // change state to scanning, result handling is async
-  updateStatus(BLE_SCANNING, "Start scanning");
+  _scanStartTime = NogasmClock::millis();
+  _scanDurationMs = durationMs;
+  setScanActive(true, _scanDowngraded ? "Start passive scanning, session running" : "Start scanning");
+}
+
+void NogasmBLEManager::configureUserScan(NimBLEScan* scan)
+{
+  // during a session the connected toys get the radio, the scan only listens now and then
+  _scanDowngraded = _sessionActive;
+  scan->setActiveScan(!_scanDowngraded);
+
+  // passive scans have no scan responses the filter could swallow, the controller drops repeats
+  scan->setDuplicateFilter(_scanDowngraded ? 1 : 0);
+  scan->setInterval(_scanDowngraded ? BLE_SESSION_SCAN_INTERVAL_MS : BLE_ACTIVE_SCAN_INTERVAL_MS);
+  scan->setWindow(_scanDowngraded ? BLE_SESSION_SCAN_WINDOW_MS : BLE_ACTIVE_SCAN_WINDOW_MS);
+}
+
+void NogasmBLEManager::restartUserScan()
+{
+  // keeps the original end time, a scan that is about to end is left alone
+  const unsigned long elapsed = NogasmClock::millis() - _scanStartTime;
+  if (_scanDurationMs != 0 && elapsed >= _scanDurationMs)
+  {
+    return;
+  }
+
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  configureUserScan(pScan);
+  pScan->start(_scanDurationMs == 0 ? 0 : _scanDurationMs - elapsed, false, true);
+  Util::logDebug("Scan switched to %s", _scanDowngraded ? "passive, session running" : "active");
+}
+
+void NogasmBLEManager::updateBackgroundScan()
+{
+  // the background scan gives way to user scans, sessions and links that are connecting
+  const bool wanted = _config.getBackgroundScan() && !_scanActive && !_sessionActive && !isAnyLinkBusy();
+
+  // the controller reports every device once per scan, a restart lets known devices refresh their entry
+  if (wanted && _backgroundScanActive && Util::hasTimeExpired(BLE_BACKGROUND_SCAN_REFRESH_MS, _backgroundScanStart))
+  {
+    _backgroundScanStart = NogasmClock::millis();
+    NimBLEDevice::getScan()->start(0, false, true);
+    return;
+  }
+
+  if (wanted == _backgroundScanActive)
+  {
+    return;
+  }
+
+  NimBLEScan* pScan = NimBLEDevice::getScan();
+  if (!wanted)
+  {
+    Util::logDebug("Stopping background scan");
+    _backgroundScanActive = false;
+    pScan->stop();
+    return;
+  }
+
+  // passive and low duty, refreshes known devices and picks up toys that advertise their name
+  Util::logDebug("Starting background scan");
+  pScan->setScanCallbacks(_scanCallbacks);
+  pScan->setActiveScan(false);
+  pScan->setInterval(BLE_BACKGROUND_SCAN_INTERVAL_MS);
+  pScan->setWindow(BLE_BACKGROUND_SCAN_WINDOW_MS);
+  pScan->setDuplicateFilter(1);
+  pScan->setMaxResults(0);
+  _backgroundScanActive = pScan->start(0, false, true);
+  _backgroundScanStart = NogasmClock::millis();
 }
 
 void NogasmBLEManager::stopScan()
@@ -93,18 +194,28 @@ std::string NogasmBLEManager::getStateString(const BLEConnectionState state)
   }
 }
 
-bool NogasmBLEManager::createProtocolForDevice(const CompatibleDevice& device)
+const char* NogasmBLEManager::getLinkProfileString(const BLELinkProfile profile)
 {
-  if (!_deviceProtocol)
+  switch (profile)
   {
-    // create default protocol
-    _deviceProtocol = std::unique_ptr<DeviceProtocol>(new LovenseProtocol());
+    case LINK_PROFILE_LOW_LATENCY:
+      return "LOW_LATENCY";
+    case LINK_PROFILE_POWER:
+      return "POWER";
+    default:
+      return "NONE";
   }
+}
+
+bool NogasmBLEManager::createProtocolForDevice(DeviceLink& link, const CompatibleDevice& device)
+{
+  // the writer task must not touch the protocol we are about to replace
+  _commandWriter.setProtocol(link.index, nullptr);
 
   if (device.protocol == LOVENSE)
   {
     Util::logTrace("Setting up lovense protocol for device: %s", device.name.c_str());
-    _deviceProtocol.reset(new LovenseProtocol());
+    link.protocol.reset(new LovenseProtocol());
   }
   else
   {
@@ -112,30 +223,123 @@ bool NogasmBLEManager::createProtocolForDevice(const CompatibleDevice& device)
     return false;
   }
 
-  _deviceProtocol->setDeviceInfoCallback(
-    [this](const DeviceInfo& info)
+  // called on the BLE host task, the notification is only copied into the event queue
+  const uint8_t index = link.index;
+  const uint16_t generation = link.generation;
+  link.protocol->setNotificationCallback(
+    [this, index, generation](const uint8_t* data, const size_t length)
+    {
+      BLEEvent event;
+      event.type = BLEEventType::NOTIFICATION;
+      event.link = index;
+      event.generation = generation;
+      event.receivedMicros = NogasmClock::micros();
+      event.length = static_cast<uint8_t>(length < BLE_EVENT_PAYLOAD ? length : BLE_EVENT_PAYLOAD);
+      memcpy(event.data, data, event.length);
+      pushEvent(event);
+    });
+
+  link.protocol->setDeviceInfoCallback(
+    [this, &link](const DeviceInfo& info)
     {
       Util::logDebug("Got device info: Model=%s, Battery=%d%, Firmware=%s", info.modelType.c_str(), info.batteryLevel, info.firmwareVersion.c_str());
-      _currentDevice.modelDisplayName = info.modelType;
-      _currentDevice.firmwareVersion = info.firmwareVersion;
+      link.device.modelDisplayName = info.modelType;
+      link.device.firmwareVersion = info.firmwareVersion;
+      link.maintenance.deviceInfoReceived();
+
+      // the last phase of the setup, the toy answering its first query
+      if (link.connectedUs != 0 && link.timing.deviceInfoUs == 0)
+      {
+        link.timing.deviceInfoUs = NogasmClock::micros() - link.connectedUs;
+        _connectionTimings.updateLatest(DeviceTable::packAddress(link.device.address), link.timing);
+        _connectionTimingsSnapshot.write(_connectionTimings);
+      }
     });
 
-  _deviceProtocol->setBatteryLevelCallback(
-    [this](const int level)
+  link.protocol->setBatteryLevelCallback(
+    [&link](const int level)
     {
       Util::logDebug("Got battery level: %d%", level);
-      _currentDevice.batteryLevel = level;
+      link.device.batteryLevel = level;
+      link.maintenance.batteryReceived(level, NogasmClock::millis());
     });
 
   return true;
 }
 
+DeviceLink* NogasmBLEManager::findLink(const std::string& address)
+{
+  for (auto& link : _links)
+  {
+    if (link.state != BLE_IDLE && link.device.address == address)
+    {
+      return &link;
+    }
+  }
+
+  return nullptr;
+}
+
+DeviceLink* NogasmBLEManager::findFreeLink()
+{
+  for (auto& link : _links)
+  {
+    if (link.state == BLE_IDLE || link.state == BLE_FAILED)
+    {
+      return &link;
+    }
+  }
+
+  return nullptr;
+}
+
+bool NogasmBLEManager::isLinkReady(const DeviceLink& link)
+{
+  return link.state == BLE_CONNECTED && link.protocol && link.protocol->isReady();
+}
+
+bool NogasmBLEManager::isLinkBusy(const DeviceLink& link)
+{
+  // a link waiting in the slow retry tier does not hold up scans
+  return link.state == BLE_CONNECTING || link.state == BLE_FINDING_SERVICE ||
+         (link.state == BLE_RECONNECTING && !link.reconnect.isSlowTier());
+}
+
+bool NogasmBLEManager::isAnyLinkBusy() const
+{
+  for (const auto& link : _links)
+  {
+    if (isLinkBusy(link))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void NogasmBLEManager::connectToDevice(const std::string& address)
 {
-  // only allow connections when we transition from idle, scanning, reconnecting or failed.
-  if (_state != BLE_IDLE && _state != BLE_SCANNING && _state != BLE_FAILED && _state != BLE_RECONNECTING)
+  // reconnects reuse their link, new devices take a free one
+  DeviceLink* link = findLink(address);
+  if (link == nullptr)
+  {
+    link = findFreeLink();
+    if (link == nullptr)
+    {
+      Util::logInfo("Cannot connect, all %d links are in use", BLE_MAX_LINKS);
+      return;
+    }
+
+    // a new device starts with the default output mapping
+    link->mapping = LinkOutputMapping();
+    link->reconnect.reset();
+  }
+
+  // only allow connections when the link transitions from idle, reconnecting or failed.
+  if (link->state != BLE_IDLE && link->state != BLE_FAILED && link->state != BLE_RECONNECTING)
   {
-    Util::logInfo("Cannot connect, BLE is busy. Current state: %s", getStateString(_state).c_str());
+    Util::logInfo("Cannot connect, link %d is busy. Current state: %s", link->index, getStateString(link->state).c_str());
     return;
   }
 
@@ -144,375 +348,991 @@ void NogasmBLEManager::connectToDevice(const std::string& address)
     stopScan();
   }
 
+  if (_backgroundScanActive)
+  {
+    _backgroundScanActive = false;
+    NimBLEDevice::getScan()->stop();
+  }
+
   // find the device in the scan results
-  bool deviceFound = false;
-  for (const auto& device : _devices)
+  const DeviceTableEntry* entry = _devices.find(DeviceTable::packAddress(address));
+  if (entry == nullptr)
   {
-    if (device.address == address)
-    {
-      if (!createProtocolForDevice(device))
-      {
-        updateStatus(BLE_FAILED, "Failed to create device protocol!");
-        break;
-      }
+    Util::logDebug("Device not found in scan results: %s", address.c_str());
+    updateStatus(*link, BLE_FAILED, "Device not found in scan results");
+    return;
+  }
 
-      _currentDevice = device;
-      deviceFound = true;
-      break;
-    }
+  char addressStr[BLE_DEVICE_ADDRESS_LENGTH];
+  DeviceTable::formatAddress(entry->address, addressStr);
+
+  CompatibleDevice device;
+  device.protocol = entry->protocol;
+  device.address = addressStr;
+  device.addressType = DeviceTable::addressTypeString(entry->addressType);
+  device.name = entry->name;
+  device.rssi = static_cast<int8_t>(entry->rssi);
+
+  // known devices skip the full service discovery, the model is shown before the toy answers again
+  link->gattCached = _gattCache.load(entry->address, link->gatt);
+  link->gattDirty = false;
+  if (link->gattCached)
+  {
+    device.modelDisplayName = link->gatt.model;
   }
 
-  if (!deviceFound)
+  // clean up existing client if any, before its protocol goes away
+  disconnectAndCleanupClient(*link);
+
+  if (!createProtocolForDevice(*link, device))
   {
-    Util::logDebug("Device not found in scan results: %s", address.c_str());
-    updateStatus(BLE_FAILED, "Device not found in scan results");
+    updateStatus(*link, BLE_FAILED, "Failed to create device protocol!");
     return;
   }
 
-  Util::logDebug("Connecting to %s (%s) - type: %s",  //
-    _currentDevice.name.c_str(), _currentDevice.address.c_str(), _currentDevice.addressType.c_str());
+  link->device = device;
 
-  // clean up existing client if any
-  disconnectAndCleanupClient();
+  Util::logDebug("Connecting link %d to %s (%s) - type: %s",  //
+    link->index, link->device.name.c_str(), link->device.address.c_str(), link->device.addressType.c_str());
 
   // create fresh callback objects for each connection
-  delete _clientCallbacks;
-  _clientCallbacks = new ClientCallbacks(this);
+  delete _clientCallbacks[link->index];
+  _clientCallbacks[link->index] = new ClientCallbacks(this, link->index, link->generation);
 
   // protect against overused clients
   if (NimBLEDevice::getCreatedClientCount() >= NIMBLE_MAX_CONNECTIONS)
   {
-    updateStatus(BLE_FAILED, "Max clients reached - no more connections available");
+    updateStatus(*link, BLE_FAILED, "Max clients reached - no more connections available");
     return;
   }
 
   // create a new client
-  _client = NimBLEDevice::createClient();
-  _client->setClientCallbacks(_clientCallbacks);
-  _client->setConnectionParams(12, 15, 0, 250);
-  _client->setConnectTimeout(_config.getConnectionTimeout());
+  link->client = NimBLEDevice::createClient();
+  link->client->setClientCallbacks(_clientCallbacks[link->index]);
+  link->client->setConnectionParams(12, 15, 0, 250);
+  link->client->setConnectTimeout(_config.getConnectionTimeout());
 
   // and hand over to state machine
-  updateStatus(BLE_CONNECTING, "Connecting to device...");
+  updateStatus(*link, BLE_CONNECTING, "Connecting to device...");
+}
+
+void NogasmBLEManager::updateDeviceState(DeviceLink& link, const bool connected)
+{
+  // update the link's device
+  link.device.connected = connected;
+
+  // connected devices are kept in the table, they may not advertise while connected
+  _devices.setConnected(DeviceTable::packAddress(link.device.address), connected);
+  Util::logTrace("  > Updated device %s in table to connected=%d", link.device.name.c_str(), connected);
 }
 
-void NogasmBLEManager::updateDeviceState(const bool connected)
+void NogasmBLEManager::disconnect(const std::string& address)
 {
-  // update the current device
-  _currentDevice.connected = connected;
+  DeviceLink* link = findLink(address);
+  if (link == nullptr)
+  {
+    return;
+  }
+
+  disconnectAndCleanupClient(*link);
+  updateStatus(*link, BLE_IDLE, "User disconnect");
+}
 
-  // find and update the same device in the devices vector
-  for (auto& device : _devices)
+void NogasmBLEManager::disconnectAll()
+{
+  for (auto& link : _links)
   {
-    if (device.address == _currentDevice.address)
+    if (link.state == BLE_IDLE)
     {
-      device.connected = connected;
-      Util::logTrace("  > Updated device %s in vector to connected=%d", device.name.c_str(), connected);
-      break;
+      continue;
     }
+
+    disconnectAndCleanupClient(link);
+    updateStatus(link, BLE_IDLE, "User disconnect");
   }
 }
 
-void NogasmBLEManager::disconnectAndCleanupClient()
+void NogasmBLEManager::disconnectAndCleanupClient(DeviceLink& link)
 {
-  Util::logDebug("  > Cleaning up ble client...");
+  Util::logDebug("  > Cleaning up ble client of link %d...", link.index);
+
+  updateDeviceState(link, false);
 
-  updateDeviceState(false);
+  // detach the writer before the characteristics go away
+  _commandWriter.setProtocol(link.index, nullptr);
+  _commandWriter.clear(link.index);
 
-  if (_deviceProtocol)
+  if (link.protocol)
   {
-    _deviceProtocol->clearCharacteristics();
+    link.protocol->clearCharacteristics();
   }
 
-  if (_client != nullptr)
+  if (link.client != nullptr)
   {
-    if (_client->isConnected())
+    if (link.client->isConnected())
     {
-      _client->disconnect();
+      link.client->disconnect();
     }
 
     // set the callbacks to nullptr first to prevent any pending callbacks
-    _client->setClientCallbacks(nullptr);
+    link.client->setClientCallbacks(nullptr);
 
-    NimBLEDevice::deleteClient(_client);
-    _client = nullptr;
+    NimBLEDevice::deleteClient(link.client);
+    link.client = nullptr;
   }
 
-  _writeCharacteristic = nullptr;
-  _notifyCharacteristic = nullptr;
-  _service = nullptr;
+  // whatever the old client still has queued is stale now
+  link.generation++;
 
-  delay(100);
+  link.writeCharacteristic = nullptr;
+  link.notifyCharacteristic = nullptr;
+  link.service = nullptr;
+  link.testPulseActive = false;
+  link.profile = LINK_PROFILE_NONE;
+  link.hostProfile.store(LINK_PROFILE_NONE, std::memory_order_relaxed);
+  link.params = LinkParams();
+
+  // the next connect() waits for the stack to settle instead of blocking here
+  link.lastCleanupTime = NogasmClock::millis();
 }
 
-bool NogasmBLEManager::setVibrationLevel(const uint8_t level) const
+bool NogasmBLEManager::submitLevel(const DeviceCommandType type, const uint8_t level)
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
+  int16_t levels[BLE_MAX_LINKS];
+  bool anyReady = false;
+
+  for (auto& link : _links)
   {
-    return false;
+    levels[link.index] = -1;
+    if (!isLinkReady(link))
+    {
+      continue;
+    }
+
+    if (type == DeviceCommandType::VIBRATE)
+    {
+      // an explicit level overrides the end of a pending test pulse
+      link.testPulseActive = false;
+      levels[link.index] = link.mapping.apply(level);
+    }
+    else
+    {
+      levels[link.index] = level;
+    }
+    anyReady = true;
   }
 
-  return _deviceProtocol->setVibration(level);
+  // one batch, so all devices change level in the same writer pass
+  return anyReady && _commandWriter.submitBatch(type, levels);
 }
 
-bool NogasmBLEManager::setRotationLevel(const uint8_t level) const
+bool NogasmBLEManager::submitToLinks(const DeviceCommandType type, const uint8_t value, const bool inflate)
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
+  bool submitted = false;
+  for (const auto& link : _links)
   {
-    return false;
+    if (isLinkReady(link))
+    {
+      submitted |= _commandWriter.submit({type, value, inflate, link.index});
+    }
   }
 
-  return _deviceProtocol->setRotation(level);
+  return submitted;
 }
 
-bool NogasmBLEManager::changeRotationDirection() const
+bool NogasmBLEManager::setVibrationLevel(const uint8_t level)
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
-  {
-    return false;
-  }
-
-  return _deviceProtocol->changeRotationDirection();
+  _vibrationLevel = level;
+  return submitLevel(DeviceCommandType::VIBRATE, level);
 }
 
-bool NogasmBLEManager::setAirLevel(const uint8_t level) const
+bool NogasmBLEManager::setRotationLevel(const uint8_t level)
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
-  {
-    return false;
-  }
-
-  return _deviceProtocol->setAirLevel(level);
+  return submitLevel(DeviceCommandType::ROTATE, level);
 }
 
-bool NogasmBLEManager::adjustAirLevelRelative(const bool inflate, const uint8_t amount) const
+bool NogasmBLEManager::changeRotationDirection()
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
-  {
-    return false;
-  }
-
-  return _deviceProtocol->adjustAirLevelRelative(inflate, amount);
+  return submitToLinks(DeviceCommandType::ROTATE_CHANGE, 0, false);
 }
 
-bool NogasmBLEManager::powerOffDevice() const
+bool NogasmBLEManager::setAirLevel(const uint8_t level)
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
-  {
-    return false;
-  }
-
-  return _deviceProtocol->powerOff();
+  return submitLevel(DeviceCommandType::AIR_LEVEL, level);
 }
 
-bool NogasmBLEManager::queryBatteryLevel() const
+bool NogasmBLEManager::adjustAirLevelRelative(const bool inflate, const uint8_t amount)
 {
-  if (!_deviceProtocol || !_deviceProtocol->isReady())
-  {
-    return false;
-  }
-
-  return _deviceProtocol->queryBatteryLevel();
+  return submitToLinks(DeviceCommandType::AIR_ADJUST, amount, inflate);
 }
 
-const std::vector<CompatibleDevice>& NogasmBLEManager::getDevices() const
+bool NogasmBLEManager::powerOffDevice()
 {
-  return _devices;
+  return submitToLinks(DeviceCommandType::POWER_OFF, 0, false);
 }
 
-const CompatibleDevice* NogasmBLEManager::getCurrentDevice() const
+bool NogasmBLEManager::queryBatteryLevel()
 {
-  if (_currentDevice.connected)
-  {
-    return &_currentDevice;
-  }
-
-  return nullptr;
+  return submitToLinks(DeviceCommandType::QUERY_BATTERY, 0, false);
 }
 
-BLEConnectionState NogasmBLEManager::getState() const
+void NogasmBLEManager::emergencyStop()
 {
-  return _state;
+  // flagged before the stop goes out, a test pulse that ends in between must not bring the output back
+  _stopPending.store(true, std::memory_order_release);
+  _commandWriter.emergencyStop();
 }
 
-bool NogasmBLEManager::isScanning() const
+DeviceTableSnapshot NogasmBLEManager::getDevicesSnapshot() const
 {
-  return _scanActive;
+  return _devicesSnapshot.read();
 }
 
-bool NogasmBLEManager::isConnectedState() const
+uint32_t NogasmBLEManager::getDevicesGeneration() const
 {
-  return _state == BLE_CONNECTED && _currentDevice.connected;
+  return _devicesSnapshot.sequence();
 }
 
-void NogasmBLEManager::onStatusChange(const std::function<void(BLEConnectionState)>& callback)
+void NogasmBLEManager::publishDevices()
 {
-  _statusCallback = callback;
+  DeviceTableSnapshot snapshot;
+  _devices.copyTo(snapshot, NogasmClock::millis());
+  _devicesSnapshot.write(snapshot);
+
+  _snapshotGeneration = _devices.generation();
+  _lastSnapshotTime = snapshot.takenAt;
 }
 
-bool NogasmBLEManager::connectToLastDevice()
+const CompatibleDevice* NogasmBLEManager::getCurrentDevice() const
 {
-  const String lastDeviceAddr = _config.getLastConnectedDevice();
-  if (lastDeviceAddr.isEmpty())
+  // the first connected link is the primary device
+  for (const auto& link : _links)
   {
-    Util::logDebug("  > No last device to reconnect to");
-    return false;
+    if (link.device.connected)
+    {
+      return &link.device;
+    }
   }
 
-  bool deviceFound = false;
-  for (const auto& device : _devices)
+  return nullptr;
+}
+
+void NogasmBLEManager::publishStatus()
+{
+  BLEStatusSnapshot snapshot;
+  snapshot.takenAt = NogasmClock::millis();
+  snapshot.state = getState();
+  snapshot.scanning = isScanning();
+  snapshot.scanPassive = isScanDowngraded();
+  snapshot.sessionActive = _sessionActive;
+  snapshot.connected = isConnectedState();
+
+  for (const auto& link : _links)
   {
-    if (device.address == lastDeviceAddr.c_str())
+    LinkStatus& status = snapshot.links[link.index];
+    status.index = link.index;
+    status.state = link.state;
+    _publishedStates[link.index] = link.state;
+    if (link.state == BLE_IDLE)
     {
-      deviceFound = true;
-      break;
+      continue;
     }
-  }
 
-  if (!deviceFound)
-  {
-    Util::logDebug("  > Last device not found in scan results");
-    return false;
+    status.connected = link.device.connected;
+    status.address = DeviceTable::packAddress(link.device.address);
+    strncpy(status.addressType, link.device.addressType.c_str(), sizeof(status.addressType) - 1);
+    strncpy(status.name, link.device.name.c_str(), BLE_DEVICE_NAME_LENGTH - 1);
+    strncpy(status.model, link.device.modelDisplayName.c_str(), GATT_CACHE_MODEL_LENGTH - 1);
+    strncpy(status.firmwareVersion, link.device.firmwareVersion.c_str(), BLE_LINK_FIRMWARE_LENGTH - 1);
+    status.batteryLevel = link.device.batteryLevel;
+    status.rssi = link.device.rssi;
+    status.mapping = link.mapping;
+    status.profile = link.profile;
+    status.params = link.params;
+
+    const ReconnectScheduler& reconnect = link.reconnect;
+    status.reconnectAttempts = reconnect.getAttempts();
+    status.reconnectNextInMs = reconnect.getNextAttemptIn(snapshot.takenAt);
+    status.reconnectSlow = reconnect.isSlowTier();
+    status.lastRecoveryMs = reconnect.getLastRecoveryMs();
+    status.reconnectHistoryCount = static_cast<uint8_t>(reconnect.getHistoryCount());
+    for (size_t h = 0; h < reconnect.getHistoryCount(); h++)
+    {
+      status.reconnectHistory[h] = reconnect.getHistory(h);
+    }
+
+    const MaintenanceScheduler& maintenance = link.maintenance;
+    status.batteryIntervalMs = maintenance.getBatteryIntervalMs();
+    status.batteryAgeMs = maintenance.getLastBatteryAt() ? static_cast<long>(snapshot.takenAt - maintenance.getLastBatteryAt()) : -1;
+    status.rssiAgeMs = maintenance.getLastRssiAt() ? static_cast<long>(snapshot.takenAt - maintenance.getLastRssiAt()) : -1;
+    status.maintenanceDeferred = maintenance.getDeferredCount();
+
+    if (link.protocol)
+    {
+      status.hasProtocol = true;
+      status.latency = link.protocol->getLatencyStats();
+      status.confirmedVibration = link.protocol->getConfirmedLevel(DeviceChannel::VIBRATE);
+    }
+
+    if (snapshot.primary < 0 && status.connected)
+    {
+      snapshot.primary = static_cast<int8_t>(link.index);
+    }
   }
 
-  Util::logDebug("  > Attempting to reconnect to last device: %s", lastDeviceAddr.c_str());
-  connectToDevice(lastDeviceAddr.c_str());
-  return true;
+  _statusSnapshot.write(snapshot);
+  _lastStatusTime = snapshot.takenAt;
+  _statusChanged = false;
 }
 
-bool NogasmBLEManager::shouldTryReconnect()
+bool NogasmBLEManager::setLinkMapping(const std::string& address, const LinkOutputMapping& mapping)
 {
-  if (!_autoReconnectEnabled)
+  // checked against the snapshot, the loop finds the link again when it applies the change
+  const uint64_t packed = DeviceTable::packAddress(address);
+  const BLEStatusSnapshot status = getStatusSnapshot();
+  bool found = false;
+  for (const auto& link : status.links)
   {
-    Util::logDebug("Auto-reconnect not enabled");
-    return false;
+    found |= link.state != BLE_IDLE && link.address == packed;
   }
 
-  Util::logDebug("Trying to reconnect...");
-  if (++_reconnectAttempts > MAX_RECONNECT_ATTEMPTS)
+  if (!found)
   {
-    Util::logDebug("  > Max reconnection attempts reached");
-    _reconnectAttempts = 0;
     return false;
   }
 
-  Util::logDebug("  > Attempt %d of %d", _reconnectAttempts, MAX_RECONNECT_ATTEMPTS);
-  return true;
+  BLERequest request;
+  request.type = BLERequestType::LINK_MAPPING;
+  DeviceTable::formatAddress(packed, request.address);
+  request.mapping = mapping;
+  return _requests.push(request);
 }
 
-void NogasmBLEManager::update()
+bool NogasmBLEManager::requestConnect(const std::string& address)
 {
-  processConnectionStateMachine();
-  delay(BLE_STABILISE_DELAY_MS);
+  BLERequest request;
+  request.type = BLERequestType::CONNECT;
+  DeviceTable::formatAddress(DeviceTable::packAddress(address), request.address);
+  return _requests.push(request);
 }
 
-bool NogasmBLEManager::hasTimedOut(const unsigned long timeoutMs)
+bool NogasmBLEManager::requestDisconnectAll()
 {
-  if (Util::hasTimeExpired(timeoutMs, _lastStateChangeTime))
+  BLERequest request;
+  request.type = BLERequestType::DISCONNECT_ALL;
+  return _requests.push(request);
+}
+
+bool NogasmBLEManager::requestScan(const uint32_t durationMs)
+{
+  BLERequest request;
+  request.type = BLERequestType::SCAN;
+  request.durationMs = durationMs;
+  return _requests.push(request);
+}
+
+bool NogasmBLEManager::requestLevel(const DeviceCommandType type, const uint8_t level)
+{
+  BLERequest request;
+  request.type = BLERequestType::LEVEL;
+  request.command = type;
+  request.value = level;
+  return _requests.push(request);
+}
+
+bool NogasmBLEManager::requestCommand(const DeviceCommandType type, const uint8_t value, const bool inflate)
+{
+  BLERequest request;
+  request.type = BLERequestType::COMMAND;
+  request.command = type;
+  request.value = value;
+  request.inflate = inflate;
+  return _requests.push(request);
+}
+
+void NogasmBLEManager::applyRequests()
+{
+  BLERequest request;
+  while (_requests.pop(request))
   {
-    updateStatus(BLE_FAILED, "Timed out");
-    return true;
+    applyRequest(request);
   }
-
-  return false;
 }
 
-void NogasmBLEManager::processConnectionStateMachine()
+void NogasmBLEManager::applyRequest(const BLERequest& request)
 {
-  switch (_state)
+  switch (request.type)
   {
-    case BLE_CONNECTING:
+    case BLERequestType::CONNECT:
+      connectToDevice(request.address);
+      break;
+    case BLERequestType::DISCONNECT_ALL:
+      disconnectAll();
+      break;
+    case BLERequestType::SCAN:
+      startScan(request.durationMs);
+      break;
+    case BLERequestType::LINK_MAPPING:
     {
-      if (hasTimedOut(_connectionTimeoutMs))
-      {
-        Util::logDebug("Connection timeout after %d ms", _connectionTimeoutMs);
-        return;
-      }
-
-      if (_client != nullptr && !_client->isConnected())
+      // the link may have dropped since the request was queued
+      DeviceLink* link = findLink(request.address);
+      if (link != nullptr)
       {
-        Util::logDebug("Attempting to connect...");
-
-        const uint8_t addressType = _currentDevice.addressType == "RANDOM" ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
-        const auto address = NimBLEAddress(_currentDevice.address, addressType);
-        const bool connectResult = _client->connect(address, true, true, true);
-
-        if (!connectResult)
-        {
-          updateStatus(BLE_FAILED, "connect() failed");
-        }
-        else
-        {
-          updateStatus(BLE_FINDING_SERVICE, "connect() success");
-        }
+        applyLinkMapping(*link, request.mapping);
       }
       break;
     }
-    case BLE_FINDING_SERVICE:
-    {
-      if (hasTimedOut(_connectionTimeoutMs))
+    case BLERequestType::LEVEL:
+      if (request.command == DeviceCommandType::VIBRATE)
       {
-        Util::logDebug("Finding service timeout after %d ms", _connectionTimeoutMs);
-        break;
+        setVibrationLevel(request.value);
       }
-
-      if (_client == nullptr)
+      else
       {
-        Util::logTrace("Client is null!");
-        break;
+        submitLevel(request.command, request.value);
       }
+      break;
+    case BLERequestType::COMMAND:
+      submitToLinks(request.command, request.value, request.inflate);
+      break;
+  }
+}
 
-      if (!_client->isConnected())
-      {
-        Util::logTrace("Waiting for connection...");
-        break;
-      }
+void NogasmBLEManager::applyLinkMapping(DeviceLink& link, const LinkOutputMapping& mapping)
+{
+  link.mapping = mapping;
+  link.mapping.maxLevel = constrain(mapping.maxLevel, 0, 20);
+  link.mapping.minLevel = min(mapping.minLevel, link.mapping.maxLevel);
+  _statusChanged = true;
+
+  // apply right away instead of waiting for the next output change
+  if (isLinkReady(link))
+  {
+    _commandWriter.submit({DeviceCommandType::VIBRATE, link.mapping.apply(_vibrationLevel), false, link.index});
+  }
+}
+
+BLEConnectionState NogasmBLEManager::getState() const
+{
+  // the most advanced link wins, scanning shows while no link is up or on its way
+  static constexpr BLEConnectionState LINK_STATE_PRIORITY[] = {BLE_CONNECTED, BLE_FINDING_SERVICE, BLE_CONNECTING, BLE_RECONNECTING};
+  for (const auto state : LINK_STATE_PRIORITY)
+  {
+    for (const auto& link : _links)
+    {
+      if (link.state == state)
+      {
+        return state;
+      }
+    }
+  }
+
+  if (_scanActive)
+  {
+    return BLE_SCANNING;
+  }
+
+  for (const auto& link : _links)
+  {
+    if (link.state == BLE_FAILED)
+    {
+      return BLE_FAILED;
+    }
+  }
+
+  return BLE_IDLE;
+}
+
+bool NogasmBLEManager::isScanning() const
+{
+  return _scanActive;
+}
+
+bool NogasmBLEManager::isConnectedState() const
+{
+  for (const auto& link : _links)
+  {
+    if (link.state == BLE_CONNECTED && link.device.connected)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void NogasmBLEManager::onStatusChange(const std::function<void(BLEConnectionState)>& callback)
+{
+  _statusCallback = callback;
+}
+
+bool NogasmBLEManager::connectToLastDevice()
+{
+  const String lastDeviceAddr = _config.getLastConnectedDevice();
+  if (lastDeviceAddr.isEmpty())
+  {
+    Util::logDebug("  > No last device to reconnect to");
+    return false;
+  }
+
+  if (findLink(lastDeviceAddr.c_str()) != nullptr)
+  {
+    Util::logDebug("  > Last device already has a link");
+    return false;
+  }
+
+  if (_devices.find(DeviceTable::packAddress(lastDeviceAddr.c_str())) == nullptr)
+  {
+    Util::logDebug("  > Last device not found in scan results");
+    return false;
+  }
+
+  Util::logDebug("  > Attempting to reconnect to last device: %s", lastDeviceAddr.c_str());
+  connectToDevice(lastDeviceAddr.c_str());
+  return true;
+}
+
+bool NogasmBLEManager::connectToSavedDevice()
+{
+  if (!_config.hasDeviceInfo())
+  {
+    Util::logDebug("  > No saved device to connect to");
+    return false;
+  }
+
+  const String address = _config.getDeviceAddress();
+  const String name = _config.getDeviceName();
+  if (!LovenseProtocol::isCompatibleDevice(name.c_str()))
+  {
+    Util::logDebug("  > Saved device %s is not compatible", name.c_str());
+    return false;
+  }
+
+  // the device has not advertised yet, enter it as if it had so connectToDevice() can use it
+  const uint8_t addressType = _config.getDeviceAddressType() == "RANDOM" ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
+  if (_devices.insert(DeviceTable::packAddress(address.c_str()), addressType, LOVENSE, name.c_str(), NogasmClock::millis()) == nullptr)
+  {
+    return false;
+  }
+
+  Util::logDebug("  > Connecting directly to saved device: %s", address.c_str());
+  connectToDevice(address.c_str());
+
+  DeviceLink* link = findLink(address.c_str());
+  if (link == nullptr || link->state != BLE_CONNECTING)
+  {
+    return false;
+  }
+
+  link->directConnect = true;
+  link->client->setConnectTimeout(BLE_DIRECT_CONNECT_TIMEOUT_MS);
+  return true;
+}
+
+bool NogasmBLEManager::scheduleReconnect(DeviceLink& link)
+{
+  if (!_autoReconnectEnabled)
+  {
+    Util::logDebug("Auto-reconnect not enabled");
+    link.reconnect.reset();
+    return false;
+  }
+
+  const unsigned long now = NogasmClock::millis();
+  link.reconnect.attemptFinished(now, false);
+
+  if (!link.reconnect.scheduleNext(now, _sessionActive))
+  {
+    Util::logDebug("  > Link %d gave up reconnecting", link.index);
+    return false;
+  }
+
+  Util::logDebug("  > Link %d reconnect attempt %d in %lu ms%s", link.index, link.reconnect.getAttempts() + 1,
+    link.reconnect.getNextAttemptIn(now), link.reconnect.isSlowTier() ? " (slow)" : "");
+  return true;
+}
+
+void NogasmBLEManager::setSessionActive(const bool active)
+{
+  if (active == _sessionActive)
+  {
+    return;
+  }
+
+  _sessionActive = active;
+  _statusChanged = true;
+  for (auto& link : _links)
+  {
+    if (link.state == BLE_CONNECTED)
+    {
+      applyLinkProfile(link);
+    }
+  }
+
+  // a running scan changes duty cycle for whatever is left of it
+  if (_scanActive && _scanDowngraded != active)
+  {
+    restartUserScan();
+  }
+}
+
+void NogasmBLEManager::applyLinkProfile(DeviceLink& link)
+{
+  if (!_config.getLowLatencyLink() || link.client == nullptr || !link.client->isConnected())
+  {
+    return;
+  }
+
+  const BLELinkProfile profile = _sessionActive ? LINK_PROFILE_LOW_LATENCY : LINK_PROFILE_POWER;
+  if (profile == link.profile)
+  {
+    return;
+  }
+
+  // the peripheral has the final say, updateLinkParams() picks up what it accepted
+  bool requested;
+  if (profile == LINK_PROFILE_LOW_LATENCY)
+  {
+    requested = link.client->updateConnParams(BLE_LOW_LATENCY_MIN_INTERVAL, BLE_LOW_LATENCY_MAX_INTERVAL, 0, BLE_LOW_LATENCY_TIMEOUT);
+  }
+  else
+  {
+    requested = link.client->updateConnParams(BLE_POWER_MIN_INTERVAL, BLE_POWER_MAX_INTERVAL, BLE_POWER_LATENCY, BLE_POWER_TIMEOUT);
+  }
+
+  Util::logDebug("Link %d requested %s profile: %s", link.index, getLinkProfileString(profile), requested ? "ok" : "failed");
+  if (requested)
+  {
+    link.profile = profile;
+    link.hostProfile.store(profile, std::memory_order_relaxed);
+  }
+}
+
+void NogasmBLEManager::runMaintenance(DeviceLink& link)
+{
+  const unsigned long now = NogasmClock::millis();
+  const MaintenanceTask task = link.maintenance.next(now);
+  if (task == MaintenanceTask::NONE)
+  {
+    return;
+  }
+
+  // housekeeping waits for a gap in the output, it must not delay the next level change
+  if (link.testPulseActive || !_commandWriter.isLinkQuiet(link.index, BLE_MAINTENANCE_QUIET_MS))
+  {
+    link.maintenance.deferred(task);
+    return;
+  }
+
+  switch (task)
+  {
+    case MaintenanceTask::DEVICE_INFO:
+      _commandWriter.submit({DeviceCommandType::QUERY_DEVICE_TYPE, 0, false, link.index});
+      break;
+
+    case MaintenanceTask::BATTERY:
+      _commandWriter.submit({DeviceCommandType::QUERY_BATTERY, 0, false, link.index});
+      break;
+
+    case MaintenanceTask::RSSI:
+      link.device.rssi = link.client->getRssi();
+      Util::logTrace("Updating rssi for link %d:%d", link.index, link.device.rssi);
+
+      // parameter updates complete asynchronously, refresh what is in effect
+      updateLinkParams(link);
+      break;
+
+    case MaintenanceTask::NONE:
+      break;
+  }
+
+  link.maintenance.issued(task, now, _sessionActive);
+}
+
+void NogasmBLEManager::updateLinkParams(DeviceLink& link)
+{
+  const NimBLEConnInfo info = link.client->getConnInfo();
+  link.params.interval = info.getConnInterval();
+  link.params.latency = info.getConnLatency();
+  link.params.timeout = info.getConnTimeout();
+  link.params.mtu = link.client->getMTU();
+}
+
+void NogasmBLEManager::update()
+{
+  if (_stopPending.exchange(false, std::memory_order_acquire))
+  {
+    _vibrationLevel = 0;
+    for (auto& link : _links)
+    {
+      link.testPulseActive = false;
+    }
+  }
+
+  processEvents();
+  applyRequests();
+
+  // picked up live, like the link profile
+  _commandWriter.setWriteMode(_config.getAcknowledgedWrites() ? BLEWriteMode::ACKNOWLEDGED : BLEWriteMode::UNACKNOWLEDGED);
+
+  if (_scanEnded.exchange(false))
+  {
+    handleScanEnd();
+  }
+
+  for (auto& link : _links)
+  {
+    processConnectionStateMachine(link);
+  }
+
+  // the last device showed up, connecting now saves the rest of the scan duration
+  if (_lastDeviceSeen)
+  {
+    _lastDeviceSeen = false;
+    NimBLEDevice::getScan()->stop();
+    setScanActive(false, "Last device found");
+    connectToLastDevice();
+  }
+
+  if (_directConnectFailed)
+  {
+    _directConnectFailed = false;
+    Util::logInfo("Saved device did not answer, scanning instead");
+    startScan(_config.getScanDuration());
+  }
+
+  updateBackgroundScan();
+
+  // writes made while the scanner shares the radio are tracked apart, the difference is what scanning costs
+  const bool scanning = _scanActive || _backgroundScanActive;
+  for (auto& link : _links)
+  {
+    if (link.protocol)
+    {
+      link.protocol->setScanRunning(scanning);
+    }
+  }
+
+  if (Util::hasTimeExpired(1000, _lastDeviceAging))
+  {
+    _devices.age(NogasmClock::millis(), BLE_DEVICE_MAX_AGE_MS);
+    _lastDeviceAging = NogasmClock::millis();
+  }
+
+  // other tasks read the table through this snapshot, changes are batched so readers can cache what they built from it
+  if ((_devices.generation() != _snapshotGeneration && Util::hasTimeExpired(BLE_DEVICE_SNAPSHOT_INTERVAL_MS, _lastSnapshotTime)) ||
+      (!_devices.isEmpty() && Util::hasTimeExpired(BLE_DEVICE_SNAPSHOT_REFRESH_MS, _lastSnapshotTime)))
+  {
+    publishDevices();
+  }
+
+  // a state change goes out right away so status pushes never show the state before it
+  for (const auto& link : _links)
+  {
+    _statusChanged |= link.state != _publishedStates[link.index];
+  }
+
+  if (_statusChanged || Util::hasTimeExpired(BLE_STATUS_SNAPSHOT_INTERVAL_MS, _lastStatusTime))
+  {
+    publishStatus();
+  }
+}
+
+bool NogasmBLEManager::hasTimedOut(DeviceLink& link, const unsigned long timeoutMs)
+{
+  if (Util::hasTimeExpired(timeoutMs, link.lastStateChangeTime))
+  {
+    updateStatus(link, BLE_FAILED, "Timed out");
+    return true;
+  }
+
+  return false;
+}
+
+void NogasmBLEManager::processConnectionStateMachine(DeviceLink& link)
+{
+  switch (link.state)
+  {
+    case BLE_CONNECTING:
+    {
+      if (hasTimedOut(link, _connectionTimeoutMs))
+      {
+        Util::logDebug("Connection timeout after %d ms", _connectionTimeoutMs);
+        return;
+      }
+
+      // give the stack time to release the previous client
+      if (!Util::hasTimeExpired(BLE_CLEANUP_SETTLE_MS, link.lastCleanupTime))
+      {
+        break;
+      }
+
+      if (link.client != nullptr && !link.client->isConnected())
+      {
+        Util::logDebug("Attempting to connect link %d...", link.index);
+
+        const uint8_t addressType = link.device.addressType == "RANDOM" ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
+        const auto address = NimBLEAddress(link.device.address, addressType);
+
+        link.timing = ConnectionTiming();
+        link.timing.startedAt = NogasmClock::millis();
+        link.connectStartUs = NogasmClock::micros();
+        link.linkUpUs = 0;
+        link.connectedUs = 0;
+
+        const bool connectResult = link.client->connect(address, true, true, true);
+
+        if (!connectResult)
+        {
+          updateStatus(link, BLE_FAILED, "connect() failed");
+        }
+        else
+        {
+          updateStatus(link, BLE_FINDING_SERVICE, "connect() success");
+        }
+      }
+      break;
+    }
+    case BLE_FINDING_SERVICE:
+    {
+      if (hasTimedOut(link, _connectionTimeoutMs))
+      {
+        Util::logDebug("Finding service timeout after %d ms", _connectionTimeoutMs);
+        break;
+      }
+
+      if (link.client == nullptr)
+      {
+        Util::logTrace("Client is null!");
+        break;
+      }
+
+      if (!link.client->isConnected())
+      {
+        Util::logTrace("Waiting for connection...");
+        break;
+      }
 
       // ReSharper disable once CppDFAConstantConditions
-      if (!_currentDevice.connected)
+      if (!link.device.connected)
       {
         Util::logDebug("Waiting for connect callback...");
         break;
       }
 
-      if (!findCompatibleService())
+      // a known device is looked up by its cached uuids right away, without settling or a full discovery
+      if (link.gattCached)
+      {
+        link.gattCached = false;
+
+        const uint32_t lookupStart = NogasmClock::micros();
+        link.timing.cached = useCachedAttributes(link);
+        link.timing.discoveryUs += NogasmClock::micros() - lookupStart - link.timing.subscribeUs;
+
+        if (!link.timing.cached)
+        {
+          link.timing.subscribeUs = 0;
+          Util::logDebug("  > Cached attributes failed, falling back to full discovery");
+          _gattCache.remove(DeviceTable::packAddress(link.device.address));
+          link.gatt = GattCacheEntry();
+          link.lastDiscoveryTime = NogasmClock::millis();
+          break;
+        }
+      }
+      else
+      {
+        // the link just came up, let it settle before discovery
+        if (link.lastDiscoveryTime == 0)
+        {
+          link.lastDiscoveryTime = NogasmClock::millis();
+          break;
+        }
+
+        if (!Util::hasTimeExpired(link.discoveryAttempts == 0 ? BLE_DISCOVERY_SETTLE_MS : BLE_DISCOVERY_RETRY_MS, link.lastDiscoveryTime))
+        {
+          break;
+        }
+
+        const uint32_t discoveryStart = NogasmClock::micros();
+        const bool discovered = discoverAttributes(link);
+        link.timing.discoveryUs += NogasmClock::micros() - discoveryStart;
+
+        if (!discovered)
+        {
+          if (link.discoveryAttempts >= BLE_DISCOVERY_ATTEMPTS)
+          {
+            updateStatus(link, BLE_FAILED, "Service discovery failed after retries");
+          }
+          break;
+        }
+
+        const uint32_t lookupStart = NogasmClock::micros();
+        if (!findCompatibleService(link))
+        {
+          updateStatus(link, BLE_FAILED, "Could not find compatible service");
+          break;
+        }
+
+        if (!findCharacteristics(link))
+        {
+          updateStatus(link, BLE_FAILED, "Could not find required characteristics");
+          break;
+        }
+        link.timing.lookupUs = NogasmClock::micros() - lookupStart - link.timing.subscribeUs;
+
+        rememberAttributes(link);
+      }
+
+      finishConnectionTiming(link);
+      updateStatus(link, BLE_CONNECTED, "Connected successfully!");
+
+      // discovery is done, now the link can be tuned for what comes next
+      applyLinkProfile(link);
+      updateLinkParams(link);
+      break;
+    }
+    case BLE_RECONNECTING:
+    {
+      // the slow tier is in no hurry, a running scan finishes first
+      if (!link.reconnect.isDue(NogasmClock::millis()) || (_scanActive && link.reconnect.isSlowTier()))
       {
-        updateStatus(BLE_FAILED, "Could not find compatible service");
         break;
       }
 
-      if (!findCharacteristics())
+      Util::logDebug("Reconnecting link %d to device @ %s", link.index, link.device.address.c_str());
+      link.reconnect.attemptStarted(NogasmClock::millis());
+
+      // a device that stopped advertising for a while aged out of the table, it is still the one we want
+      if (_devices.find(DeviceTable::packAddress(link.device.address)) == nullptr)
       {
-        updateStatus(BLE_FAILED, "Could not find required characteristics");
-        break;
+        const uint8_t addressType = link.device.addressType == "RANDOM" ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
+        _devices.insert(DeviceTable::packAddress(link.device.address), addressType, link.device.protocol, link.device.name.c_str(),
+          NogasmClock::millis());
       }
 
-      updateStatus(BLE_CONNECTED, "Connected successfully!");
+      connectToDevice(link.device.address);
       break;
     }
-    case BLE_RECONNECTING:
-    {
-      Util::logDebug("Reconnecting to device @ %s", _currentDevice.address.c_str());
-      connectToDevice(_currentDevice.address);
-    }
     default:
     {
-      if (isConnectedState())
+      if (link.state == BLE_CONNECTED && link.device.connected)
       {
-        if (_client == nullptr || !_client->isConnected())
+        if (link.client == nullptr || !link.client->isConnected())
         {
-          updateStatus(BLE_FAILED, "Connection lost unexpectedly");
+          updateStatus(link, BLE_FAILED, "Connection lost unexpectedly");
         }
         else
         {
-          // we have a stable connection, update signal strength
-          if (Util::hasTimeExpired(1000, _lastRssiCheck))
+          // end the connect test pulse, a link that joined a running session picks up its level, unless a stop just came in
+          if (link.testPulseActive && Util::hasTimeExpired(BLE_TEST_PULSE_MS, link.testPulseStartTime) &&
+            !_stopPending.load(std::memory_order_acquire))
           {
-            _currentDevice.rssi = _client->getRssi();
-            _lastRssiCheck = millis();
-
-            Util::logTrace("Updating rssi for connected device:%d", _currentDevice.rssi);
+            link.testPulseActive = false;
+            _commandWriter.submit({DeviceCommandType::VIBRATE, link.mapping.apply(_vibrationLevel), false, link.index});
           }
+
+          persistAttributes(link);
+          runMaintenance(link);
         }
       }
       break;
@@ -520,55 +1340,47 @@ void NogasmBLEManager::processConnectionStateMachine()
   }
 }
 
-bool NogasmBLEManager::findCompatibleService()
+bool NogasmBLEManager::discoverAttributes(DeviceLink& link)
 {
-  if (_client == nullptr || !_client->isConnected())
-  {
-    Util::logDebug("  > Cannot find services: client not connected");
-    return false;
-  }
+  link.discoveryAttempts++;
+  link.lastDiscoveryTime = NogasmClock::millis();
 
-  if (!_deviceProtocol)
+  Util::logDebug("  > Discovering attributes, attempt %d", link.discoveryAttempts);
+  if (link.client->discoverAttributes())
   {
-    Util::logDebug("  > Cannot find services: protocol not initialized");
-    return false;
+    Util::logDebug("  > Service discovery successful");
+    return true;
   }
 
-  delay(BLE_STABILISE_DELAY_MS * 50);
-  Util::logDebug("  > Discovering attributes...");
+  Util::logDebug("  > Service discovery failed");
+  return false;
+}
 
-  bool discovered = false;
-  for (int attempt = 0; attempt < 3; attempt++)
+bool NogasmBLEManager::findCompatibleService(DeviceLink& link)
+{
+  if (link.client == nullptr || !link.client->isConnected())
   {
-    Util::logDebug("  > Discovery attempt %d", attempt + 1);
-    discovered = _client->discoverAttributes();
-    if (discovered)
-    {
-      Util::logDebug("  > Service discovery successful");
-      break;
-    }
-
-    Util::logDebug("  > Service discovery failed, retrying...");
-    delay(BLE_STABILISE_DELAY_MS * 50);
+    Util::logDebug("  > Cannot find services: client not connected");
+    return false;
   }
 
-  if (!discovered)
+  if (!link.protocol)
   {
-    Util::logDebug("  > Service discovery failed after retries");
+    Util::logDebug("  > Cannot find services: protocol not initialized");
     return false;
   }
 
-  auto& services = _client->getServices(false);
+  auto& services = link.client->getServices(false);
   Util::logDebug("  > Found services %d", services.size());
 
   for (const auto& it : services)
   {
     std::string serviceUuid = it->getUUID().toString();
     Util::logTrace("  > Examining service: %s", serviceUuid.c_str());
-    if (_deviceProtocol->isCompatibleServiceUUID(serviceUuid))
+    if (link.protocol->isCompatibleServiceUUID(serviceUuid))
     {
       Util::logDebug("    > Selected as compatible service: %s", serviceUuid.c_str());
-      _service = it;
+      link.service = it;
       return true;
     }
   }
@@ -577,68 +1389,195 @@ bool NogasmBLEManager::findCompatibleService()
   return false;
 }
 
-bool NogasmBLEManager::findCharacteristics()
+bool NogasmBLEManager::findCharacteristics(DeviceLink& link)
 {
-  if (_service == nullptr)
+  if (link.service == nullptr)
   {
     Util::logDebug("  > Cannot find characteristics: No service selected");
     return false;
   }
 
-  if (!_deviceProtocol)
+  if (!link.protocol)
   {
     Util::logDebug("  > Cannot find characteristics: protocol not initialized");
     return false;
   }
 
   Util::logDebug("  > Discovering characteristics");
-  for (const auto& it : _service->getCharacteristics(false))
+  for (const auto& it : link.service->getCharacteristics(false))
   {
     std::string charUuid = it->getUUID().toString();
     Util::logDebug("  > Examining characteristic: %s", charUuid.c_str());
 
     const bool canWrite = it->canWrite();
-    if (_writeCharacteristic == nullptr && canWrite)
+    if (link.writeCharacteristic == nullptr && canWrite)
     {
       Util::logDebug("    > Selected as control characteristic");
-      _writeCharacteristic = it;
-      _deviceProtocol->setTxCharacteristic(_writeCharacteristic);
+      link.writeCharacteristic = it;
+      link.protocol->setTxCharacteristic(link.writeCharacteristic);
     }
 
     const bool canNotify = it->canNotify();
-    if (_notifyCharacteristic == nullptr && canNotify)
+    if (link.notifyCharacteristic == nullptr && canNotify)
     {
       Util::logDebug("    > Selected as notify characteristic");
-      _notifyCharacteristic = it;
-      _deviceProtocol->setRxCharacteristic(_notifyCharacteristic, _client);
+      subscribeNotifications(link, it);
     }
 
-    if (_writeCharacteristic != nullptr && _notifyCharacteristic != nullptr)
+    if (link.writeCharacteristic != nullptr && link.notifyCharacteristic != nullptr)
     {
       return true;
     }
   }
 
   // the write characteristic is absolutely required
-  return _writeCharacteristic != nullptr;
+  return link.writeCharacteristic != nullptr;
 }
 
-void NogasmBLEManager::updateStatus(BLEConnectionState newState, const std::string& reason)
+bool NogasmBLEManager::useCachedAttributes(DeviceLink& link)
 {
-  if (newState == BLE_SCANNING)
+  if (!link.protocol)
   {
-    _devices.clear();
-    _scanActive = true;
+    return false;
   }
-  else if (newState == BLE_IDLE)
+
+  // NimBLE only writes through discovered characteristic objects, so the cached uuids drive a targeted discovery
+  // of just these attributes and the handles confirm the device still has the layout we saw last time
+  Util::logDebug("  > Using cached attributes, service %s", link.gatt.serviceUuid);
+  NimBLERemoteService* service = link.client->getService(NimBLEUUID(link.gatt.serviceUuid));
+  if (service == nullptr || !link.protocol->isCompatibleServiceUUID(service->getUUID().toString()))
   {
-    _scanActive = false;
+    return false;
+  }
+
+  NimBLERemoteCharacteristic* writeCharacteristic = service->getCharacteristic(NimBLEUUID(link.gatt.writeUuid));
+  if (writeCharacteristic == nullptr || !writeCharacteristic->canWrite())
+  {
+    return false;
+  }
+
+  NimBLERemoteCharacteristic* notifyCharacteristic = nullptr;
+  if (link.gatt.notifyUuid[0] != '\0')
+  {
+    notifyCharacteristic = service->getCharacteristic(NimBLEUUID(link.gatt.notifyUuid));
+    if (notifyCharacteristic == nullptr || !notifyCharacteristic->canNotify())
+    {
+      return false;
+    }
+  }
+
+  if (service->getHandle() != link.gatt.serviceHandle || writeCharacteristic->getHandle() != link.gatt.writeHandle ||
+      (notifyCharacteristic != nullptr && notifyCharacteristic->getHandle() != link.gatt.notifyHandle))
+  {
+    // same attributes at new handles, e.g. after a firmware update, refresh the cache
+    Util::logDebug("  > Cached handles moved, updating cache");
+    link.gattDirty = true;
+  }
+
+  link.service = service;
+  link.writeCharacteristic = writeCharacteristic;
+  link.protocol->setTxCharacteristic(writeCharacteristic);
+  if (notifyCharacteristic != nullptr)
+  {
+    subscribeNotifications(link, notifyCharacteristic);
+  }
+
+  rememberAttributes(link);
+  return true;
+}
+
+void NogasmBLEManager::subscribeNotifications(DeviceLink& link, NimBLERemoteCharacteristic* characteristic)
+{
+  // a round trip to the toy of its own, kept out of the lookup time
+  const uint32_t start = NogasmClock::micros();
+  link.notifyCharacteristic = characteristic;
+  link.protocol->setRxCharacteristic(characteristic, link.client);
+  link.timing.subscribeUs = NogasmClock::micros() - start;
+}
+
+void NogasmBLEManager::finishConnectionTiming(DeviceLink& link)
+{
+  const uint32_t now = NogasmClock::micros();
+  ConnectionTiming& timing = link.timing;
+  link.connectedUs = now;
+  timing.totalUs = now - link.connectStartUs;
+  timing.discoveryAttempts = static_cast<uint8_t>(link.discoveryAttempts);
+
+  // whatever the link-up to connected time was not busy with went to waiting, the MTU exchange runs meanwhile
+  const uint32_t busy = timing.discoveryUs + timing.lookupUs + timing.subscribeUs;
+  const uint32_t sinceUp = link.linkUpUs != 0 ? now - link.linkUpUs : 0;
+  timing.settleUs = sinceUp > busy ? sinceUp - busy : 0;
+
+  _connectionTimings.record(DeviceTable::packAddress(link.device.address), timing);
+  _connectionTimingsSnapshot.write(_connectionTimings);
+  Util::logDebug("  > Link %d setup took %lu ms: connect %lu, mtu %lu, settle %lu, discovery %lu%s, lookup %lu, subscribe %lu",
+    link.index, static_cast<unsigned long>(timing.totalUs / 1000), static_cast<unsigned long>(timing.connectUs / 1000),
+    static_cast<unsigned long>(timing.mtuUs / 1000), static_cast<unsigned long>(timing.settleUs / 1000),
+    static_cast<unsigned long>(timing.discoveryUs / 1000), timing.cached ? " (cached)" : "",
+    static_cast<unsigned long>(timing.lookupUs / 1000), static_cast<unsigned long>(timing.subscribeUs / 1000));
+}
+
+void NogasmBLEManager::rememberAttributes(DeviceLink& link)
+{
+  GattCacheEntry gatt = link.gatt;
+  gatt.version = GATT_CACHE_VERSION;
+  strncpy(gatt.serviceUuid, link.service->getUUID().toString().c_str(), GATT_CACHE_UUID_LENGTH - 1);
+  gatt.serviceHandle = link.service->getHandle();
+  strncpy(gatt.writeUuid, link.writeCharacteristic->getUUID().toString().c_str(), GATT_CACHE_UUID_LENGTH - 1);
+  gatt.writeHandle = link.writeCharacteristic->getHandle();
+
+  gatt.notifyUuid[0] = '\0';
+  gatt.notifyHandle = 0;
+  if (link.notifyCharacteristic != nullptr)
+  {
+    strncpy(gatt.notifyUuid, link.notifyCharacteristic->getUUID().toString().c_str(), GATT_CACHE_UUID_LENGTH - 1);
+    gatt.notifyHandle = link.notifyCharacteristic->getHandle();
+  }
+
+  if (memcmp(&gatt, &link.gatt, sizeof(GattCacheEntry)) != 0)
+  {
+    link.gatt = gatt;
+    link.gattDirty = true;
+  }
+}
+
+void NogasmBLEManager::persistAttributes(DeviceLink& link)
+{
+  // the model arrives with the device type reply some time after the link is up
+  if (!link.device.modelDisplayName.isEmpty() && strncmp(link.gatt.model, link.device.modelDisplayName.c_str(), GATT_CACHE_MODEL_LENGTH - 1) != 0)
+  {
+    strncpy(link.gatt.model, link.device.modelDisplayName.c_str(), GATT_CACHE_MODEL_LENGTH - 1);
+    link.gattDirty = true;
+  }
+
+  if (link.gattDirty)
+  {
+    link.gattDirty = false;
+    _gattCache.store(DeviceTable::packAddress(link.device.address), link.gatt);
   }
-  else if (newState == BLE_FAILED)
+}
+
+void NogasmBLEManager::setScanActive(const bool active, const std::string& reason)
+{
+  Util::logInfo("%s :: %s", active ? "SCANNING" : "SCAN ENDED", reason.c_str());
+
+  _scanActive = active;
+  notifyStatusChange();
+}
+
+void NogasmBLEManager::updateStatus(DeviceLink& link, BLEConnectionState newState, const std::string& reason)
+{
+  if (newState == BLE_FAILED)
   {
     // connect() will clean up, we just indicate the current connection failure
-    updateDeviceState(false);
-    if (shouldTryReconnect())
+    updateDeviceState(link, false);
+    if (link.directConnect)
+    {
+      // the device may not be around, a scan finds out faster than retrying blindly
+      link.directConnect = false;
+      _directConnectFailed = true;
+    }
+    else if (scheduleReconnect(link))
     {
       // don't transition to failed yet, try reconnecting first
       newState = BLE_RECONNECTING;
@@ -646,155 +1585,384 @@ void NogasmBLEManager::updateStatus(BLEConnectionState newState, const std::stri
   }
   else if (newState == BLE_CONNECTED)
   {
-    // reset reconnect attempts on successful connection
-    _reconnectAttempts = 0;
+    // a reconnect that got here is done, the next drop starts over with an immediate retry
+    link.reconnect.attemptFinished(NogasmClock::millis(), true);
+    link.reconnect.reset();
+    link.directConnect = false;
+
+    // from here on all writes go through the writer task
+    _commandWriter.setProtocol(link.index, link.protocol.get());
 
-    // send device queries
-    _deviceProtocol->queryDeviceType();
-    _deviceProtocol->queryBatteryLevel();
+    // device info and battery follow once the test pulse is over, see runMaintenance()
+    link.maintenance.reset(NogasmClock::millis());
 
-    // vibration test pulse
+    // vibration test pulse on this link only, the state machine turns it off again
     const uint8_t defaultLevel = _config.getDefaultVibrationLevel();
     if (defaultLevel > 0)
     {
-      setVibrationLevel(defaultLevel);
+      _commandWriter.submit({DeviceCommandType::VIBRATE, defaultLevel, false, link.index});
     }
     else
     {
-      setVibrationLevel(1);
-      delay(200);
-      setVibrationLevel(0);
+      _commandWriter.submit({DeviceCommandType::VIBRATE, 1, false, link.index});
+      link.testPulseActive = true;
+      link.testPulseStartTime = NogasmClock::millis();
     }
   }
+  else if (newState == BLE_IDLE)
+  {
+    link.reconnect.reset();
+  }
+  else if (newState == BLE_FINDING_SERVICE)
+  {
+    link.discoveryAttempts = 0;
+    link.lastDiscoveryTime = 0;
+  }
 
-  Util::logInfo("%s -> %s :: %s", getStateString(_state).c_str(), getStateString(newState).c_str(), reason.c_str());
+  Util::logInfo("[link %d] %s -> %s :: %s", link.index, getStateString(link.state).c_str(), getStateString(newState).c_str(), reason.c_str());
 
-  _state = newState;
-  _lastStateChangeTime = millis();
+  link.state = newState;
+  link.lastStateChangeTime = NogasmClock::millis();
   notifyStatusChange();
 }
 
-void NogasmBLEManager::notifyStatusChange() const
+bool NogasmBLEManager::pushEvent(const BLEEvent& event)
+{
+  if (!_events.push(event))
+  {
+    // no logging here, this runs on the host task
+    _droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  return true;
+}
+
+void NogasmBLEManager::processEvents()
+{
+  BLEEvent event;
+  while (_events.pop(event))
+  {
+    if (event.type == BLEEventType::ADVERTISEMENT)
+    {
+      handleAdvertisement(event);
+      continue;
+    }
+
+    DeviceLink& link = _links[event.link];
+    if (event.generation != link.generation)
+    {
+      Util::logTrace("Dropping stale event of link %d", event.link);
+      continue;
+    }
+
+    switch (event.type)
+    {
+      case BLEEventType::CONNECTED:
+        Util::logDebug("  > Link %d connected to: %s", link.index, link.device.address.c_str());
+        link.linkUpUs = event.receivedMicros;
+        link.timing.connectUs = event.receivedMicros - link.connectStartUs;
+        updateDeviceState(link, true);
+        break;
+
+      case BLEEventType::MTU_CHANGED:
+        Util::logDebug("  > Link %d MTU %d", link.index, event.reason);
+        if (link.linkUpUs != 0 && link.timing.mtuUs == 0)
+        {
+          link.timing.mtuUs = event.receivedMicros - link.linkUpUs;
+        }
+        break;
+
+      case BLEEventType::CONNECT_FAILED:
+        Util::logInfo("Link %d connection failed, reason %d (%s)", link.index, event.reason, connectFailReasonString(event.reason));
+        updateStatus(link, BLE_FAILED, connectFailReasonString(event.reason));
+        break;
+
+      case BLEEventType::DISCONNECTED:
+        Util::logDebug("Link %d disconnected from %s, reason %d", link.index, link.device.address.c_str(), event.reason);
+        if (link.state == BLE_CONNECTING || link.state == BLE_FINDING_SERVICE || link.state == BLE_CONNECTED)
+        {
+          updateStatus(link, BLE_FAILED, "Unexpected disconnect");
+        }
+        break;
+
+      case BLEEventType::NOTIFICATION:
+        if (link.protocol)
+        {
+          link.protocol->handleNotification(event.data, event.length, event.receivedMicros);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+void NogasmBLEManager::handleAdvertisement(const BLEEvent& event)
+{
+  const unsigned long now = NogasmClock::millis();
+
+  DeviceTableEntry* entry = _devices.find(event.address);
+  if (entry == nullptr)
+  {
+    const char* name = reinterpret_cast<const char*>(event.data);
+    entry = _devices.insert(event.address, event.addressType, event.protocol, name, now);
+    if (entry == nullptr)
+    {
+      Util::logDebug("    > Device table full, ignoring %s", name);
+      return;
+    }
+
+    char address[BLE_DEVICE_ADDRESS_LENGTH];
+    DeviceTable::formatAddress(event.address, address);
+    Util::logDebug("    > Compatible device identified: %s, address: %s, type: %s",  //
+      name, address, DeviceTable::addressTypeString(event.addressType));
+  }
+
+  _devices.updateRssi(*entry, event.rssi, now);
+
+  if (event.address == _lastDeviceAddress && _scanActive)
+  {
+    _lastDeviceSeen = true;
+  }
+}
+
+const char* NogasmBLEManager::connectFailReasonString(const int reason)
+{
+  switch (reason)
+  {
+    case BLE_HS_ETIMEOUT:
+      return "TIMEOUT";
+    case BLE_HS_EBADDATA:
+      return "BAD_DATA";
+    case BLE_HS_EDONE:
+      return "ALREADY_CONNECTED";
+    case BLE_HS_ENOTCONN:
+      return "NOT_CONNECTED";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+void NogasmBLEManager::notifyStatusChange()
 {
+  // listeners see the combined state of all links, not every per-link transition
+  const BLEConnectionState state = getState();
+  if (state == _notifiedState)
+  {
+    return;
+  }
+
+  _notifiedState = state;
   if (_statusCallback)
   {
-    _statusCallback(_state);
+    _statusCallback(state);
   }
 }
 
-void NogasmBLEManager::ScanCallbacks::onScanEnd(const NimBLEScanResults& scanResults, int reason)
+void NogasmBLEManager::handleScanEnd()
 {
-  Util::logDebug("  > Scan stopped, found %zu devices total", _manager->_devices.size());
-  _manager->updateStatus(BLE_IDLE, "Scan completed");
+  // a stopped scan can report its end after the next one started
+  if (NimBLEDevice::getScan()->isScanning())
+  {
+    return;
+  }
+
+  if (!_scanActive)
+  {
+    // background scan ended, update() restarts it when it is still wanted
+    _backgroundScanActive = false;
+    return;
+  }
 
-  if (_manager->_autoConnectEnabled)
+  Util::logDebug("  > Scan stopped, found %zu devices", _devices.countSeenSince(_scanStartTime));
+  setScanActive(false, "Scan completed");
+
+  if (_autoConnectEnabled)
   {
     Util::logDebug("  > Auto-connect enabled");
 
     // try to find the last connected device if auto-reconnect is enabled
-    if (_manager->connectToLastDevice())
+    if (connectToLastDevice())
     {
       return;
     }
 
-    // connect to the first device if only one is found
-    if (_manager->_devices.size() == 1)
+    // connect to the first device if only one is found that has no link yet
+    const DeviceTableEntry* autoConnectDevice = nullptr;
+    int unlinkedCount = 0;
+    for (size_t i = 0; i < DeviceTable::capacity(); i++)
+    {
+      const DeviceTableEntry& entry = _devices.at(i);
+      if (entry.isUsed() && !entry.connected && static_cast<long>(entry.lastSeen - _scanStartTime) >= 0)
+      {
+        autoConnectDevice = &entry;
+        unlinkedCount++;
+      }
+    }
+
+    if (unlinkedCount == 1)
     {
       Util::logDebug("  > Found only one device, auto-connecting...");
-      const auto& autoConnectDevice = _manager->_devices.front();
-      _manager->connectToDevice(autoConnectDevice.address);
+      char address[BLE_DEVICE_ADDRESS_LENGTH];
+      DeviceTable::formatAddress(autoConnectDevice->address, address);
+      connectToDevice(address);
     }
   }
 }
 
+void NogasmBLEManager::ScanCallbacks::onScanEnd(const NimBLEScanResults& scanResults, int reason)
+{
+  // handled by update(), the auto connect must not run on the host task
+  _manager->_scanEnded = true;
+}
+
 void NogasmBLEManager::ScanCallbacks::onResult(const NimBLEAdvertisedDevice* advertisedDevice)
 {
-  if (advertisedDevice == nullptr || !advertisedDevice->haveName())
+  if (advertisedDevice == nullptr)
   {
     return;
   }
 
-  const uint8_t deviceAddressType = advertisedDevice->getAddress().getType();
-  const int8_t deviceRSSI = advertisedDevice->getRSSI();
-  const std::string deviceName = advertisedDevice->getName();
-  const std::string deviceAddress = advertisedDevice->getAddress().toString();
-  const std::string addressTypeStr = (deviceAddressType == BLE_ADDR_PUBLIC)  //
-                                       ? "PUBLIC"
-                                       : (deviceAddressType == BLE_ADDR_RANDOM)  //
-                                           ? "RANDOM"
-                                           : "UNKNOWN";
+  BLEEvent event;
+  event.type = BLEEventType::ADVERTISEMENT;
+  event.address = static_cast<uint64_t>(advertisedDevice->getAddress());
+  event.addressType = advertisedDevice->getAddress().getType();
+  event.rssi = static_cast<int8_t>(advertisedDevice->getRSSI());
+  event.receivedMicros = NogasmClock::micros();
 
-  // determine protocol (lovense only for now)
-  CompatibleDeviceProtocol deviceProtocol = UNKNOWN;
-  if (LovenseProtocol::isCompatibleDevice(deviceName))
+  // known devices are forwarded from our own copy, nothing is allocated for them
+  const ScannedDevice* device = findScanned(event.address);
+  if (device == nullptr)
   {
-    deviceProtocol = LOVENSE;
+    // everything else is judged on the raw payload, the many unrelated devices nearby cost no copy
+    const char* name = nullptr;
+    uint8_t nameLength = 0;
+    if (!findName(advertisedDevice->getPayload(), name, nameLength))
+    {
+      _rejected.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    // determine protocol (lovense only for now)
+    CompatibleDeviceProtocol deviceProtocol = UNKNOWN;
+    if (LovenseProtocol::isCompatibleDevice(name, nameLength))
+    {
+      deviceProtocol = LOVENSE;
+    }
+
+    if (deviceProtocol == UNKNOWN)
+    {
+      _rejected.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    device = rememberScanned(event.address, deviceProtocol, name, nameLength);
+    _identified.fetch_add(1, std::memory_order_relaxed);
+  }
+  else
+  {
+    _known.fetch_add(1, std::memory_order_relaxed);
   }
 
-  Util::logTrace("  > Found device: %s, address: %s, type: %s, rssi: %d",  //
-    deviceName.c_str(), deviceAddress.c_str(), addressTypeStr.c_str(), deviceRSSI);
+  // the table belongs to the main loop, it picks this up in update()
+  event.protocol = device->protocol;
+  event.length = static_cast<uint8_t>(strlen(device->name));
+  memcpy(event.data, device->name, event.length + 1);
+  _manager->pushEvent(event);
+}
 
-  if (deviceProtocol != UNKNOWN)
+const NogasmBLEManager::ScanCallbacks::ScannedDevice* NogasmBLEManager::ScanCallbacks::findScanned(const uint64_t address) const
+{
+  for (const auto& device : _scanned)
   {
-    // ensure we have not seen this device already within the advertisement window
-    for (const auto& device : _manager->_devices)
+    if (device.address == address)
     {
-      if (device.address == deviceAddress)
-      {
-        return;
-      }
+      return &device;
     }
+  }
 
-    Util::logDebug("    > Compatible device identified: %s, address: %s, type: %s",  //
-      deviceName.c_str(), deviceAddress.c_str(), addressTypeStr.c_str());
+  return nullptr;
+}
+
+const NogasmBLEManager::ScanCallbacks::ScannedDevice* NogasmBLEManager::ScanCallbacks::rememberScanned(
+  const uint64_t address, const CompatibleDeviceProtocol protocol, const char* name, const uint8_t length)
+{
+  // oldest first, a forgotten device only costs one more name check
+  ScannedDevice& device = _scanned[_nextScanned];
+  _nextScanned = (_nextScanned + 1) % BLE_DEVICE_TABLE_CAPACITY;
+
+  device.address = address;
+  device.protocol = protocol;
+  const uint8_t copied = min(length, static_cast<uint8_t>(BLE_DEVICE_NAME_LENGTH - 1));
+  memcpy(device.name, name, copied);
+  device.name[copied] = '\0';
+
+  return &device;
+}
+
+bool NogasmBLEManager::ScanCallbacks::findName(const std::vector<uint8_t>& payload, const char*& name, uint8_t& length)
+{
+  // a sequence of length, type, data fields, the scan response is appended to the advertisement
+  bool found = false;
+  size_t i = 0;
+  while (i + 1 < payload.size())
+  {
+    const uint8_t fieldLength = payload[i];
+    if (fieldLength == 0 || i + 1 + fieldLength > payload.size())
+    {
+      break;
+    }
+
+    const uint8_t type = payload[i + 1];
+    if (type == BLE_AD_TYPE_COMPLETE_NAME || (type == BLE_AD_TYPE_SHORT_NAME && !found))
+    {
+      name = reinterpret_cast<const char*>(&payload[i + 2]);
+      length = fieldLength - 1;
+      found = true;
 
-    CompatibleDevice newDevice;
-    newDevice.address = deviceAddress;
-    newDevice.addressType = addressTypeStr;
-    newDevice.name = deviceName;
-    newDevice.rssi = deviceRSSI;
-    newDevice.protocol = deviceProtocol;
+      if (type == BLE_AD_TYPE_COMPLETE_NAME)
+      {
+        break;
+      }
+    }
 
-    _manager->_devices.push_back(newDevice);
+    i += fieldLength + 1;
   }
+
+  return found && length > 0;
 }
 
 void NogasmBLEManager::ClientCallbacks::onConnect(NimBLEClient* client)
 {
-  Util::logDebug("  > Connected to: %s, rssi: %d", client->getPeerAddress().toString().c_str(), client->getRssi());
-  _manager->updateDeviceState(true);
+  pushEvent(BLEEventType::CONNECTED, 0);
 }
 
 void NogasmBLEManager::ClientCallbacks::onConnectFail(NimBLEClient* client, const int reason)
 {
-  String reasonStr;
-  switch (reason)
-  {
-    case BLE_HS_ETIMEOUT:
-      reasonStr = "TIMEOUT";
-      break;
-    case BLE_HS_EBADDATA:
-      reasonStr = "BAD_DATA";
-      break;
-    case BLE_HS_EDONE:
-      reasonStr = "ALREADY_CONNECTED";
-      break;
-    case BLE_HS_ENOTCONN:
-      reasonStr = "NOT_CONNECTED";
-      break;
-    default:
-      reasonStr = String(reason);
-      break;
-  }
+  pushEvent(BLEEventType::CONNECT_FAILED, reason);
+}
 
-  Util::logInfo("Connection failed, reason %d (%s)", reason, reasonStr.c_str());
-  _manager->updateStatus(BLE_FAILED, reasonStr.c_str());
+void NogasmBLEManager::ClientCallbacks::onDisconnect(NimBLEClient* client, const int reason)
+{
+  pushEvent(BLEEventType::DISCONNECTED, reason);
+}
+
+void NogasmBLEManager::ClientCallbacks::onMTUChange(NimBLEClient* client, const uint16_t mtu)
+{
+  pushEvent(BLEEventType::MTU_CHANGED, mtu);
 }
 
-void NogasmBLEManager::ClientCallbacks::onDisconnect(const NimBLEClient* client) const
+void NogasmBLEManager::ClientCallbacks::pushEvent(const BLEEventType type, const int reason) const
 {
-  Util::logDebug("Client disconnected from %s", client->getPeerAddress().toString().c_str());
-  _manager->updateStatus(BLE_FAILED, "Unexpected disconnect");
+  BLEEvent event;
+  event.type = type;
+  event.link = _link;
+  event.generation = _generation;
+  event.reason = reason;
+  event.receivedMicros = NogasmClock::micros();
+  _manager->pushEvent(event);
 }
 
 bool NogasmBLEManager::ClientCallbacks::onConnParamsUpdateRequest(NimBLEClient* client, const ble_gap_upd_params* params)
@@ -805,6 +1973,14 @@ bool NogasmBLEManager::ClientCallbacks::onConnParamsUpdateRequest(NimBLEClient*
   Util::logDebug("  > Latency: %d", params->latency);
   Util::logDebug("  > Timeout: %d", params->supervision_timeout);
 
+  // while we run low latency, don't let the toy drift back to its slower preference
+  const uint8_t profile = _manager->_links[_link].hostProfile.load(std::memory_order_relaxed);
+  if (profile == LINK_PROFILE_LOW_LATENCY && (params->itvl_min > BLE_LOW_LATENCY_MAX_INTERVAL || params->latency > 0))
+  {
+    Util::logDebug("  > Rejected, link %d runs the low latency profile", _link);
+    return false;
+  }
+
   // Accept the parameter update
   return true;
 }
\ No newline at end of file
@@ -2,14 +2,54 @@
 #define NOGASM_BLE_MANAGER_H
 
 #include <Arduino.h>
-#include <NimBLEDevice.h>
+#include "BLEStack.h"
 #include <NogasmConfig.h>
 #include <DeviceProtocol.h>
+#include "BLECommandWriter.h"
+#include "DeviceTable.h"
+#include "GattCache.h"
+#include "ReconnectScheduler.h"
+#include "MaintenanceScheduler.h"
+#include "ConnectionTimings.h"
+#include "SpscQueue.h"
+#include "SeqLock.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <functional>
 
-#define BLE_STABILISE_DELAY_MS 10
+#define BLE_CLEANUP_SETTLE_MS 100    // wait after deleting a client before connecting again
+#define BLE_DISCOVERY_SETTLE_MS 500  // wait after the link comes up before discovering attributes
+#define BLE_DISCOVERY_RETRY_MS 500   // wait between failed discovery attempts
+#define BLE_DISCOVERY_ATTEMPTS 3
+#define BLE_TEST_PULSE_MS 200  // length of the vibration pulse sent after connecting
+#define BLE_DIRECT_CONNECT_TIMEOUT_MS 3000  // a saved device that does not answer a directed connect by then gets scanned for
+
+#define BLE_ACTIVE_SCAN_INTERVAL_MS 100
+#define BLE_ACTIVE_SCAN_WINDOW_MS 100
+#define BLE_BACKGROUND_SCAN_INTERVAL_MS 1000
+#define BLE_BACKGROUND_SCAN_WINDOW_MS 50  // 5% duty cycle
+#define BLE_SESSION_SCAN_INTERVAL_MS 1000  // user scans during a session are passive
+#define BLE_SESSION_SCAN_WINDOW_MS 30      // 3% duty cycle
+#define BLE_BACKGROUND_SCAN_REFRESH_MS 20000  // restart so the duplicate filter lets known devices through again
+#define BLE_AD_TYPE_SHORT_NAME 0x08
+#define BLE_AD_TYPE_COMPLETE_NAME 0x09
+
+#define BLE_STATUS_SNAPSHOT_INTERVAL_MS 250  // the link status is republished this often, and right after a link changes state
+#define BLE_LINK_FIRMWARE_LENGTH 12
+#define BLE_REQUEST_QUEUE_LENGTH 8  // requests from the web task waiting for the loop
+
+#define BLE_EVENT_QUEUE_LENGTH 64
+#define BLE_EVENT_PAYLOAD 32  // Lovense replies are short, longer notifications are truncated, fits a device name
+
+// connection parameters, intervals in units of 1.25ms, supervision timeouts in units of 10ms
+#define BLE_LOW_LATENCY_MIN_INTERVAL 6   // 7.5ms
+#define BLE_LOW_LATENCY_MAX_INTERVAL 12  // 15ms
+#define BLE_LOW_LATENCY_TIMEOUT 400      // 4s
+#define BLE_POWER_MIN_INTERVAL 40        // 50ms
+#define BLE_POWER_MAX_INTERVAL 80        // 100ms
+#define BLE_POWER_LATENCY 4              // the toy may skip up to 4 connection events while idle
+#define BLE_POWER_TIMEOUT 600            // 6s
 
 // BLE connection states
 enum BLEConnectionState
@@ -23,10 +63,54 @@ enum BLEConnectionState
   BLE_RECONNECTING,
 };
 
-enum  CompatibleDeviceProtocol
+enum BLELinkProfile
+{
+  LINK_PROFILE_NONE,  // whatever the device asked for
+  LINK_PROFILE_LOW_LATENCY,
+  LINK_PROFILE_POWER,
+};
+
+// connection parameters as negotiated, in the units of the link layer
+struct LinkParams
+{
+  uint16_t interval = 0;  // 1.25ms
+  uint16_t latency = 0;   // connection events
+  uint16_t timeout = 0;   // 10ms
+  uint16_t mtu = 0;
+};
+
+// what the BLE host task hands over to the main loop, the callbacks do nothing but queue these
+enum class BLEEventType : uint8_t
+{
+  CONNECTED,
+  CONNECT_FAILED,
+  DISCONNECTED,
+  MTU_CHANGED,  // reason holds the new MTU
+  NOTIFICATION,
+  ADVERTISEMENT  // of a compatible device, data holds its name
+};
+
+struct BLEEvent
+{
+  BLEEventType type = BLEEventType::NOTIFICATION;
+  uint8_t link = 0;
+  uint16_t generation = 0;  // of the client that raised it, events of a replaced client are dropped
+  int reason = 0;
+  uint32_t receivedMicros = 0;
+  uint64_t address = 0;
+  uint8_t addressType = 0;
+  int8_t rssi = 0;
+  CompatibleDeviceProtocol protocol = UNKNOWN;
+  uint8_t length = 0;
+  uint8_t data[BLE_EVENT_PAYLOAD] = {};
+};
+
+// advertisements seen by the scan callback, counted on the host task
+struct BLEScanFilterStats
 {
-  UNKNOWN,
-  LOVENSE
+  uint32_t rejected = 0;    // not compatible, dropped on the raw payload without a copy
+  uint32_t identified = 0;  // compatible devices seen for the first time
+  uint32_t known = 0;       // repeats of devices identified before
 };
 
 struct CompatibleDevice
@@ -42,44 +126,241 @@ struct CompatibleDevice
   int8_t rssi = -1;
 };
 
+// maps the arousal output level (0-20) onto one link, e.g. to run a secondary toy weaker
+struct LinkOutputMapping
+{
+  float scale = 1.0f;
+  uint8_t minLevel = 0;  // lowest level written while the output is above zero
+  uint8_t maxLevel = 20;
+
+  uint8_t apply(const uint8_t level) const
+  {
+    if (level == 0)
+    {
+      return 0;
+    }
+
+    const int scaled = static_cast<int>(static_cast<float>(level) * scale + 0.5f);
+    return static_cast<uint8_t>(constrain(scaled, minLevel, maxLevel));
+  }
+};
+
+// what the web task asks of the loop, update() applies them in order
+enum class BLERequestType : uint8_t
+{
+  CONNECT,         // address
+  DISCONNECT_ALL,
+  SCAN,            // durationMs
+  LINK_MAPPING,    // address, mapping
+  LEVEL,           // command (VIBRATE, ROTATE or AIR_LEVEL), value
+  COMMAND          // command (ROTATE_CHANGE, AIR_ADJUST or POWER_OFF), value, inflate
+};
+
+struct BLERequest
+{
+  BLERequestType type = BLERequestType::LEVEL;
+  DeviceCommandType command = DeviceCommandType::VIBRATE;
+  uint8_t value = 0;
+  bool inflate = false;
+  uint32_t durationMs = 0;
+  char address[BLE_DEVICE_ADDRESS_LENGTH] = {};
+  LinkOutputMapping mapping;
+};
+
+// one device connection, every link has its own client, protocol and state machine
+struct DeviceLink
+{
+  uint8_t index = 0;
+  uint16_t generation = 0;  // bumped whenever the client is dropped
+  BLEConnectionState state = BLE_IDLE;
+  CompatibleDevice device;
+  std::unique_ptr<DeviceProtocol> protocol;
+  LinkOutputMapping mapping;
+  BLELinkProfile profile = LINK_PROFILE_NONE;
+  std::atomic<uint8_t> hostProfile{LINK_PROFILE_NONE};  // profile mirrored for the host task, only the loop writes it
+  LinkParams params;
+  ReconnectScheduler reconnect;
+  MaintenanceScheduler maintenance;
+
+  NimBLEClient* client = nullptr;
+  NimBLERemoteService* service = nullptr;
+  NimBLERemoteCharacteristic* writeCharacteristic = nullptr;
+  NimBLERemoteCharacteristic* notifyCharacteristic = nullptr;
+  GattCacheEntry gatt;      // what the last discovery found, or the persisted copy
+  bool gattCached = false;  // gatt was loaded from the cache and not tried on this connect yet
+  bool gattDirty = false;   // gatt differs from what is persisted
+
+  unsigned long lastStateChangeTime = 0;
+  unsigned long lastCleanupTime = 0;
+  unsigned long lastDiscoveryTime = 0;
+  unsigned long testPulseStartTime = 0;
+  int discoveryAttempts = 0;
+  bool testPulseActive = false;
+  bool directConnect = false;  // connecting to the saved device without a scan, a failure falls back to scanning
+
+  // the setup in progress or the last one, with the micros its phases are measured from
+  ConnectionTiming timing;
+  uint32_t connectStartUs = 0;
+  uint32_t linkUpUs = 0;
+  uint32_t connectedUs = 0;
+};
+
+// what other tasks get to see of one link, copied out of the DeviceLink by the loop
+struct LinkStatus
+{
+  uint8_t index = 0;
+  BLEConnectionState state = BLE_IDLE;
+  bool connected = false;  // the device is connected, not only the link on its way
+  uint64_t address = 0;
+  char addressType[8] = {};
+  char name[BLE_DEVICE_NAME_LENGTH] = {};
+  char model[GATT_CACHE_MODEL_LENGTH] = {};
+  char firmwareVersion[BLE_LINK_FIRMWARE_LENGTH] = {};
+  int batteryLevel = -1;
+  int8_t rssi = -1;
+  LinkOutputMapping mapping;
+  BLELinkProfile profile = LINK_PROFILE_NONE;
+  LinkParams params;
+
+  // reconnect and housekeeping state as of BLEStatusSnapshot::takenAt
+  uint16_t reconnectAttempts = 0;
+  unsigned long reconnectNextInMs = 0;
+  bool reconnectSlow = false;
+  unsigned long lastRecoveryMs = 0;
+  uint8_t reconnectHistoryCount = 0;
+  ReconnectAttempt reconnectHistory[BLE_RECONNECT_HISTORY];  // 0 is the most recent attempt
+  unsigned long batteryIntervalMs = 0;
+  long batteryAgeMs = -1;  // -1 until the first answer
+  long rssiAgeMs = -1;
+  uint32_t maintenanceDeferred = 0;
+
+  bool hasProtocol = false;
+  CommandLatencyStats latency;
+  int16_t confirmedVibration = -1;
+};
+
+// a copy of the overall state and every link for readers on other tasks
+struct BLEStatusSnapshot
+{
+  unsigned long takenAt = 0;
+  BLEConnectionState state = BLE_IDLE;
+  bool scanning = false;
+  bool scanPassive = false;
+  bool sessionActive = false;  // scans started now are passive
+  bool connected = false;
+  int8_t primary = -1;  // the first link with a connected device
+  LinkStatus links[BLE_MAX_LINKS];
+};
+
 class NogasmBLEManager
 {
  public:
   explicit NogasmBLEManager(NogasmConfig& config);
   ~NogasmBLEManager();
 
+  // the methods below touch the live links and belong to the loop, other tasks go through the request*() methods
   void begin(const char* deviceName);
   void connectToDevice(const std::string& address);
   void startScan(uint32_t durationMs = 30000);
   void stopScan();
 
-  // Device control methods
-  bool setVibrationLevel(uint8_t level) const;
-  bool setRotationLevel(uint8_t level) const;
-  bool changeRotationDirection() const;
-  bool setAirLevel(uint8_t level) const;
-  bool adjustAirLevelRelative(bool inflate, uint8_t amount) const;
-  bool powerOffDevice() const;
-  bool queryBatteryLevel() const;
+  // Device control methods, these go to every connected link
+  bool setVibrationLevel(uint8_t level);
+  bool setRotationLevel(uint8_t level);
+  bool changeRotationDirection();
+  bool setAirLevel(uint8_t level);
+  bool adjustAirLevelRelative(bool inflate, uint8_t amount);
+  bool powerOffDevice();
+  bool queryBatteryLevel();
+
+  // silences every link ahead of anything queued, resent until each device confirms it.
+  // Safe from any task, only the writer's stop lane runs right away, update() drops the output state after
+  void emergencyStop();
+
+  // only the writer's stop lane, for the control watchdog, the loop catches up on its own state later
+  void emergencyStopFromISR()
+  {
+    _commandWriter.emergencyStopFromISR();
+  }
+
+  const BLECommandWriter& getCommandWriter() const
+  {
+    return _commandWriter;
+  }
+
+  // what the scan callback made of the advertisements it saw
+  BLEScanFilterStats getScanFilterStats() const
+  {
+    return _scanCallbacks->getStats();
+  }
+
+  // the last connection setups of recently connected devices, phase by phase, a consistent copy safe from any task
+  ConnectionTimings getConnectionTimings() const
+  {
+    return _connectionTimingsSnapshot.read();
+  }
+
+  // host task events lost because the main loop fell behind
+  uint32_t getDroppedEventCount() const
+  {
+    return _droppedEvents.load(std::memory_order_relaxed);
+  }
 
   // Device information methods
-  const std::vector<CompatibleDevice>& getDevices() const;
+  // lock-free copy of the device table, safe from any task
+  DeviceTableSnapshot getDevicesSnapshot() const;
+  // changes with every published snapshot
+  uint32_t getDevicesGeneration() const;
   const CompatibleDevice* getCurrentDevice() const;
 
+  // Link information methods
+  static constexpr uint8_t getLinkCount()
+  {
+    return BLE_MAX_LINKS;
+  }
+
+  // lock-free copy of every link, safe from any task, the live links belong to the loop
+  BLEStatusSnapshot getStatusSnapshot() const
+  {
+    return _statusSnapshot.read();
+  }
+
+  // queued for the loop, for one task besides it (the web server), false when no link has the device or the queue is full
+  bool setLinkMapping(const std::string& address, const LinkOutputMapping& mapping);
+
+  // queued for the loop like setLinkMapping(), false when the queue is full
+  bool requestConnect(const std::string& address);
+  bool requestDisconnectAll();
+  bool requestScan(uint32_t durationMs);
+  bool requestLevel(DeviceCommandType type, uint8_t level);
+  bool requestCommand(DeviceCommandType type, uint8_t value = 0, bool inflate = false);
+
   // Status methods
   BLEConnectionState getState() const;
   static std::string getStateString(BLEConnectionState state) ;
+  static const char* getLinkProfileString(BLELinkProfile profile);
   bool isScanning() const;
+
+  // the running scan is passive and low duty because a session has the radio
+  bool isScanDowngraded() const
+  {
+    return _scanActive && _scanDowngraded;
+  }
   bool isConnectedState() const;
 
   // Connection management
   void update();
-  void disconnectAndCleanupClient();
-  void updateStatus(BLEConnectionState newState, const std::string& reason);
+  void disconnect(const std::string& address);
+  void disconnectAll();
   void onStatusChange(const std::function<void(BLEConnectionState)>& callback);
 
+  // switches connected links between the low latency and the power profile, and scans to a low duty passive one
+  void setSessionActive(bool active);
+
   bool connectToLastDevice();
-  bool shouldTryReconnect();
+
+  // connects to the saved device without scanning for it first
+  bool connectToSavedDevice();
 
   class ScanCallbacks final : public NimBLEScanCallbacks
   {
@@ -91,63 +372,163 @@ class NogasmBLEManager
     void onResult(const NimBLEAdvertisedDevice* advertisedDevice) override;
     void onScanEnd(const NimBLEScanResults& scanResults, int reason) override;
 
+    BLEScanFilterStats getStats() const
+    {
+      BLEScanFilterStats stats;
+      stats.rejected = _rejected.load(std::memory_order_relaxed);
+      stats.identified = _identified.load(std::memory_order_relaxed);
+      stats.known = _known.load(std::memory_order_relaxed);
+      return stats;
+    }
+
    private:
+    // compatible devices identified before, owned by the host task so repeated advertisements skip the name check
+    struct ScannedDevice
+    {
+      uint64_t address = 0;
+      CompatibleDeviceProtocol protocol = UNKNOWN;
+      char name[BLE_DEVICE_NAME_LENGTH] = {};
+    };
+
+    const ScannedDevice* findScanned(uint64_t address) const;
+    const ScannedDevice* rememberScanned(uint64_t address, CompatibleDeviceProtocol protocol, const char* name, uint8_t length);
+
+    // the advertised name inside the raw payload, a complete name wins over a shortened one
+    static bool findName(const std::vector<uint8_t>& payload, const char*& name, uint8_t& length);
+
     NogasmBLEManager* _manager;
+    ScannedDevice _scanned[BLE_DEVICE_TABLE_CAPACITY];
+    size_t _nextScanned = 0;
+
+    std::atomic<uint32_t> _rejected{0};
+    std::atomic<uint32_t> _identified{0};
+    std::atomic<uint32_t> _known{0};
   };
 
  private:
   class ClientCallbacks final : public NimBLEClientCallbacks
   {
    public:
-    explicit ClientCallbacks(NogasmBLEManager* manager) : _manager(manager)
+    ClientCallbacks(NogasmBLEManager* manager, const uint8_t link, const uint16_t generation)
+        : _manager(manager), _link(link), _generation(generation)
     {
     }
 
     void onConnect(NimBLEClient* client) override;
-    void onDisconnect(const NimBLEClient* client) const;
+    void onDisconnect(NimBLEClient* client, int reason) override;
     void onConnectFail(NimBLEClient* client, int reason) override;
     bool onConnParamsUpdateRequest(NimBLEClient* client, const ble_gap_upd_params* params) override;
+    void onMTUChange(NimBLEClient* client, uint16_t mtu) override;
 
    private:
+    void pushEvent(BLEEventType type, int reason) const;
+
     NogasmBLEManager* _manager;
+    uint8_t _link;
+    uint16_t _generation;
   };
 
   // Private methods
-  bool hasTimedOut(unsigned long timeoutMs);
-  bool findCompatibleService();
-  bool findCharacteristics();
-  void notifyStatusChange() const;
-  void processConnectionStateMachine();
-  void updateDeviceState(bool connected);
-  bool createProtocolForDevice(const CompatibleDevice& device);
+  DeviceLink* findLink(const std::string& address);
+  DeviceLink* findFreeLink();
+  static bool isLinkReady(const DeviceLink& link);
+  static bool isLinkBusy(const DeviceLink& link);
+  bool isAnyLinkBusy() const;
+  void updateBackgroundScan();
+  void configureUserScan(NimBLEScan* scan);
+  void restartUserScan();
+  bool submitLevel(DeviceCommandType type, uint8_t level);
+  bool submitToLinks(DeviceCommandType type, uint8_t value, bool inflate);
+
+  bool hasTimedOut(DeviceLink& link, unsigned long timeoutMs);
+  bool discoverAttributes(DeviceLink& link);
+  bool findCompatibleService(DeviceLink& link);
+  bool findCharacteristics(DeviceLink& link);
+  bool useCachedAttributes(DeviceLink& link);
+  void rememberAttributes(DeviceLink& link);
+  void persistAttributes(DeviceLink& link);
+  void notifyStatusChange();
+  bool pushEvent(const BLEEvent& event);
+  void processEvents();
+  void handleScanEnd();
+  void handleAdvertisement(const BLEEvent& event);
+  void publishDevices();
+  void publishStatus();
+  void applyRequests();
+  void applyRequest(const BLERequest& request);
+  void applyLinkMapping(DeviceLink& link, const LinkOutputMapping& mapping);
+  static const char* connectFailReasonString(int reason);
+  void processConnectionStateMachine(DeviceLink& link);
+  void updateDeviceState(DeviceLink& link, bool connected);
+  bool createProtocolForDevice(DeviceLink& link, const CompatibleDevice& device);
+  void disconnectAndCleanupClient(DeviceLink& link);
+  void updateStatus(DeviceLink& link, BLEConnectionState newState, const std::string& reason);
+  void setScanActive(bool active, const std::string& reason);
+  bool scheduleReconnect(DeviceLink& link);
+  void applyLinkProfile(DeviceLink& link);
+  void updateLinkParams(DeviceLink& link);
+  void runMaintenance(DeviceLink& link);
+  void subscribeNotifications(DeviceLink& link, NimBLERemoteCharacteristic* characteristic);
+  void finishConnectionTiming(DeviceLink& link);
 
   // Private members
   NogasmConfig& _config;
-  BLEConnectionState _state = BLE_IDLE;
-  std::vector<CompatibleDevice> _devices;
-  CompatibleDevice _currentDevice;
+  DeviceTable _devices;
+  SeqLock<DeviceTableSnapshot> _devicesSnapshot;
+  uint32_t _snapshotGeneration = 0;
+  unsigned long _lastSnapshotTime = 0;
+  GattCache _gattCache;
+  ConnectionTimings _connectionTimings;
+  SeqLock<ConnectionTimings> _connectionTimingsSnapshot;  // republished by the loop after every change
 
-  // Device protocol - polymorphic interface for different device types
-  std::unique_ptr<DeviceProtocol> _deviceProtocol;
+  // concurrent device connections, each with its own protocol instance
+  DeviceLink _links[BLE_MAX_LINKS];
+
+  // all device writes go through this task
+  BLECommandWriter _commandWriter;
 
-  NimBLEClient* _client = nullptr;
-  NimBLERemoteService* _service = nullptr;
-  NimBLERemoteCharacteristic* _writeCharacteristic = nullptr;
-  NimBLERemoteCharacteristic* _notifyCharacteristic = nullptr;
   ScanCallbacks* _scanCallbacks = nullptr;
-  ClientCallbacks* _clientCallbacks = nullptr;
+  ClientCallbacks* _clientCallbacks[BLE_MAX_LINKS] = {};
+
+  // what the web task reads instead of the links
+  SeqLock<BLEStatusSnapshot> _statusSnapshot;
+  BLEConnectionState _publishedStates[BLE_MAX_LINKS] = {};
+  unsigned long _lastStatusTime = 0;
+  bool _statusChanged = false;
 
-  unsigned long _lastRssiCheck = 0;
-  unsigned long _lastStateChangeTime = 0;
-  unsigned long _scanEndTime = 0;
+  // setLinkMapping() and the request*() methods from the web task, applied by update()
+  SpscQueue<BLERequest, BLE_REQUEST_QUEUE_LENGTH> _requests;
+
+  // filled by the BLE host task only, drained by update()
+  SpscQueue<BLEEvent, BLE_EVENT_QUEUE_LENGTH> _events;
+  std::atomic<uint32_t> _droppedEvents{0};
+  std::atomic<bool> _scanEnded{false};
+
+  // last vibration output before the per-link mapping, links that join late pick it up
+  uint8_t _vibrationLevel = 0;
+
+  // an emergency stop went out, update() zeroes the output and ends test pulses
+  std::atomic<bool> _stopPending{false};
+
+  unsigned long _scanStartTime = 0;
+  unsigned long _backgroundScanStart = 0;
+  uint32_t _scanDurationMs = 0;
+  unsigned long _lastDeviceAging = 0;
   unsigned long _connectionTimeoutMs = 15000;
 
+  // set when the last device advertises, update() then ends the scan and connects
+  uint64_t _lastDeviceAddress = 0;
+  bool _lastDeviceSeen = false;
+  bool _directConnectFailed = false;
+
   bool _scanActive = false;
+  bool _backgroundScanActive = false;
+  bool _scanDowngraded = false;
+  bool _sessionActive = false;
   bool _autoConnectEnabled = true;
   bool _autoReconnectEnabled = true;
-  int _reconnectAttempts = 0;
-  static constexpr int MAX_RECONNECT_ATTEMPTS = 5;
 
+  BLEConnectionState _notifiedState = BLE_IDLE;
   std::function<void(BLEConnectionState)> _statusCallback = nullptr;
 };
 
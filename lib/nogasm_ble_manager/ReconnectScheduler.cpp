@@ -0,0 +1,117 @@
+#include "ReconnectScheduler.h"
+
+void ReconnectScheduler::reset()
+{
+  _attempts = 0;
+  _scheduled = false;
+  _attemptRunning = false;
+}
+
+bool ReconnectScheduler::scheduleNext(const unsigned long now, const bool sessionActive)
+{
+  // a late failure report for an outage that already has its next attempt lined up
+  if (_scheduled)
+  {
+    return true;
+  }
+
+  if (_attempts == 0)
+  {
+    _outageStartedAt = now;
+  }
+  else if (_attempts >= BLE_RECONNECT_FAST_ATTEMPTS && !sessionActive)
+  {
+    reset();
+    return false;
+  }
+
+  _delayMs = nextDelay();
+  _scheduledAt = now;
+  _scheduled = true;
+  return true;
+}
+
+bool ReconnectScheduler::isDue(const unsigned long now) const
+{
+  return _scheduled && now - _scheduledAt >= _delayMs;
+}
+
+void ReconnectScheduler::attemptStarted(const unsigned long now)
+{
+  _scheduled = false;
+  _attemptRunning = true;
+  _attempts++;
+
+  ReconnectAttempt& entry = _history[_historyHead];
+  entry.startedAt = now;
+  entry.durationMs = 0;
+  entry.attempt = _attempts;
+  entry.success = false;
+
+  _historyHead = (_historyHead + 1) % BLE_RECONNECT_HISTORY;
+  if (_historyCount < BLE_RECONNECT_HISTORY)
+  {
+    _historyCount++;
+  }
+}
+
+void ReconnectScheduler::attemptFinished(const unsigned long now, const bool success)
+{
+  if (!_attemptRunning)
+  {
+    return;
+  }
+
+  _attemptRunning = false;
+
+  ReconnectAttempt& entry = _history[(_historyHead + BLE_RECONNECT_HISTORY - 1) % BLE_RECONNECT_HISTORY];
+  entry.durationMs = now - entry.startedAt;
+  entry.success = success;
+
+  if (success)
+  {
+    _lastRecoveryMs = now - _outageStartedAt;
+    reset();
+  }
+}
+
+unsigned long ReconnectScheduler::getNextAttemptIn(const unsigned long now) const
+{
+  if (!_scheduled || now - _scheduledAt >= _delayMs)
+  {
+    return 0;
+  }
+
+  return _delayMs - (now - _scheduledAt);
+}
+
+const ReconnectAttempt& ReconnectScheduler::getHistory(const size_t index) const
+{
+  return _history[(_historyHead + BLE_RECONNECT_HISTORY - 1 - index) % BLE_RECONNECT_HISTORY];
+}
+
+unsigned long ReconnectScheduler::nextDelay() const
+{
+  // most dropouts are a single missed supervision timeout, the device is back right away
+  if (_attempts == 0)
+  {
+    return 0;
+  }
+
+  unsigned long delayMs;
+  if (_attempts < BLE_RECONNECT_FAST_ATTEMPTS)
+  {
+    delayMs = BLE_RECONNECT_BASE_DELAY_MS << (_attempts - 1);
+    if (delayMs > BLE_RECONNECT_MAX_DELAY_MS)
+    {
+      delayMs = BLE_RECONNECT_MAX_DELAY_MS;
+    }
+  }
+  else
+  {
+    delayMs = BLE_RECONNECT_SLOW_DELAY_MS;
+  }
+
+  const unsigned long span = delayMs * BLE_RECONNECT_JITTER_PERCENT / 100;
+  return delayMs - span + esp_random() % (2 * span + 1);
+}
@@ -0,0 +1,87 @@
+#ifndef RECONNECT_SCHEDULER_H
+#define RECONNECT_SCHEDULER_H
+
+#include <Arduino.h>
+
+#define BLE_RECONNECT_BASE_DELAY_MS 250    // delay before the second attempt, doubled for every further one
+#define BLE_RECONNECT_MAX_DELAY_MS 8000
+#define BLE_RECONNECT_FAST_ATTEMPTS 6      // immediate retry plus 250ms .. 4s of backoff
+#define BLE_RECONNECT_SLOW_DELAY_MS 30000  // pace of the unlimited retries while a session runs
+#define BLE_RECONNECT_JITTER_PERCENT 25    // +-25% so links that dropped together don't retry together
+#define BLE_RECONNECT_HISTORY 8
+
+struct ReconnectAttempt
+{
+  unsigned long startedAt = 0;
+  unsigned long durationMs = 0;  // until the attempt connected or failed
+  uint16_t attempt = 0;          // 1 for the first attempt of an outage
+  bool success = false;
+};
+
+/**
+ * Decides when a dropped link tries again: the first retry is immediate, the following ones back off
+ * exponentially with jitter. When the fast attempts are used up the link gives up, unless a session is
+ * running, then it keeps retrying at a slow pace until the device is back.
+ */
+class ReconnectScheduler
+{
+ public:
+  // forgets the current outage, the next failure starts over with an immediate retry
+  void reset();
+
+  // called on every failure, false when no further attempt is scheduled
+  bool scheduleNext(unsigned long now, bool sessionActive);
+
+  bool isDue(unsigned long now) const;
+  void attemptStarted(unsigned long now);
+  void attemptFinished(unsigned long now, bool success);
+
+  bool isAttemptRunning() const
+  {
+    return _attemptRunning;
+  }
+
+  uint16_t getAttempts() const
+  {
+    return _attempts;
+  }
+
+  bool isSlowTier() const
+  {
+    return _attempts >= BLE_RECONNECT_FAST_ATTEMPTS;
+  }
+
+  // ms until the next attempt, 0 when it is due or none is scheduled
+  unsigned long getNextAttemptIn(unsigned long now) const;
+
+  // time from the drop until the link was back, of the last outage that recovered
+  unsigned long getLastRecoveryMs() const
+  {
+    return _lastRecoveryMs;
+  }
+
+  size_t getHistoryCount() const
+  {
+    return _historyCount;
+  }
+
+  // 0 is the most recent attempt
+  const ReconnectAttempt& getHistory(size_t index) const;
+
+ private:
+  unsigned long nextDelay() const;
+
+  uint16_t _attempts = 0;
+  bool _scheduled = false;
+  bool _attemptRunning = false;
+  unsigned long _outageStartedAt = 0;
+  unsigned long _scheduledAt = 0;
+  unsigned long _delayMs = 0;
+  unsigned long _lastRecoveryMs = 0;
+
+  ReconnectAttempt _history[BLE_RECONNECT_HISTORY];
+  size_t _historyHead = 0;
+  size_t _historyCount = 0;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#if defined(NOGASM_SIMULATED_BLE)
+
+#include "SimulatedLovenseToy.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static uint64_t parseAddress(const std::string& address)
+{
+  uint64_t packed = 0;
+  for (const char c : address)
+  {
+    if (isxdigit(static_cast<unsigned char>(c)))
+    {
+      packed = (packed << 4) | (isdigit(static_cast<unsigned char>(c)) ? c - '0' : tolower(c) - 'a' + 10);
+    }
+  }
+
+  return packed;
+}
+
+// the level after the last colon, "Air:Level:3;" -> 3
+static uint8_t parseLevel(const std::string& command)
+{
+  const size_t colon = command.rfind(':');
+  return colon == std::string::npos ? 0 : static_cast<uint8_t>(atoi(command.c_str() + colon + 1));
+}
+
+static bool startsWith(const std::string& value, const char* prefix)
+{
+  return value.compare(0, strlen(prefix), prefix) == 0;
+}
+
+SimulatedLovenseToy::SimulatedLovenseToy(const SimulatedToyConfig& config) : _config(config)
+{
+  _address = parseAddress(config.address);
+  _state = config.seed != 0 ? config.seed : static_cast<uint32_t>(_address ^ (_address >> 32)) | 1;
+}
+
+void SimulatedLovenseToy::setInRange(const bool inRange)
+{
+  _inRange = inRange;
+}
+
+void SimulatedLovenseToy::setReplyLatency(const uint32_t minUs, const uint32_t maxUs)
+{
+  _config.replyLatencyMinUs = minUs;
+  _config.replyLatencyMaxUs = maxUs < minUs ? minUs : maxUs;
+}
+
+void SimulatedLovenseToy::setLossPercent(const uint8_t percent)
+{
+  _config.lossPercent = percent;
+}
+
+void SimulatedLovenseToy::setConnectFailPercent(const uint8_t percent)
+{
+  _config.connectFailPercent = percent;
+}
+
+void SimulatedLovenseToy::setMeanDropInterval(const uint32_t ms)
+{
+  _config.meanDropIntervalMs = ms;
+}
+
+void SimulatedLovenseToy::setBattery(const uint8_t level)
+{
+  _config.battery = level;
+}
+
+void SimulatedLovenseToy::powerOn()
+{
+  _powered = true;
+}
+
+bool SimulatedLovenseToy::receive(const std::string& command, std::string& reply, bool& powerOff)
+{
+  _commands++;
+  powerOff = false;
+
+  // the command took effect, only the answer went missing
+  const bool lost = _config.lossPercent > 0 && random() % 100 < _config.lossPercent;
+
+  char buffer[32];
+  if (command == "DeviceType;")
+  {
+    snprintf(buffer, sizeof(buffer), "%c:%u:%012llX;", _config.modelLetter, _config.firmware, static_cast<unsigned long long>(_address));
+    reply = buffer;
+  }
+  else if (command == "Battery;")
+  {
+    snprintf(buffer, sizeof(buffer), "%u;", _config.battery);
+    reply = buffer;
+  }
+  else if (startsWith(command, "Vibrate"))
+  {
+    _vibration = parseLevel(command);
+    reply = "OK;";
+  }
+  else if (command == "RotateChange;")
+  {
+    reply = "OK;";
+  }
+  else if (startsWith(command, "Rotate:"))
+  {
+    _rotation = parseLevel(command);
+    reply = "OK;";
+  }
+  else if (startsWith(command, "Air:Level:"))
+  {
+    _air = parseLevel(command);
+    reply = "OK;";
+  }
+  else if (startsWith(command, "Air:In:") || startsWith(command, "Air:Out:"))
+  {
+    reply = "OK;";
+  }
+  else if (command == "PowerOff;")
+  {
+    _vibration = 0;
+    _powered = false;
+    powerOff = true;
+    reply = "OK;";
+  }
+  else
+  {
+    reply = "ERR;";
+  }
+
+  if (lost)
+  {
+    _lost++;
+    return false;
+  }
+
+  return true;
+}
+
+bool SimulatedLovenseToy::shouldFailConnect()
+{
+  return _config.connectFailPercent > 0 && random() % 100 < _config.connectFailPercent;
+}
+
+uint32_t SimulatedLovenseToy::nextReplyLatencyUs()
+{
+  const uint32_t span = _config.replyLatencyMaxUs - _config.replyLatencyMinUs;
+  return _config.replyLatencyMinUs + (span > 0 ? random() % (span + 1) : 0);
+}
+
+uint32_t SimulatedLovenseToy::nextDropDelayMs()
+{
+  // uniform around the mean is enough to spread the drops of several toys
+  const uint32_t mean = _config.meanDropIntervalMs;
+  return mean / 2 + random() % (mean + 1);
+}
+
+void SimulatedLovenseToy::setConnected(const bool connected)
+{
+  if (connected && !_connected)
+  {
+    _connects++;
+  }
+
+  // the motor stops with the connection, like the real toys do
+  if (!connected)
+  {
+    _vibration = 0;
+  }
+
+  _connected = connected;
+}
+
+uint32_t SimulatedLovenseToy::random()
+{
+  _state ^= _state << 13;
+  _state ^= _state >> 17;
+  _state ^= _state << 5;
+  return _state;
+}
+
+#endif
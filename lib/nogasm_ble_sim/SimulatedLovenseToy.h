@@ -0,0 +1,141 @@
+#ifndef SIMULATED_LOVENSE_TOY_H
+#define SIMULATED_LOVENSE_TOY_H
+
+#if defined(NOGASM_SIMULATED_BLE)
+
+#include <cstdint>
+#include <string>
+
+// where a toy generation keeps its uart service, the protocol recognises all three by their uuid
+enum class SimulatedGattLayout : uint8_t
+{
+  FFF0,     // 0000fff0-0000-1000-8000-00805f9b34fb
+  NORDIC,   // 6e400001-b5a3-f393-e0a9-e50e24dcca9e
+  LOVENSE,  // 5a300001-0023-4bd4-bbd5-a6920e4c5653
+};
+
+struct SimulatedToyConfig
+{
+  std::string address = "c4:4f:33:00:00:01";
+  uint8_t addressType = 0;  // BLE_ADDR_PUBLIC
+  std::string name = "LVS-Lush3";
+  char modelLetter = 'S';
+  uint8_t firmware = 11;
+  uint8_t battery = 85;
+  int8_t rssi = -60;
+  SimulatedGattLayout layout = SimulatedGattLayout::LOVENSE;
+  uint16_t handleOffset = 0;  // moves every attribute handle, like a firmware update would
+
+  uint32_t advertisingIntervalMs = 100;
+  uint32_t connectLatencyMs = 30;
+  uint32_t replyLatencyMinUs = 15000;  // write to notification, drawn uniformly per command
+  uint32_t replyLatencyMaxUs = 30000;
+  uint8_t lossPercent = 0;             // commands that never get a reply
+  uint8_t connectFailPercent = 0;      // connection attempts that fail to establish
+  uint32_t meanDropIntervalMs = 0;     // spontaneous supervision timeouts while connected, 0 never
+  uint32_t seed = 0;                   // 0 derives it from the address, so runs repeat
+};
+
+/**
+ * Scripted stand-in for a Lovense toy, answers the commands the way the real firmware does.
+ * Only the behaviour lives here, SimulatedNimBLE carries writes to it and its replies back.
+ */
+class SimulatedLovenseToy
+{
+ public:
+  explicit SimulatedLovenseToy(const SimulatedToyConfig& config);
+
+  const SimulatedToyConfig& getConfig() const
+  {
+    return _config;
+  }
+
+  uint64_t getAddress() const
+  {
+    return _address;
+  }
+
+  // scripting, take effect on the next SimulatedBLE::process()
+  void setInRange(bool inRange);
+  void setReplyLatency(uint32_t minUs, uint32_t maxUs);
+  void setLossPercent(uint8_t percent);
+  void setConnectFailPercent(uint8_t percent);
+  void setMeanDropInterval(uint32_t ms);
+  void setBattery(uint8_t level);
+
+  // powered off toys neither advertise nor accept connections until powerOn()
+  void powerOn();
+
+  bool isInRange() const
+  {
+    return _inRange;
+  }
+
+  bool isAdvertising() const
+  {
+    return _inRange && _powered && !_connected;
+  }
+
+  bool isConnectable() const
+  {
+    return _inRange && _powered && !_connected;
+  }
+
+  bool isConnected() const
+  {
+    return _connected;
+  }
+
+  uint8_t getVibration() const
+  {
+    return _vibration;
+  }
+
+  uint32_t getCommandCount() const
+  {
+    return _commands;
+  }
+
+  uint32_t getLostCount() const
+  {
+    return _lost;
+  }
+
+  uint32_t getConnectCount() const
+  {
+    return _connects;
+  }
+
+  /**
+   * Runs one written command, false when the toy does not answer (lost or no reply expected).
+   * powerOff is set when the toy shuts down after the reply.
+   */
+  bool receive(const std::string& command, std::string& reply, bool& powerOff);
+
+  bool shouldFailConnect();
+  uint32_t nextReplyLatencyUs();
+  uint32_t nextDropDelayMs();
+  void setConnected(bool connected);
+
+ private:
+  uint32_t random();
+
+  SimulatedToyConfig _config;
+  uint64_t _address = 0;
+  uint32_t _state = 0;  // xorshift32
+
+  bool _inRange = true;
+  bool _powered = true;
+  bool _connected = false;
+  uint8_t _vibration = 0;
+  uint8_t _rotation = 0;
+  uint8_t _air = 0;
+
+  uint32_t _commands = 0;
+  uint32_t _lost = 0;
+  uint32_t _connects = 0;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,767 @@
+#if defined(NOGASM_SIMULATED_BLE)
+
+#include "SimulatedNimBLE.h"
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "Clock.h"
+
+#define SIM_MTU 247
+#define SIM_POWER_OFF_DELAY_US 50000  // the toy answers the PowerOff before it drops the link
+
+namespace
+{
+enum class SimEventType : uint8_t
+{
+  CONNECTED,
+  CONNECT_FAILED,
+  DISCONNECTED,
+  NOTIFICATION,
+};
+
+struct SimEvent
+{
+  SimEventType type;
+  NimBLEClient* client;
+  int reason;
+  std::string payload;
+};
+
+struct SimToy
+{
+  std::unique_ptr<SimulatedLovenseToy> toy;
+  NimBLEClient* client = nullptr;  // connecting or connected
+  uint64_t nextAdvertUs = 0;
+  uint64_t dropAtUs = 0;       // 0 when no spontaneous drop is planned
+  uint64_t lastReplyUs = 0;    // replies never overtake each other
+};
+
+struct SimWorld
+{
+  std::recursive_mutex lock;
+  std::vector<SimToy> toys;
+  std::multimap<uint64_t, SimEvent> events;  // equal times keep their insertion order
+  std::vector<NimBLEClient*> clients;
+  NimBLEScan scan;
+};
+
+SimWorld& world()
+{
+  static SimWorld value;
+  return value;
+}
+
+uint64_t now()
+{
+  return NogasmClock::micros();
+}
+
+SimToy* findSimToy(const uint64_t address)
+{
+  for (auto& toy : world().toys)
+  {
+    if (toy.toy->getAddress() == address)
+    {
+      return &toy;
+    }
+  }
+
+  return nullptr;
+}
+
+SimToy* findSimToy(const NimBLEClient* client)
+{
+  for (auto& toy : world().toys)
+  {
+    if (toy.client == client)
+    {
+      return &toy;
+    }
+  }
+
+  return nullptr;
+}
+
+void schedule(const uint64_t dueUs, const SimEventType type, NimBLEClient* client, const int reason, const std::string& payload = "")
+{
+  world().events.emplace(dueUs, SimEvent{type, client, reason, payload});
+}
+
+struct SimGatt
+{
+  const char* service;
+  const char* write;
+  const char* notify;
+};
+
+// indexed by SimulatedGattLayout
+const SimGatt SIM_GATT_LAYOUTS[] = {
+  {"0000fff0-0000-1000-8000-00805f9b34fb", "0000fff2-0000-1000-8000-00805f9b34fb", "0000fff1-0000-1000-8000-00805f9b34fb"},
+  {"6e400001-b5a3-f393-e0a9-e50e24dcca9e", "6e400002-b5a3-f393-e0a9-e50e24dcca9e", "6e400003-b5a3-f393-e0a9-e50e24dcca9e"},
+  {"5a300001-0023-4bd4-bbd5-a6920e4c5653", "5a300002-0023-4bd4-bbd5-a6920e4c5653", "5a300003-0023-4bd4-bbd5-a6920e4c5653"},
+};
+}  // namespace
+
+// NimBLEUUID / NimBLEAddress
+
+NimBLEUUID::NimBLEUUID(const std::string& uuid) : _value(uuid)
+{
+  std::transform(_value.begin(), _value.end(), _value.begin(), [](const unsigned char c) { return static_cast<char>(tolower(c)); });
+}
+
+NimBLEUUID::NimBLEUUID(const char* uuid) : NimBLEUUID(std::string(uuid)) {}
+
+NimBLEAddress::NimBLEAddress(const std::string& address, const uint8_t type) : _type(type)
+{
+  for (const char c : address)
+  {
+    if (isxdigit(static_cast<unsigned char>(c)))
+    {
+      _value = (_value << 4) | (isdigit(static_cast<unsigned char>(c)) ? c - '0' : tolower(c) - 'a' + 10);
+    }
+  }
+}
+
+std::string NimBLEAddress::toString() const
+{
+  char buffer[18];
+  snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x",  //
+    static_cast<uint8_t>(_value >> 40), static_cast<uint8_t>(_value >> 32), static_cast<uint8_t>(_value >> 24),
+    static_cast<uint8_t>(_value >> 16), static_cast<uint8_t>(_value >> 8), static_cast<uint8_t>(_value));
+  return buffer;
+}
+
+// NimBLEAdvertisedDevice
+
+NimBLEAdvertisedDevice::NimBLEAdvertisedDevice(const NimBLEAddress& address, const std::string& name, const int rssi)
+    : _address(address), _name(name), _rssi(rssi)
+{
+  // general discoverable, no classic, then the complete local name
+  _payload = {0x02, 0x01, 0x06};
+  if (!name.empty())
+  {
+    const size_t length = min(name.size(), static_cast<size_t>(29));
+    _payload.push_back(static_cast<uint8_t>(length + 1));
+    _payload.push_back(0x09);
+    _payload.insert(_payload.end(), name.begin(), name.begin() + length);
+  }
+}
+
+// NimBLERemoteCharacteristic / NimBLERemoteService
+
+NimBLERemoteCharacteristic::NimBLERemoteCharacteristic(NimBLEClient* client, const char* uuid, const uint16_t handle, const bool write,
+  const bool notify)
+    : _client(client), _uuid(uuid), _handle(handle), _write(write), _notify(notify)
+{
+}
+
+bool NimBLERemoteCharacteristic::subscribe(const bool notifications, notify_callback callback, bool response)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  if (!_notify || !_client->isConnected())
+  {
+    return false;
+  }
+
+  _callback = notifications ? callback : nullptr;
+  return true;
+}
+
+bool NimBLERemoteCharacteristic::unsubscribe(bool response)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  _callback = nullptr;
+  return _client->isConnected();
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const char* value, const bool response)
+{
+  return SimulatedBLE::write(this, value);
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const std::string& value, const bool response)
+{
+  return SimulatedBLE::write(this, value);
+}
+
+bool NimBLERemoteCharacteristic::writeValue(const uint8_t* data, const size_t length, const bool response)
+{
+  return SimulatedBLE::write(this, std::string(reinterpret_cast<const char*>(data), length));
+}
+
+NimBLERemoteService::~NimBLERemoteService()
+{
+  for (const auto* characteristic : _characteristics)
+  {
+    delete characteristic;
+  }
+}
+
+NimBLERemoteCharacteristic* NimBLERemoteService::getCharacteristic(const NimBLEUUID& uuid)
+{
+  for (auto* characteristic : _characteristics)
+  {
+    if (characteristic->getUUID() == uuid)
+    {
+      return characteristic;
+    }
+  }
+
+  return nullptr;
+}
+
+// NimBLEClient
+
+NimBLEClient::~NimBLEClient()
+{
+  clearServices();
+}
+
+bool NimBLEClient::connect(const NimBLEAddress& address, const bool deleteAttributes, bool asyncConnect, const bool exchangeMTU)
+{
+  // always asynchronous, the outcome arrives through the callbacks from SimulatedBLE::process()
+  if (deleteAttributes)
+  {
+    clearServices();
+  }
+
+  _mtu = exchangeMTU ? SIM_MTU : 23;
+  return SimulatedBLE::startConnect(this, address);
+}
+
+int NimBLEClient::disconnect(const uint8_t reason)
+{
+  if (!isConnected())
+  {
+    return BLE_HS_ENOTCONN;
+  }
+
+  SimulatedBLE::disconnectClient(this, BLE_HS_ERR_HCI_BASE + reason);
+  return 0;
+}
+
+bool NimBLEClient::isConnected() const
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  return _connected;
+}
+
+void NimBLEClient::setConnectionParams(const uint16_t minInterval, const uint16_t maxInterval, const uint16_t latency, const uint16_t timeout,
+  uint16_t scanInterval, uint16_t scanWindow)
+{
+  _interval = maxInterval;
+  _latency = latency;
+  _timeout = timeout;
+}
+
+bool NimBLEClient::updateConnParams(const uint16_t minInterval, const uint16_t maxInterval, const uint16_t latency, const uint16_t timeout)
+{
+  if (!isConnected())
+  {
+    return false;
+  }
+
+  // the simulated toys accept whatever they are asked for
+  setConnectionParams(minInterval, maxInterval, latency, timeout);
+  return true;
+}
+
+int NimBLEClient::getRssi() const
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  return _connected && _toy != nullptr ? _toy->getConfig().rssi : 0;
+}
+
+NimBLEConnInfo NimBLEClient::getConnInfo() const
+{
+  return {_interval, _latency, _timeout, _mtu};
+}
+
+bool NimBLEClient::discoverAttributes()
+{
+  if (!isConnected())
+  {
+    return false;
+  }
+
+  SimulatedBLE::buildServices(this);
+  return true;
+}
+
+const std::vector<NimBLERemoteService*>& NimBLEClient::getServices(const bool refresh)
+{
+  if (refresh && isConnected())
+  {
+    SimulatedBLE::buildServices(this);
+  }
+
+  return _services;
+}
+
+NimBLERemoteService* NimBLEClient::getService(const NimBLEUUID& uuid)
+{
+  // a targeted discovery when nothing was discovered yet
+  if (_services.empty() && isConnected())
+  {
+    SimulatedBLE::buildServices(this);
+  }
+
+  for (auto* service : _services)
+  {
+    if (service->getUUID() == uuid)
+    {
+      return service;
+    }
+  }
+
+  return nullptr;
+}
+
+void NimBLEClient::clearServices()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  for (const auto* service : _services)
+  {
+    delete service;
+  }
+  _services.clear();
+}
+
+// NimBLEScan / NimBLEDevice
+
+bool NimBLEScan::start(const uint32_t durationMs, bool isContinue, bool restart)
+{
+  SimulatedBLE::startScan(this, durationMs);
+  return true;
+}
+
+bool NimBLEScan::stop()
+{
+  SimulatedBLE::stopScan(this);
+  return true;
+}
+
+bool NimBLEScan::isScanning()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  return _scanning;
+}
+
+bool NimBLEDevice::init(const std::string& deviceName)
+{
+  return true;
+}
+
+NimBLEScan* NimBLEDevice::getScan()
+{
+  return &world().scan;
+}
+
+NimBLEClient* NimBLEDevice::createClient()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  auto* client = new NimBLEClient();
+  world().clients.push_back(client);
+  return client;
+}
+
+bool NimBLEDevice::deleteClient(NimBLEClient* client)
+{
+  if (client == nullptr)
+  {
+    return false;
+  }
+
+  SimulatedBLE::removeClient(client);
+  delete client;
+  return true;
+}
+
+size_t NimBLEDevice::getCreatedClientCount()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  return world().clients.size();
+}
+
+// SimulatedBLE
+
+SimulatedLovenseToy& SimulatedBLE::addToy(const SimulatedToyConfig& config)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  SimToy toy;
+  toy.toy.reset(new SimulatedLovenseToy(config));
+  toy.nextAdvertUs = now();
+  world().toys.push_back(std::move(toy));
+  return *world().toys.back().toy;
+}
+
+SimulatedLovenseToy* SimulatedBLE::findToy(const uint64_t address)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  SimToy* toy = findSimToy(address);
+  return toy != nullptr ? toy->toy.get() : nullptr;
+}
+
+void SimulatedBLE::reset()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  world().events.clear();
+
+  for (NimBLEClient* client : world().clients)
+  {
+    if (!client->_connected && !client->_connecting)
+    {
+      continue;
+    }
+
+    const bool wasConnected = client->_connected;
+    client->_connected = false;
+    client->_connecting = false;
+    client->_toy = nullptr;
+    if (client->_callbacks != nullptr)
+    {
+      if (wasConnected)
+      {
+        client->_callbacks->onDisconnect(client, BLE_HS_ERR_HCI_BASE + BLE_ERR_CONN_SPVN_TMO);
+      }
+      else
+      {
+        client->_callbacks->onConnectFail(client, BLE_HS_ETIMEOUT);
+      }
+    }
+  }
+
+  world().toys.clear();
+}
+
+void SimulatedBLE::process()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  const uint64_t time = now();
+
+  while (!world().events.empty() && world().events.begin()->first <= time)
+  {
+    const SimEvent event = world().events.begin()->second;
+    world().events.erase(world().events.begin());
+
+    NimBLEClient* client = event.client;
+    SimToy* toy = findSimToy(client);
+    switch (event.type)
+    {
+      case SimEventType::CONNECTED:
+        client->_connecting = false;
+        client->_connected = true;
+        if (toy != nullptr)
+        {
+          toy->toy->setConnected(true);
+          const uint32_t dropMs = toy->toy->getConfig().meanDropIntervalMs > 0 ? toy->toy->nextDropDelayMs() : 0;
+          toy->dropAtUs = dropMs > 0 ? time + dropMs * 1000ULL : 0;
+        }
+        if (client->_callbacks != nullptr)
+        {
+          client->_callbacks->onConnect(client);
+
+          // the exchange completes with the connection, a real one takes a round trip more
+          if (client->_mtu > 23)
+          {
+            client->_callbacks->onMTUChange(client, client->_mtu);
+          }
+        }
+        break;
+
+      case SimEventType::CONNECT_FAILED:
+        client->_connecting = false;
+        client->_toy = nullptr;
+        if (toy != nullptr)
+        {
+          toy->client = nullptr;
+        }
+        if (client->_callbacks != nullptr)
+        {
+          client->_callbacks->onConnectFail(client, event.reason);
+        }
+        break;
+
+      case SimEventType::DISCONNECTED:
+        if (!client->_connected)
+        {
+          break;
+        }
+        client->_connected = false;
+        client->_toy = nullptr;
+        if (toy != nullptr)
+        {
+          toy->client = nullptr;
+          toy->dropAtUs = 0;
+          toy->toy->setConnected(false);
+        }
+        if (client->_callbacks != nullptr)
+        {
+          client->_callbacks->onDisconnect(client, event.reason);
+        }
+        break;
+
+      case SimEventType::NOTIFICATION:
+        if (!client->_connected)
+        {
+          break;
+        }
+        for (const auto* service : client->_services)
+        {
+          for (auto* characteristic : service->_characteristics)
+          {
+            if (characteristic->_notify && characteristic->_callback)
+            {
+              std::string payload = event.payload;
+              characteristic->_callback(characteristic, reinterpret_cast<uint8_t*>(&payload[0]), payload.size(), true);
+            }
+          }
+        }
+        break;
+    }
+  }
+
+  // spontaneous drops go out on the next call, like a supervision timeout that is noticed a bit later
+  for (auto& toy : world().toys)
+  {
+    if (toy.client != nullptr && toy.dropAtUs != 0 && toy.dropAtUs <= time)
+    {
+      toy.dropAtUs = 0;
+      schedule(time, SimEventType::DISCONNECTED, toy.client, BLE_HS_ERR_HCI_BASE + BLE_ERR_CONN_SPVN_TMO);
+    }
+  }
+
+  NimBLEScan& scan = world().scan;
+  if (scan._scanning)
+  {
+    for (auto& toy : world().toys)
+    {
+      if (!toy.toy->isAdvertising() || toy.nextAdvertUs > time)
+      {
+        continue;
+      }
+
+      toy.nextAdvertUs = time + toy.toy->getConfig().advertisingIntervalMs * 1000ULL;
+      scan._results._count++;
+
+      const NimBLEAdvertisedDevice device(NimBLEAddress(toy.toy->getAddress(), toy.toy->getConfig().addressType), toy.toy->getConfig().name,
+        toy.toy->getConfig().rssi);
+      if (scan._callbacks != nullptr)
+      {
+        scan._callbacks->onResult(&device);
+      }
+    }
+
+    if (scan._endUs != 0 && scan._endUs <= time)
+    {
+      scan._scanning = false;
+      scan._endPending = true;
+    }
+  }
+
+  if (scan._endPending)
+  {
+    scan._endPending = false;
+    if (scan._callbacks != nullptr)
+    {
+      scan._callbacks->onScanEnd(scan._results, 0);
+    }
+  }
+}
+
+uint64_t SimulatedBLE::nextEventUs()
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  uint64_t next = UINT64_MAX;
+
+  if (!world().events.empty())
+  {
+    next = world().events.begin()->first;
+  }
+
+  for (const auto& toy : world().toys)
+  {
+    if (toy.client != nullptr && toy.dropAtUs != 0)
+    {
+      next = std::min(next, toy.dropAtUs);
+    }
+
+    if (world().scan._scanning && toy.toy->isAdvertising())
+    {
+      next = std::min(next, toy.nextAdvertUs);
+    }
+  }
+
+  if (world().scan._scanning && world().scan._endUs != 0)
+  {
+    next = std::min(next, world().scan._endUs);
+  }
+
+  if (world().scan._endPending)
+  {
+    next = now();
+  }
+
+  return next;
+}
+
+void SimulatedBLE::dropConnection(SimulatedLovenseToy& toy, const int reason)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  SimToy* simToy = findSimToy(toy.getAddress());
+  if (simToy != nullptr && simToy->client != nullptr && simToy->client->_connected)
+  {
+    schedule(now(), SimEventType::DISCONNECTED, simToy->client, reason);
+  }
+}
+
+bool SimulatedBLE::startConnect(NimBLEClient* client, const NimBLEAddress& address)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  if (client->_connecting || client->_connected)
+  {
+    return false;
+  }
+
+  client->_peer = address;
+  client->_connecting = true;
+
+  // nobody answers, the attempt runs into the connect timeout like it would over the air
+  const uint64_t time = now();
+  SimToy* toy = findSimToy(static_cast<uint64_t>(address));
+  if (toy == nullptr || !toy->toy->isConnectable() || toy->client != nullptr)
+  {
+    schedule(time + client->_connectTimeoutMs * 1000ULL, SimEventType::CONNECT_FAILED, client, BLE_HS_ETIMEOUT);
+    return true;
+  }
+
+  const uint64_t establishedUs = time + toy->toy->getConfig().connectLatencyMs * 1000ULL;
+  if (toy->toy->shouldFailConnect())
+  {
+    schedule(establishedUs, SimEventType::CONNECT_FAILED, client, BLE_HS_ERR_HCI_BASE + BLE_ERR_CONN_ESTABLISHMENT);
+    return true;
+  }
+
+  toy->client = client;
+  client->_toy = toy->toy.get();
+  schedule(establishedUs, SimEventType::CONNECTED, client, 0);
+  return true;
+}
+
+void SimulatedBLE::disconnectClient(NimBLEClient* client, const int reason)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  schedule(now(), SimEventType::DISCONNECTED, client, reason);
+}
+
+void SimulatedBLE::removeClient(NimBLEClient* client)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+
+  // nothing may reach a deleted client
+  for (auto it = world().events.begin(); it != world().events.end();)
+  {
+    it = it->second.client == client ? world().events.erase(it) : std::next(it);
+  }
+
+  SimToy* toy = findSimToy(client);
+  if (toy != nullptr)
+  {
+    toy->client = nullptr;
+    toy->dropAtUs = 0;
+    toy->toy->setConnected(false);
+  }
+
+  auto& clients = world().clients;
+  clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+}
+
+bool SimulatedBLE::write(NimBLERemoteCharacteristic* characteristic, const std::string& value)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  NimBLEClient* client = characteristic->_client;
+  if (!characteristic->_write || !client->_connected)
+  {
+    return false;
+  }
+
+  SimToy* toy = findSimToy(client);
+  if (toy == nullptr)
+  {
+    return false;
+  }
+
+  std::string reply;
+  bool powerOff = false;
+  const uint64_t time = now();
+  if (toy->toy->receive(value, reply, powerOff))
+  {
+    // the toy works through its commands in order, a fast reply waits for the slow one before it
+    const uint64_t dueUs = std::max(time + toy->toy->nextReplyLatencyUs(), toy->lastReplyUs);
+    toy->lastReplyUs = dueUs;
+    schedule(dueUs, SimEventType::NOTIFICATION, client, 0, reply);
+  }
+
+  if (powerOff)
+  {
+    schedule(std::max(time, toy->lastReplyUs) + SIM_POWER_OFF_DELAY_US, SimEventType::DISCONNECTED, client, BLE_HS_ERR_HCI_BASE + 0x13);
+  }
+
+  return true;
+}
+
+void SimulatedBLE::buildServices(NimBLEClient* client)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  client->clearServices();
+
+  const SimToy* toy = findSimToy(client);
+  if (toy == nullptr)
+  {
+    return;
+  }
+
+  // generic access first, like every real device, then the toy's uart service.
+  // NimBLE prints 16 bit uuids in their short form, the full form would pass for an early Lovense service
+  auto* access = new NimBLERemoteService("0x1800", 0x0001);
+  access->_characteristics.push_back(new NimBLERemoteCharacteristic(client, "0x2a00", 0x0003, false, false));
+  client->_services.push_back(access);
+
+  const uint16_t offset = toy->toy->getConfig().handleOffset;
+  const SimGatt& gatt = SIM_GATT_LAYOUTS[static_cast<uint8_t>(toy->toy->getConfig().layout)];
+  auto* uart = new NimBLERemoteService(gatt.service, 0x000c + offset);
+  uart->_characteristics.push_back(new NimBLERemoteCharacteristic(client, gatt.write, 0x000e + offset, true, false));
+  uart->_characteristics.push_back(new NimBLERemoteCharacteristic(client, gatt.notify, 0x0010 + offset, false, true));
+  client->_services.push_back(uart);
+}
+
+void SimulatedBLE::startScan(NimBLEScan* scan, const uint32_t durationMs)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  const uint64_t time = now();
+
+  scan->_scanning = true;
+  scan->_endPending = false;
+  scan->_endUs = durationMs > 0 ? time + durationMs * 1000ULL : 0;
+  scan->_results = NimBLEScanResults();
+
+  // every advertising toy is heard right away, then at its own interval
+  for (auto& toy : world().toys)
+  {
+    toy.nextAdvertUs = time;
+  }
+}
+
+void SimulatedBLE::stopScan(NimBLEScan* scan)
+{
+  std::lock_guard<std::recursive_mutex> guard(world().lock);
+  if (scan->_scanning)
+  {
+    scan->_scanning = false;
+    scan->_endPending = true;
+  }
+}
+
+#endif
@@ -0,0 +1,434 @@
+#ifndef SIMULATED_NIMBLE_H
+#define SIMULATED_NIMBLE_H
+
+#if defined(NOGASM_SIMULATED_BLE)
+
+#include <Arduino.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "SimulatedLovenseToy.h"
+
+/**
+ * The part of the NimBLE client API this firmware uses, backed by SimulatedLovenseToy instead of a radio.
+ * Selected by BLEStack.h when NOGASM_SIMULATED_BLE is defined, so NogasmBLEManager and LovenseProtocol run
+ * unchanged on a host. Callbacks only fire from SimulatedBLE::process(), which stands in for the NimBLE host task.
+ */
+
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#define NIMBLE_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+#define BLE_ADDR_PUBLIC 0
+#define BLE_ADDR_RANDOM 1
+
+// host and controller error codes as NimBLE reports them, controller codes are offset by BLE_HS_ERR_HCI_BASE
+#define BLE_HS_ENOTCONN 7
+#define BLE_HS_EBADDATA 10
+#define BLE_HS_ETIMEOUT 13
+#define BLE_HS_EDONE 14
+#define BLE_HS_ERR_HCI_BASE 0x200
+#define BLE_ERR_CONN_SPVN_TMO 0x08
+#define BLE_ERR_CONN_TERM_LOCAL 0x16
+#define BLE_ERR_CONN_ESTABLISHMENT 0x3e
+
+struct ble_gap_upd_params
+{
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint16_t latency;
+  uint16_t supervision_timeout;
+  uint16_t min_ce_len;
+  uint16_t max_ce_len;
+};
+
+class NimBLEUUID
+{
+ public:
+  NimBLEUUID() = default;
+  NimBLEUUID(const std::string& uuid);  // NOLINT(*-explicit-constructor)
+  NimBLEUUID(const char* uuid);         // NOLINT(*-explicit-constructor)
+
+  std::string toString() const
+  {
+    return _value;
+  }
+
+  bool operator==(const NimBLEUUID& other) const
+  {
+    return _value == other._value;
+  }
+
+  bool operator!=(const NimBLEUUID& other) const
+  {
+    return _value != other._value;
+  }
+
+ private:
+  std::string _value;  // lower case, as NimBLE prints it
+};
+
+class NimBLEAddress
+{
+ public:
+  NimBLEAddress() = default;
+  NimBLEAddress(const std::string& address, uint8_t type);
+  NimBLEAddress(uint64_t address, uint8_t type) : _value(address), _type(type) {}
+
+  operator uint64_t() const  // NOLINT(*-explicit-constructor)
+  {
+    return _value;
+  }
+
+  std::string toString() const;
+
+  uint8_t getType() const
+  {
+    return _type;
+  }
+
+  bool isNull() const
+  {
+    return _value == 0;
+  }
+
+ private:
+  uint64_t _value = 0;
+  uint8_t _type = BLE_ADDR_PUBLIC;
+};
+
+class NimBLEConnInfo
+{
+ public:
+  NimBLEConnInfo(const uint16_t interval, const uint16_t latency, const uint16_t timeout, const uint16_t mtu)
+      : _interval(interval), _latency(latency), _timeout(timeout), _mtu(mtu)
+  {
+  }
+
+  uint16_t getConnInterval() const
+  {
+    return _interval;
+  }
+
+  uint16_t getConnLatency() const
+  {
+    return _latency;
+  }
+
+  uint16_t getConnTimeout() const
+  {
+    return _timeout;
+  }
+
+  uint16_t getMTU() const
+  {
+    return _mtu;
+  }
+
+ private:
+  uint16_t _interval;
+  uint16_t _latency;
+  uint16_t _timeout;
+  uint16_t _mtu;
+};
+
+class NimBLEClient;
+
+class NimBLERemoteCharacteristic
+{
+ public:
+  using notify_callback = std::function<void(NimBLERemoteCharacteristic*, uint8_t*, size_t, bool)>;
+
+  NimBLERemoteCharacteristic(NimBLEClient* client, const char* uuid, uint16_t handle, bool write, bool notify);
+
+  NimBLEUUID getUUID() const
+  {
+    return _uuid;
+  }
+
+  uint16_t getHandle() const
+  {
+    return _handle;
+  }
+
+  bool canWrite() const
+  {
+    return _write;
+  }
+
+  bool canWriteNoResponse() const
+  {
+    return _write;
+  }
+
+  bool canNotify() const
+  {
+    return _notify;
+  }
+
+  NimBLEClient* getClient() const
+  {
+    return _client;
+  }
+
+  bool subscribe(bool notifications = true, notify_callback callback = nullptr, bool response = true);
+  bool unsubscribe(bool response = true);
+
+  bool writeValue(const char* value, bool response = false);
+  bool writeValue(const std::string& value, bool response = false);
+  bool writeValue(const uint8_t* data, size_t length, bool response = false);
+
+ private:
+  friend class SimulatedBLE;
+
+  NimBLEClient* _client;
+  NimBLEUUID _uuid;
+  uint16_t _handle;
+  bool _write;
+  bool _notify;
+  notify_callback _callback = nullptr;
+};
+
+class NimBLERemoteService
+{
+ public:
+  NimBLERemoteService(const char* uuid, uint16_t handle) : _uuid(uuid), _handle(handle) {}
+  ~NimBLERemoteService();
+
+  NimBLEUUID getUUID() const
+  {
+    return _uuid;
+  }
+
+  uint16_t getHandle() const
+  {
+    return _handle;
+  }
+
+  const std::vector<NimBLERemoteCharacteristic*>& getCharacteristics(bool refresh = false)
+  {
+    return _characteristics;
+  }
+
+  NimBLERemoteCharacteristic* getCharacteristic(const NimBLEUUID& uuid);
+
+ private:
+  friend class SimulatedBLE;
+
+  NimBLEUUID _uuid;
+  uint16_t _handle;
+  std::vector<NimBLERemoteCharacteristic*> _characteristics;
+};
+
+class NimBLEClientCallbacks
+{
+ public:
+  virtual ~NimBLEClientCallbacks() = default;
+  virtual void onConnect(NimBLEClient* client) {}
+  virtual void onConnectFail(NimBLEClient* client, int reason) {}
+  virtual void onDisconnect(NimBLEClient* client, int reason) {}
+  virtual bool onConnParamsUpdateRequest(NimBLEClient* client, const ble_gap_upd_params* params)
+  {
+    return true;
+  }
+  virtual void onMTUChange(NimBLEClient* client, uint16_t mtu) {}
+};
+
+class NimBLEClient
+{
+ public:
+  ~NimBLEClient();
+
+  bool connect(const NimBLEAddress& address, bool deleteAttributes = true, bool asyncConnect = false, bool exchangeMTU = true);
+  int disconnect(uint8_t reason = BLE_ERR_CONN_TERM_LOCAL);
+  bool isConnected() const;
+
+  void setClientCallbacks(NimBLEClientCallbacks* callbacks, bool deleteCallbacks = true)
+  {
+    _callbacks = callbacks;
+  }
+
+  void setConnectionParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout, uint16_t scanInterval = 16,
+    uint16_t scanWindow = 16);
+  bool updateConnParams(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout);
+
+  void setConnectTimeout(const uint32_t timeoutMs)
+  {
+    _connectTimeoutMs = timeoutMs;
+  }
+
+  NimBLEAddress getPeerAddress() const
+  {
+    return _peer;
+  }
+
+  int getRssi() const;
+  NimBLEConnInfo getConnInfo() const;
+
+  uint16_t getMTU() const
+  {
+    return _mtu;
+  }
+
+  // the attribute table is known up front, discovery only materialises it
+  bool discoverAttributes();
+  const std::vector<NimBLERemoteService*>& getServices(bool refresh = false);
+  NimBLERemoteService* getService(const NimBLEUUID& uuid);
+
+ private:
+  friend class SimulatedBLE;
+
+  void clearServices();
+
+  NimBLEClientCallbacks* _callbacks = nullptr;
+  SimulatedLovenseToy* _toy = nullptr;  // while connecting or connected
+  NimBLEAddress _peer;
+  bool _connecting = false;
+  bool _connected = false;
+  uint32_t _connectTimeoutMs = 30000;
+  uint16_t _interval = 24;
+  uint16_t _latency = 0;
+  uint16_t _timeout = 400;
+  uint16_t _mtu = 23;
+  std::vector<NimBLERemoteService*> _services;
+};
+
+class NimBLEAdvertisedDevice
+{
+ public:
+  NimBLEAdvertisedDevice(const NimBLEAddress& address, const std::string& name, int rssi);
+
+  NimBLEAddress getAddress() const
+  {
+    return _address;
+  }
+
+  bool haveName() const
+  {
+    return !_name.empty();
+  }
+
+  std::string getName() const
+  {
+    return _name;
+  }
+
+  int getRSSI() const
+  {
+    return _rssi;
+  }
+
+  // flags and the complete name, laid out like the toys advertise them
+  const std::vector<uint8_t>& getPayload() const
+  {
+    return _payload;
+  }
+
+ private:
+  NimBLEAddress _address;
+  std::string _name;
+  int _rssi;
+  std::vector<uint8_t> _payload;
+};
+
+class NimBLEScanResults
+{
+ public:
+  int getCount() const
+  {
+    return _count;
+  }
+
+ private:
+  friend class SimulatedBLE;
+  int _count = 0;
+};
+
+class NimBLEScanCallbacks
+{
+ public:
+  virtual ~NimBLEScanCallbacks() = default;
+  virtual void onResult(const NimBLEAdvertisedDevice* advertisedDevice) {}
+  virtual void onScanEnd(const NimBLEScanResults& scanResults, int reason) {}
+};
+
+class NimBLEScan
+{
+ public:
+  bool start(uint32_t durationMs, bool isContinue = false, bool restart = true);
+  bool stop();
+  bool isScanning();
+
+  void setScanCallbacks(NimBLEScanCallbacks* callbacks, bool wantDuplicates = false)
+  {
+    _callbacks = callbacks;
+  }
+
+  // the simulated radio hears every advertisement, duty cycle, scan type and duplicate filter make no difference
+  void setActiveScan(bool active) {}
+  void setInterval(uint16_t intervalMs) {}
+  void setWindow(uint16_t windowMs) {}
+  void setMaxResults(uint8_t maxResults) {}
+  void setDuplicateFilter(uint8_t enabled) {}
+
+ private:
+  friend class SimulatedBLE;
+
+  NimBLEScanCallbacks* _callbacks = nullptr;
+  bool _scanning = false;
+  bool _endPending = false;
+  uint64_t _endUs = 0;  // 0 scans until stopped
+  NimBLEScanResults _results;
+};
+
+class NimBLEDevice
+{
+ public:
+  static bool init(const std::string& deviceName);
+  static NimBLEScan* getScan();
+  static NimBLEClient* createClient();
+  static bool deleteClient(NimBLEClient* client);
+  static size_t getCreatedClientCount();
+};
+
+/**
+ * The simulated radio: toys, pending deliveries and the scanner. Everything is guarded by one lock,
+ * so the loop, the writer task and whatever drives process() can share it like they share NimBLE.
+ */
+class SimulatedBLE
+{
+ public:
+  // the toy lives until reset()
+  static SimulatedLovenseToy& addToy(const SimulatedToyConfig& config);
+  static SimulatedLovenseToy* findToy(uint64_t address);
+
+  // drops every toy and pending delivery, clients still connected to them see a disconnect
+  static void reset();
+
+  // delivers connects, notifications, disconnects and advertisements that are due by NogasmClock::micros()
+  static void process();
+
+  // when process() has something to do next, for harnesses that jump a ManualClock ahead
+  static uint64_t nextEventUs();
+
+  // force a dropped link right now, like the toy walking out of range for a moment
+  static void dropConnection(SimulatedLovenseToy& toy, int reason = BLE_HS_ERR_HCI_BASE + BLE_ERR_CONN_SPVN_TMO);
+
+ private:
+  friend class NimBLEClient;
+  friend class NimBLERemoteCharacteristic;
+  friend class NimBLEScan;
+  friend class NimBLEDevice;
+
+  static bool startConnect(NimBLEClient* client, const NimBLEAddress& address);
+  static void disconnectClient(NimBLEClient* client, int reason);
+  static void removeClient(NimBLEClient* client);
+  static bool write(NimBLERemoteCharacteristic* characteristic, const std::string& value);
+  static void buildServices(NimBLEClient* client);
+  static void startScan(NimBLEScan* scan, uint32_t durationMs);
+  static void stopScan(NimBLEScan* scan);
+};
+
+#endif
+
+#endif
@@ -15,20 +15,21 @@ bool NogasmConfig::load()
     return false;
   }
 
-  size_t size = configFile.size();
-  if (size > 1024)
+  const size_t size = configFile.size();
+  if (size > NOGASM_CONFIG_MAX_SIZE)
   {
-    Util::logDebug("Config file size is too large");
+    Util::logInfo("Config file size is too large: %u bytes", static_cast<unsigned>(size));
     configFile.close();
     return false;
   }
 
-  const std::unique_ptr<char[]> buf(new char[size]);
-  configFile.readBytes(buf.get(), size);
+  const std::unique_ptr<char[]> buf(new char[size + 1]);
+  const size_t read = configFile.readBytes(buf.get(), size);
+  buf[read] = '\0';
   configFile.close();
 
   JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, buf.get());
+  DeserializationError error = deserializeJson(doc, buf.get(), read);
   if (error)
   {
     Util::logInfo("Failed to parse config file");
@@ -39,12 +40,17 @@ bool NogasmConfig::load()
   {
     _deviceAddress = doc["device"]["address"] | "";
     _deviceName = doc["device"]["name"] | "";
+    _deviceAddressType = doc["device"]["addressType"] | "PUBLIC";
   }
 
   if (doc["connection"].is<JsonObject>())
   {
     _scanDuration = doc["connection"]["scanDuration"] | 10000;
     _connectionTimeout = doc["connection"]["connectionTimeout"] | 15000;
+    _lowLatencyLink = doc["connection"]["lowLatencyLink"] | true;
+    _backgroundScan = doc["connection"]["backgroundScan"] | false;
+    _directConnect = doc["connection"]["directConnect"] | false;
+    _acknowledgedWrites = doc["connection"]["acknowledgedWrites"] | false;
   }
 
   if (doc["control"].is<JsonObject>())
@@ -78,6 +84,23 @@ bool NogasmConfig::load()
       _arousalConfig.clenchPressureSensitivity = doc["arousal"]["config"]["clenchPressureSensitivity"] | 20;
       _arousalConfig.clenchTimeMinThresholdMs = doc["arousal"]["config"]["clenchTimeMinThresholdMs"] | 250;
       _arousalConfig.clenchTimeMaxThresholdMs = doc["arousal"]["config"]["clenchTimeMaxThresholdMs"] | 3500;
+
+      // Hold (setpoint) controller settings
+      _arousalConfig.controlMode = static_cast<ArousalControlMode>(doc["arousal"]["config"]["controlMode"] | 0);
+      _arousalConfig.holdTargetPercent = doc["arousal"]["config"]["holdTargetPercent"] | 80.0f;
+      _arousalConfig.holdKp = doc["arousal"]["config"]["holdKp"] | 4.0f;
+      _arousalConfig.holdKi = doc["arousal"]["config"]["holdKi"] | 0.5f;
+      _arousalConfig.holdKd = doc["arousal"]["config"]["holdKd"] | 2.0f;
+      _arousalConfig.holdMaxLevelRate = doc["arousal"]["config"]["holdMaxLevelRate"] | 4.0f;
+
+      // Edge predictor settings
+      _arousalConfig.edgePredictorEnabled = doc["arousal"]["config"]["edgePredictorEnabled"] | false;
+      _arousalConfig.edgePredictorThreshold = doc["arousal"]["config"]["edgePredictorThreshold"] | 0.8f;
+
+      // Control loop watchdog
+      // same range the API accepts, a hand-edited 0 would trip the watchdog on every loop
+      const int watchdogDeadlineMs = doc["arousal"]["config"]["watchdogDeadlineMs"] | 250;
+      _arousalConfig.watchdogDeadlineMs = constrain(watchdogDeadlineMs, AROUSAL_WATCHDOG_DEADLINE_MIN_MS, AROUSAL_WATCHDOG_DEADLINE_MAX_MS);
     }
   }
 
@@ -98,9 +121,14 @@ bool NogasmConfig::save() const
 
   doc["device"]["address"] = _deviceAddress;
   doc["device"]["name"] = _deviceName;
+  doc["device"]["addressType"] = _deviceAddressType;
 
   doc["connection"]["scanDuration"] = _scanDuration;
   doc["connection"]["connectionTimeout"] = _connectionTimeout;
+  doc["connection"]["lowLatencyLink"] = _lowLatencyLink;
+  doc["connection"]["backgroundScan"] = _backgroundScan;
+  doc["connection"]["directConnect"] = _directConnect;
+  doc["connection"]["acknowledgedWrites"] = _acknowledgedWrites;
 
   doc["control"]["defaultVibrationLevel"] = _defaultVibrationLevel;
 
@@ -121,10 +149,27 @@ bool NogasmConfig::save() const
   doc["arousal"]["config"]["clenchPressureSensitivity"] = _arousalConfig.clenchPressureSensitivity;
   doc["arousal"]["config"]["clenchTimeMinThresholdMs"] = _arousalConfig.clenchTimeMinThresholdMs;
   doc["arousal"]["config"]["clenchTimeMaxThresholdMs"] = _arousalConfig.clenchTimeMaxThresholdMs;
+  doc["arousal"]["config"]["controlMode"] = static_cast<int>(_arousalConfig.controlMode);
+  doc["arousal"]["config"]["holdTargetPercent"] = _arousalConfig.holdTargetPercent;
+  doc["arousal"]["config"]["holdKp"] = _arousalConfig.holdKp;
+  doc["arousal"]["config"]["holdKi"] = _arousalConfig.holdKi;
+  doc["arousal"]["config"]["holdKd"] = _arousalConfig.holdKd;
+  doc["arousal"]["config"]["holdMaxLevelRate"] = _arousalConfig.holdMaxLevelRate;
+  doc["arousal"]["config"]["edgePredictorEnabled"] = _arousalConfig.edgePredictorEnabled;
+  doc["arousal"]["config"]["edgePredictorThreshold"] = _arousalConfig.edgePredictorThreshold;
+  doc["arousal"]["config"]["watchdogDeadlineMs"] = _arousalConfig.watchdogDeadlineMs;
 
   // Save misc settings
   doc["lastConnectedDevice"] = _lastConnectedDevice;
 
+  // checked before the old file is truncated, the next boot would fall back to the defaults otherwise
+  const size_t size = measureJson(doc);
+  if (size > NOGASM_CONFIG_MAX_SIZE)
+  {
+    Util::logInfo("Config is too large to save: %u bytes", static_cast<unsigned>(size));
+    return false;
+  }
+
   File configFile = _filesystem.open(_configFile, "w");
   if (!configFile)
   {
@@ -158,10 +203,16 @@ void NogasmConfig::setDeviceName(const String &name)
   _deviceName = name;
 }
 
-void NogasmConfig::saveDeviceInfo(const String &address, const String &name)
+String NogasmConfig::getDeviceAddressType() const
+{
+  return _deviceAddressType;
+}
+
+void NogasmConfig::saveDeviceInfo(const String &address, const String &name, const String &addressType)
 {
   _deviceAddress = address;
   _deviceName = name;
+  _deviceAddressType = addressType;
   _lastConnectedDevice = address;
 
   // ReSharper disable once CppExpressionWithoutSideEffects
@@ -194,6 +245,46 @@ void NogasmConfig::setConnectionTimeout(uint32_t timeout)
   _connectionTimeout = timeout;
 }
 
+bool NogasmConfig::getLowLatencyLink() const
+{
+  return _lowLatencyLink;
+}
+
+void NogasmConfig::setLowLatencyLink(bool enabled)
+{
+  _lowLatencyLink = enabled;
+}
+
+bool NogasmConfig::getBackgroundScan() const
+{
+  return _backgroundScan;
+}
+
+void NogasmConfig::setBackgroundScan(bool enabled)
+{
+  _backgroundScan = enabled;
+}
+
+bool NogasmConfig::getDirectConnect() const
+{
+  return _directConnect;
+}
+
+void NogasmConfig::setDirectConnect(bool enabled)
+{
+  _directConnect = enabled;
+}
+
+bool NogasmConfig::getAcknowledgedWrites() const
+{
+  return _acknowledgedWrites;
+}
+
+void NogasmConfig::setAcknowledgedWrites(bool enabled)
+{
+  _acknowledgedWrites = enabled;
+}
+
 uint8_t NogasmConfig::getDefaultVibrationLevel() const
 {
   return _defaultVibrationLevel;
@@ -241,8 +332,13 @@ void NogasmConfig::clear()
 {
   _deviceAddress = "";
   _deviceName = "";
+  _deviceAddressType = "PUBLIC";
   _scanDuration = 10000;
   _connectionTimeout = 15000;
+  _lowLatencyLink = true;
+  _backgroundScan = false;
+  _directConnect = false;
+  _acknowledgedWrites = false;
   _defaultVibrationLevel = 0;
   _autoConnect = true;
   _autoReconnect = true;
@@ -279,10 +375,15 @@ void NogasmConfig::clearCategory(ConfigCategory category)
     case DEVICE:
       _deviceAddress = "";
       _deviceName = "";
+      _deviceAddressType = "PUBLIC";
       break;
     case CONNECTION:
       _scanDuration = 10000;
       _connectionTimeout = 15000;
+      _lowLatencyLink = true;
+      _backgroundScan = false;
+      _directConnect = false;
+      _acknowledgedWrites = false;
       break;
     case UI:
       _autoConnect = true;
@@ -302,6 +403,15 @@ void NogasmConfig::clearCategory(ConfigCategory category)
       _arousalConfig.targetEdgeCount = 20;
       _arousalConfig.rampTimeSeconds = 50.0f;
       _arousalConfig.coolTimeSeconds = 15.0f;
+      _arousalConfig.controlMode = ArousalControlMode::EDGE;
+      _arousalConfig.holdTargetPercent = 80.0f;
+      _arousalConfig.holdKp = 4.0f;
+      _arousalConfig.holdKi = 0.5f;
+      _arousalConfig.holdKd = 2.0f;
+      _arousalConfig.holdMaxLevelRate = 4.0f;
+      _arousalConfig.edgePredictorEnabled = false;
+      _arousalConfig.edgePredictorThreshold = 0.8f;
+      _arousalConfig.watchdogDeadlineMs = 250;
       break;
   }
 
@@ -5,6 +5,8 @@
 #include <FS.h>
 #include "ArousalConfig.h"
 
+#define NOGASM_CONFIG_MAX_SIZE 4096  // bytes of JSON, save() refuses what load() would reject
+
 // Configuration categories
 enum ConfigCategory
 {
@@ -30,7 +32,8 @@ class NogasmConfig
   void setDeviceAddress(const String &address);
   String getDeviceName() const;
   void setDeviceName(const String &name);
-  void saveDeviceInfo(const String &address, const String &name);
+  String getDeviceAddressType() const;
+  void saveDeviceInfo(const String &address, const String &name, const String &addressType = "PUBLIC");
   bool hasDeviceInfo() const;
 
   // Connection settings
@@ -38,6 +41,14 @@ class NogasmConfig
   void setScanDuration(uint32_t duration);
   uint32_t getConnectionTimeout() const;
   void setConnectionTimeout(uint32_t timeout);
+  bool getLowLatencyLink() const;
+  void setLowLatencyLink(bool enabled);
+  bool getBackgroundScan() const;
+  void setBackgroundScan(bool enabled);
+  bool getDirectConnect() const;
+  void setDirectConnect(bool enabled);
+  bool getAcknowledgedWrites() const;
+  void setAcknowledgedWrites(bool enabled);
 
   // Device control settings
   uint8_t getDefaultVibrationLevel() const;
@@ -72,10 +83,15 @@ class NogasmConfig
   // Device info
   String _deviceAddress;
   String _deviceName;
+  String _deviceAddressType = "PUBLIC";
 
   // Connection settings
   uint32_t _scanDuration = 10000;       // 10 seconds
   uint32_t _connectionTimeout = 15000;  // 15 seconds
+  bool _lowLatencyLink = true;          // short connection interval while a session runs
+  bool _backgroundScan = false;         // passive low duty scan whenever no other scan runs
+  bool _directConnect = false;          // connect to the saved device at boot without scanning first
+  bool _acknowledgedWrites = false;     // hold levels back until the toy confirmed earlier ones, resend lost ones
 
   // Device control settings
   uint8_t _defaultVibrationLevel = 0;
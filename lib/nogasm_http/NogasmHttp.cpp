@@ -49,7 +49,7 @@ void NogasmHttp::update()
     return;
   }
 
-  const unsigned long currentTime = millis();
+  const unsigned long currentTime = NogasmClock::millis();
   if (Util::hasTimeExpired(WS_PING_INTERVAL_MS, _lastPingCheck))
   {
     cleanupDisconnectedClients();
@@ -222,25 +222,127 @@ void NogasmHttp::sendArousalStatusUpdate()
 template <typename T>
 void NogasmHttp::generateBleStatusJson(T &doc)
 {
-  const BLEConnectionState bleState = _bleManager.getState();
-
-  doc["scanning"] = _bleManager.isScanning();
-  doc["connected"] = _bleManager.isConnectedState();
-  doc["state"] = static_cast<int>(bleState);
-  doc["stateString"] = _bleManager.getStateString(bleState);
+  // published by the BLE loop, the links themselves are only touched there
+  const BLEStatusSnapshot status = _bleManager.getStatusSnapshot();
+  const unsigned long elapsed = NogasmClock::millis() - status.takenAt;
+  char address[BLE_DEVICE_ADDRESS_LENGTH];
+
+  doc["scanning"] = status.scanning;
+  doc["scanPassive"] = status.scanPassive;
+  doc["connected"] = status.connected;
+  doc["state"] = static_cast<int>(status.state);
+  doc["stateString"] = _bleManager.getStateString(status.state);
+
+  if (status.primary >= 0)
+  {
+    const LinkStatus &device = status.links[status.primary];
+    DeviceTable::formatAddress(device.address, address);
+    doc["device"]["name"] = device.name;
+    doc["device"]["address"] = address;
+    doc["device"]["addressType"] = device.addressType;
+    doc["device"]["battery"] = device.batteryLevel;
+    doc["device"]["model"] = device.model;
+    doc["device"]["firmwareVersion"] = device.firmwareVersion;
+    doc["device"]["rssi"] = device.rssi;
+  }
 
-  const CompatibleDevice *device = _bleManager.getCurrentDevice();
-  if (device != nullptr)
+  // every link in use, the primary device above is the first connected one
+  const auto links = doc["links"].template to<JsonArray>();
+  for (const LinkStatus &link : status.links)
   {
-    doc["device"]["name"] = device->name;
-    doc["device"]["address"] = device->address;
-    doc["device"]["addressType"] = device->addressType;
-    doc["device"]["battery"] = device->batteryLevel;
-    doc["device"]["model"] = device->modelDisplayName;
-    doc["device"]["firmwareVersion"] = device->firmwareVersion;
-    doc["device"]["rssi"] = device->rssi;
+    if (link.state == BLE_IDLE)
+    {
+      continue;
+    }
+
+    DeviceTable::formatAddress(link.address, address);
+    const auto linkObj = links.add<JsonObject>();
+    linkObj["index"] = link.index;
+    linkObj["state"] = _bleManager.getStateString(link.state);
+    linkObj["name"] = link.name;
+    linkObj["address"] = address;
+    linkObj["battery"] = link.batteryLevel;
+    linkObj["model"] = link.model;
+    linkObj["rssi"] = link.rssi;
+    linkObj["mapping"]["scale"] = link.mapping.scale;
+    linkObj["mapping"]["minLevel"] = link.mapping.minLevel;
+    linkObj["mapping"]["maxLevel"] = link.mapping.maxLevel;
+
+    // what the toy actually accepted, not what we asked for
+    linkObj["params"]["profile"] = NogasmBLEManager::getLinkProfileString(link.profile);
+    linkObj["params"]["intervalMs"] = link.params.interval * 1.25f;
+    linkObj["params"]["latency"] = link.params.latency;
+    linkObj["params"]["timeoutMs"] = link.params.timeout * 10;
+    linkObj["params"]["mtu"] = link.params.mtu;
+
+    // times in the snapshot are as of takenAt, moved forward to now
+    linkObj["reconnect"]["attempts"] = link.reconnectAttempts;
+    linkObj["reconnect"]["nextInMs"] = link.reconnectNextInMs > elapsed ? link.reconnectNextInMs - elapsed : 0;
+    linkObj["reconnect"]["slow"] = link.reconnectSlow;
+    linkObj["reconnect"]["lastRecoveryMs"] = link.lastRecoveryMs;
+    const auto history = linkObj["reconnect"]["history"].template to<JsonArray>();
+    for (uint8_t h = 0; h < link.reconnectHistoryCount; h++)
+    {
+      const ReconnectAttempt &attempt = link.reconnectHistory[h];
+      const auto attemptObj = history.add<JsonObject>();
+      attemptObj["attempt"] = attempt.attempt;
+      attemptObj["agoMs"] = NogasmClock::millis() - attempt.startedAt;
+      attemptObj["durationMs"] = attempt.durationMs;
+      attemptObj["success"] = attempt.success;
+    }
+
+    // housekeeping queries, ages are -1 until the first answer
+    linkObj["maintenance"]["batteryIntervalMs"] = link.batteryIntervalMs;
+    linkObj["maintenance"]["batteryAgeMs"] = link.batteryAgeMs >= 0 ? link.batteryAgeMs + static_cast<long>(elapsed) : -1;
+    linkObj["maintenance"]["rssiAgeMs"] = link.rssiAgeMs >= 0 ? link.rssiAgeMs + static_cast<long>(elapsed) : -1;
+    linkObj["maintenance"]["deferred"] = link.maintenanceDeferred;
+
+    if (link.hasProtocol)
+    {
+      const CommandLatencyStats &latency = link.latency;
+      linkObj["latency"]["p50Us"] = latency.p50Us;
+      linkObj["latency"]["p95Us"] = latency.p95Us;
+      linkObj["latency"]["p99Us"] = latency.p99Us;
+      linkObj["latency"]["samples"] = latency.samples;
+      linkObj["latency"]["acknowledged"] = latency.acknowledged;
+      linkObj["latency"]["unacknowledged"] = latency.unacknowledged;
+      linkObj["latency"]["writeFailed"] = latency.writeFailed;
+      linkObj["latency"]["pending"] = latency.pending;
+      linkObj["latency"]["duringScan"]["p50Us"] = latency.scanP50Us;
+      linkObj["latency"]["duringScan"]["p99Us"] = latency.scanP99Us;
+      linkObj["latency"]["duringScan"]["samples"] = latency.scanSamples;
+      linkObj["latency"]["scanCostUs"] = latency.scanSamples > 0 ? static_cast<long>(latency.scanP50Us) - static_cast<long>(latency.p50Us) : 0;
+
+      // the level the toy confirmed running, -1 until its first reply
+      linkObj["confirmedVibration"] = link.confirmedVibration;
+    }
   }
 
+  const BLECommandWriter &writer = _bleManager.getCommandWriter();
+  doc["writer"]["writes"] = writer.getWriteCount();
+  doc["writer"]["coalesced"] = writer.getCoalescedCount();
+  doc["writer"]["dropped"] = writer.getDroppedCount();
+  doc["writer"]["acknowledged"] = writer.getWriteMode() == BLEWriteMode::ACKNOWLEDGED;
+  doc["writer"]["retransmits"] = writer.getRetransmitCount();
+  doc["writer"]["unconfirmed"] = writer.getUnconfirmedCount();
+  doc["writer"]["windowWaits"] = writer.getWindowWaitCount();
+
+  const BLEStopStats stop = writer.getStopStats();
+  doc["writer"]["stop"]["count"] = stop.count;
+  doc["writer"]["stop"]["acknowledged"] = stop.acknowledged;
+  doc["writer"]["stop"]["unacknowledged"] = stop.unacknowledged;
+  doc["writer"]["stop"]["retransmits"] = stop.retransmits;
+  doc["writer"]["stop"]["lastUs"] = stop.lastUs;
+  doc["writer"]["stop"]["p50Us"] = stop.p50Us;
+  doc["writer"]["stop"]["p99Us"] = stop.p99Us;
+  doc["writer"]["stop"]["maxUs"] = stop.maxUs;
+  doc["hostEvents"]["dropped"] = _bleManager.getDroppedEventCount();
+
+  const BLEScanFilterStats scanFilter = _bleManager.getScanFilterStats();
+  doc["scanFilter"]["rejected"] = scanFilter.rejected;
+  doc["scanFilter"]["identified"] = scanFilter.identified;
+  doc["scanFilter"]["known"] = scanFilter.known;
+
   // add dynamic values as part of websocket
   doc["wifi"]["rssi"] = WiFi.RSSI();
 }
@@ -248,38 +350,64 @@ void NogasmHttp::generateBleStatusJson(T &doc)
 template <typename T>
 void NogasmHttp::generateArousalStatusJson(T &doc)
 {
-  doc["active"] = _arousalManager.isActive();
-  doc["arousalPercent"] = _arousalManager.getArousalPercent();
-  doc["pressure"] = _arousalManager.getCurrentPressure();
-  doc["limit"] = _arousalManager.getArousalLimit();
-  doc["limitExceededCounter"] = _arousalManager.getLimitExceededCounter();
-  doc["sensitivity"] = _arousalManager.getSensitivity();
-  doc["currentSessionDuration"] = _arousalManager.getCurrentSessionDuration();
-
-  doc["clenchThreshold"] = _arousalManager.getConfig().clenchPressureThreshold;
-  doc["lastClenchDuration"] = _arousalManager.getLastClenchDuration();
-  doc["state"] = _arousalManager.getCurrentStateString();
+  // one consistent snapshot, the control loop may be mid-tick while we serialize
+  const ArousalTelemetry telemetry = _arousalManager.getTelemetry();
+
+  doc["active"] = telemetry.active;
+  doc["arousalPercent"] = telemetry.arousalPercent;
+  doc["pressure"] = telemetry.pressure;
+  doc["limit"] = telemetry.arousalLimit;
+  doc["limitExceededCounter"] = telemetry.limitExceededCounter;
+  doc["sensitivity"] = telemetry.sensitivity;
+  doc["currentSessionDuration"] = telemetry.sessionDurationMs;
+
+  doc["clenchThreshold"] = telemetry.clenchThreshold;
+  doc["lastClenchDuration"] = telemetry.lastClenchDuration;
+  doc["state"] = ArousalManager::getStateString(telemetry.state);
+  doc["controlMode"] = ArousalManager::getControlModeString(telemetry.controlMode);
+  doc["vibrationLevel"] = telemetry.vibrationLevel;
+  doc["tickPeriodUs"] = telemetry.tickPeriodUs;
+  doc["tickJitterUs"] = telemetry.tickJitterUs;
+
+  doc["edgePredictor"]["loaded"] = telemetry.edgeModelLoaded;
+  doc["edgePredictor"]["probability"] = telemetry.edgeProbability;
+  doc["edgePredictor"]["inferenceUs"] = telemetry.edgeInferenceUs;
+
+  doc["watchdog"]["stalled"] = telemetry.watchdogStalled;
+  doc["watchdog"]["misses"] = telemetry.watchdogMisses;
+  doc["watchdog"]["longestGapUs"] = telemetry.watchdogLongestGapUs;
 }
 
 template <typename T>
 void NogasmHttp::generateDevicesJson(T &doc)
 {
   const JsonArray devices = doc.template to<JsonArray>();
-  for (const auto &device : _bleManager.getDevices())
+  const DeviceTableSnapshot snapshot = _bleManager.getDevicesSnapshot();
+
+  for (const DeviceTableEntry &device : snapshot.entries)
   {
+    if (!device.isUsed())
+    {
+      continue;
+    }
+
+    char address[BLE_DEVICE_ADDRESS_LENGTH];
+    DeviceTable::formatAddress(device.address, address);
+
     const auto deviceObj = devices.add<JsonObject>();
     deviceObj["name"] = device.name;
-    deviceObj["address"] = device.address;
-    deviceObj["addressType"] = device.addressType;
+    deviceObj["address"] = address;
+    deviceObj["addressType"] = DeviceTable::addressTypeString(device.addressType);
     deviceObj["connected"] = device.connected;
-    deviceObj["rssi"] = device.rssi;
+    deviceObj["rssi"] = lroundf(device.rssi);
+    deviceObj["lastSeenMs"] = snapshot.takenAt - device.lastSeen;
   }
 }
 
 template <typename T>
 void NogasmHttp::generateArousalConfigJson(T &doc)
 {
-  const ArousalConfig &config = _arousalManager.getConfig();
+  const ArousalConfig config = _arousalManager.getRequestedConfig();
 
   doc["arousalDecayRate"] = config.arousalDecayRate;
   doc["sensitivityAfterEdgeDecayRate"] = config.sensitivityAfterEdgeDecayRate;
@@ -288,6 +416,8 @@ void NogasmHttp::generateArousalConfigJson(T &doc)
   doc["maxPressureLimit"] = _arousalManager.getPressureLimit();
   doc["maxArousalLimit"] = config.maxArousalLimit;
   doc["maxVibrationLevel"] = ArousalManager::speedToLevel(config.maxSpeed);
+  // frequency, max vibration, ramp, cool-off, sensitivity threshold and decay are baked into this build
+  doc["fixedParams"] = ArousalParams::isFixed();
   doc["frequency"] = config.frequency;
   doc["rampTimeSeconds"] = config.rampTimeSeconds;
   doc["coolTimeSeconds"] = config.coolTimeSeconds;
@@ -297,6 +427,18 @@ void NogasmHttp::generateArousalConfigJson(T &doc)
   doc["clenchPressureSensitivity"] = config.clenchPressureSensitivity;
   doc["clenchTimeMinThresholdMs"] = config.clenchTimeMinThresholdMs;
   doc["clenchTimeMaxThresholdMs"] = config.clenchTimeMaxThresholdMs;
+
+  doc["controlMode"] = static_cast<int>(config.controlMode);
+  doc["holdTargetPercent"] = config.holdTargetPercent;
+  doc["holdKp"] = config.holdKp;
+  doc["holdKi"] = config.holdKi;
+  doc["holdKd"] = config.holdKd;
+  doc["holdMaxLevelRate"] = config.holdMaxLevelRate;
+
+  doc["edgePredictorEnabled"] = config.edgePredictorEnabled;
+  doc["edgePredictorThreshold"] = config.edgePredictorThreshold;
+
+  doc["watchdogDeadlineMs"] = config.watchdogDeadlineMs;
 }
 
 void NogasmHttp::setupAPIEndpoints()
@@ -313,6 +455,12 @@ void NogasmHttp::setupAPIEndpoints()
       this->handleGetDevices(request);
     });
 
+  _server.on("/api/connection-timings", HTTP_GET,
+    [this](AsyncWebServerRequest *request)
+    {
+      this->handleGetConnectionTimings(request);
+    });
+
   _server.on("/api/disconnect", HTTP_POST,
     [this](AsyncWebServerRequest *request)
     {
@@ -366,6 +514,13 @@ void NogasmHttp::setupAPIEndpoints()
       this->handleAdjustAir(request, data, len, index, total);
     });
 
+  _server.on(
+    "/api/link-mapping", HTTP_POST, [](AsyncWebServerRequest *request) { /* Empty handler - we'll use the onBody handler */ }, nullptr,
+    [this](AsyncWebServerRequest *request, uint8_t *data, const size_t len, const size_t index, const size_t total)
+    {
+      this->handleLinkMapping(request, data, len, index, total);
+    });
+
   _server.on("/api/power-off", HTTP_POST,
     [this](AsyncWebServerRequest *request)
     {
@@ -465,25 +620,80 @@ void NogasmHttp::handleGetStatus(AsyncWebServerRequest *request)
 }
 
 void NogasmHttp::handleGetDevices(AsyncWebServerRequest *request)
+{
+  // only built again when the manager published a new snapshot, polls in between get the same response
+  const uint32_t generation = _bleManager.getDevicesGeneration();
+  if (generation != _devicesJsonGeneration)
+  {
+    JsonDocument doc;
+    generateDevicesJson(doc);
+
+    _devicesJson = "";
+    serializeJson(doc, _devicesJson);
+    _devicesJsonGeneration = generation;
+  }
+
+  request->send(200, "application/json", _devicesJson);
+}
+
+void NogasmHttp::handleGetConnectionTimings(AsyncWebServerRequest *request)
 {
   JsonDocument doc;
-  generateDevicesJson(doc);
+  // a copy the loop can't change underneath us
+  const ConnectionTimings timings = _bleManager.getConnectionTimings();
+  const auto devices = doc["devices"].to<JsonArray>();
+  for (size_t d = 0; d < timings.getDeviceCount(); d++)
+  {
+    char address[BLE_DEVICE_ADDRESS_LENGTH];
+    DeviceTable::formatAddress(timings.getAddress(d), address);
+
+    const auto deviceObj = devices.add<JsonObject>();
+    deviceObj["address"] = address;
+    const auto setups = deviceObj["setups"].to<JsonArray>();
+    for (size_t i = 0; i < timings.getCount(d); i++)
+    {
+      // microseconds per phase, newest first
+      const ConnectionTiming &timing = timings.get(d, i);
+      const auto setupObj = setups.add<JsonObject>();
+      setupObj["agoMs"] = NogasmClock::millis() - timing.startedAt;
+      setupObj["cached"] = timing.cached;
+      setupObj["discoveryAttempts"] = timing.discoveryAttempts;
+      setupObj["connectUs"] = timing.connectUs;
+      setupObj["mtuUs"] = timing.mtuUs;
+      setupObj["settleUs"] = timing.settleUs;
+      setupObj["discoveryUs"] = timing.discoveryUs;
+      setupObj["lookupUs"] = timing.lookupUs;
+      setupObj["subscribeUs"] = timing.subscribeUs;
+      setupObj["totalUs"] = timing.totalUs;
+      setupObj["deviceInfoUs"] = timing.deviceInfoUs;
+    }
+  }
+
   sendJsonResponse(request, doc);
 }
 
 void NogasmHttp::handleDisconnect(AsyncWebServerRequest *request)
 {
-  _bleManager.disconnectAndCleanupClient();
-  _bleManager.updateStatus(BLE_IDLE, "User disconnect");
-  sendSuccessResponse(request, true, "Disconnected current device");
+  if (!_bleManager.requestDisconnectAll())
+  {
+    sendSuccessResponse(request, false, "Too many requests pending");
+    return;
+  }
+
+  sendSuccessResponse(request, true, "Disconnecting all devices");
 }
 
 void NogasmHttp::handleScan(AsyncWebServerRequest *request)
 {
   const uint32_t scanDuration = _config.getScanDuration();
-  _bleManager.startScan(scanDuration);
+  if (!_bleManager.requestScan(scanDuration))
+  {
+    sendSuccessResponse(request, false, "Too many requests pending");
+    return;
+  }
 
-  sendSuccessResponse(request, true, "Scan started");
+  // a session keeps the radio for the toys, the scan still runs but only listens
+  sendSuccessResponse(request, true, _bleManager.getStatusSnapshot().sessionActive ? "Passive scan started, session running" : "Scan started");
 }
 
 void NogasmHttp::handleConnect(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
@@ -497,7 +707,11 @@ void NogasmHttp::handleConnect(AsyncWebServerRequest *request, uint8_t *data, si
   }
 
   const String address = doc["address"].as<String>();
-  _bleManager.connectToDevice(address.c_str());
+  if (!_bleManager.requestConnect(address.c_str()))
+  {
+    sendSuccessResponse(request, false, "Too many requests pending");
+    return;
+  }
 
   sendSuccessResponse(request, true);
 }
@@ -519,13 +733,13 @@ void NogasmHttp::handleVibrate(AsyncWebServerRequest *request, uint8_t *data, si
     return;
   }
 
-  if (!_bleManager.isConnectedState())
+  if (!_bleManager.getStatusSnapshot().connected)
   {
     sendSuccessResponse(request, false, "No device connected");
     return;
   }
 
-  const bool success = _bleManager.setVibrationLevel(level);
+  const bool success = _bleManager.requestLevel(DeviceCommandType::VIBRATE, level);
 
   JsonDocument responseDoc;
   responseDoc["success"] = success;
@@ -551,13 +765,13 @@ void NogasmHttp::handleRotate(AsyncWebServerRequest *request, uint8_t *data, siz
     return;
   }
 
-  if (!_bleManager.isConnectedState())
+  if (!_bleManager.getStatusSnapshot().connected)
   {
     sendSuccessResponse(request, false, "No device connected");
     return;
   }
 
-  const bool success = _bleManager.setRotationLevel(level);
+  const bool success = _bleManager.requestLevel(DeviceCommandType::ROTATE, level);
   JsonDocument responseDoc;
   responseDoc["success"] = success;
   responseDoc["level"] = level;
@@ -567,13 +781,13 @@ void NogasmHttp::handleRotate(AsyncWebServerRequest *request, uint8_t *data, siz
 
 void NogasmHttp::handleRotateDirection(AsyncWebServerRequest *request)
 {
-  if (!_bleManager.isConnectedState())
+  if (!_bleManager.getStatusSnapshot().connected)
   {
     sendSuccessResponse(request, false, "No device connected");
     return;
   }
 
-  const bool success = _bleManager.changeRotationDirection();
+  const bool success = _bleManager.requestCommand(DeviceCommandType::ROTATE_CHANGE);
   sendSuccessResponse(request, success);
 }
 
@@ -595,13 +809,13 @@ void NogasmHttp::handleAirLevel(AsyncWebServerRequest *request, uint8_t *data, s
     return;
   }
 
-  if (!_bleManager.isConnectedState())
+  if (!_bleManager.getStatusSnapshot().connected)
   {
     sendSuccessResponse(request, false, "No device connected");
     return;
   }
 
-  const bool success = _bleManager.setAirLevel(level);
+  const bool success = _bleManager.requestLevel(DeviceCommandType::AIR_LEVEL, level);
   JsonDocument responseDoc;
   responseDoc["success"] = success;
   responseDoc["level"] = level;
@@ -629,25 +843,81 @@ void NogasmHttp::handleAdjustAir(AsyncWebServerRequest *request, uint8_t *data,
     return;
   }
 
-  if (!_bleManager.isConnectedState())
+  if (!_bleManager.getStatusSnapshot().connected)
   {
     sendSuccessResponse(request, false, "No device connected");
     return;
   }
 
-  const bool success = _bleManager.adjustAirLevelRelative(inflate, amount);
+  const bool success = _bleManager.requestCommand(DeviceCommandType::AIR_ADJUST, amount, inflate);
   sendSuccessResponse(request, success);
 }
 
+void NogasmHttp::handleLinkMapping(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  JsonDocument doc;
+  const DeserializationError error = deserializeJson(doc, data, len);
+  if (error)
+  {
+    sendSuccessResponse(request, false, "Invalid JSON");
+    return;
+  }
+
+  const String address = doc["address"].as<String>();
+
+  // start from the link's current mapping so partial updates keep the other values
+  LinkOutputMapping mapping;
+  const uint64_t packed = DeviceTable::packAddress(address.c_str());
+  const BLEStatusSnapshot status = _bleManager.getStatusSnapshot();
+  for (const LinkStatus &link : status.links)
+  {
+    if (link.state != BLE_IDLE && link.address == packed)
+    {
+      mapping = link.mapping;
+    }
+  }
+
+  if (!doc["scale"].isNull())
+  {
+    mapping.scale = doc["scale"].as<float>();
+  }
+
+  if (!doc["minLevel"].isNull())
+  {
+    mapping.minLevel = doc["minLevel"].as<uint8_t>();
+  }
+
+  if (!doc["maxLevel"].isNull())
+  {
+    mapping.maxLevel = doc["maxLevel"].as<uint8_t>();
+  }
+
+  if (mapping.scale < 0 || mapping.maxLevel > 20)
+  {
+    sendSuccessResponse(request, false, "Scale must be positive and max level at most 20");
+    return;
+  }
+
+  if (!_bleManager.setLinkMapping(address.c_str(), mapping))
+  {
+    sendSuccessResponse(request, false, "Device has no link or too many changes are pending");
+    return;
+  }
+
+  sendSuccessResponse(request, true);
+}
+
 void NogasmHttp::handlePowerOff(AsyncWebServerRequest *request)
 {
-  if (!_bleManager.isConnectedState())
+  if (!_bleManager.getStatusSnapshot().connected)
   {
     sendSuccessResponse(request, false, "No device connected");
     return;
   }
 
-  const bool success = _bleManager.powerOffDevice();
+  // the stop goes out first, a device that ignores the power off is at least silent
+  _bleManager.emergencyStop();
+  const bool success = _bleManager.requestCommand(DeviceCommandType::POWER_OFF);
   sendSuccessResponse(request, success);
 }
 
@@ -657,6 +927,10 @@ void NogasmHttp::handleGetConfig(AsyncWebServerRequest *request)
 
   doc["connection"]["scanDuration"] = _config.getScanDuration();
   doc["connection"]["connectionTimeout"] = _config.getConnectionTimeout();
+  doc["connection"]["lowLatencyLink"] = _config.getLowLatencyLink();
+  doc["connection"]["backgroundScan"] = _config.getBackgroundScan();
+  doc["connection"]["directConnect"] = _config.getDirectConnect();
+  doc["connection"]["acknowledgedWrites"] = _config.getAcknowledgedWrites();
 
   doc["device"]["defaultVibrationLevel"] = _config.getDefaultVibrationLevel();
 
@@ -694,6 +968,34 @@ void NogasmHttp::handleUpdateConfig(AsyncWebServerRequest *request, uint8_t *dat
       _config.setConnectionTimeout(connectionTimeout);
       configChanged = true;
     }
+
+    if (!doc["connection"]["lowLatencyLink"].isNull() && doc["connection"]["lowLatencyLink"].is<bool>())
+    {
+      const bool lowLatencyLink = doc["connection"]["lowLatencyLink"].as<bool>();
+      _config.setLowLatencyLink(lowLatencyLink);
+      configChanged = true;
+    }
+
+    if (!doc["connection"]["backgroundScan"].isNull() && doc["connection"]["backgroundScan"].is<bool>())
+    {
+      const bool backgroundScan = doc["connection"]["backgroundScan"].as<bool>();
+      _config.setBackgroundScan(backgroundScan);
+      configChanged = true;
+    }
+
+    if (!doc["connection"]["directConnect"].isNull() && doc["connection"]["directConnect"].is<bool>())
+    {
+      const bool directConnect = doc["connection"]["directConnect"].as<bool>();
+      _config.setDirectConnect(directConnect);
+      configChanged = true;
+    }
+
+    if (!doc["connection"]["acknowledgedWrites"].isNull() && doc["connection"]["acknowledgedWrites"].is<bool>())
+    {
+      const bool acknowledgedWrites = doc["connection"]["acknowledgedWrites"].as<bool>();
+      _config.setAcknowledgedWrites(acknowledgedWrites);
+      configChanged = true;
+    }
   }
 
   if (doc["device"].is<JsonObject>())
@@ -844,7 +1146,7 @@ void NogasmHttp::handleUpdateArousalConfig(AsyncWebServerRequest *request, uint8
   }
 
   // Get current config and modify with new values
-  ArousalConfig config = _arousalManager.getConfig();
+  ArousalConfig config = _arousalManager.getRequestedConfig();
 
   if (!doc["arousalDecayRate"].isNull())
   {
@@ -893,6 +1195,24 @@ void NogasmHttp::handleUpdateArousalConfig(AsyncWebServerRequest *request, uint8
     config.coolTimeSeconds = doc["coolTimeSeconds"].as<float>();
   }
 
+  // a fixed build runs on constants, the UI sends them back unchanged, anything else would be ignored silently
+  if (ArousalParams::isFixed())
+  {
+    ArousalConfig fixed = config;
+    ArousalParams::pin(fixed);
+    const bool changed = config.frequency != fixed.frequency ||
+      ArousalManager::speedToLevel(config.maxSpeed) != ArousalManager::speedToLevel(fixed.maxSpeed) ||
+      lroundf(config.rampTimeSeconds * 1000) != lroundf(fixed.rampTimeSeconds * 1000) ||
+      lroundf(config.coolTimeSeconds * 1000) != lroundf(fixed.coolTimeSeconds * 1000) ||
+      config.sensitivityThreshold != fixed.sensitivityThreshold ||
+      lroundf(config.arousalDecayRate * 1000) != lroundf(fixed.arousalDecayRate * 1000);
+    if (changed)
+    {
+      sendSuccessResponse(request, false, "Frequency, max vibration, ramp, cool-off, sensitivity threshold and decay are fixed in this build");
+      return;
+    }
+  }
+
   if (!doc["clenchPressureSensitivity"].isNull())
   {
     config.clenchPressureSensitivity = doc["clenchPressureSensitivity"].as<int>();
@@ -913,6 +1233,52 @@ void NogasmHttp::handleUpdateArousalConfig(AsyncWebServerRequest *request, uint8
     config.targetEdgeCount = doc["targetEdgeCount"].as<int>();
   }
 
+  if (!doc["controlMode"].isNull())
+  {
+    const int controlMode = constrain(doc["controlMode"].as<int>(), 0, static_cast<int>(ArousalControlMode::HOLD));
+    config.controlMode = static_cast<ArousalControlMode>(controlMode);
+  }
+
+  if (!doc["holdTargetPercent"].isNull())
+  {
+    config.holdTargetPercent = constrain(doc["holdTargetPercent"].as<float>(), 0.0f, 100.0f);
+  }
+
+  if (!doc["holdKp"].isNull())
+  {
+    config.holdKp = doc["holdKp"].as<float>();
+  }
+
+  if (!doc["holdKi"].isNull())
+  {
+    config.holdKi = doc["holdKi"].as<float>();
+  }
+
+  if (!doc["holdKd"].isNull())
+  {
+    config.holdKd = doc["holdKd"].as<float>();
+  }
+
+  if (!doc["holdMaxLevelRate"].isNull())
+  {
+    config.holdMaxLevelRate = doc["holdMaxLevelRate"].as<float>();
+  }
+
+  if (!doc["edgePredictorEnabled"].isNull())
+  {
+    config.edgePredictorEnabled = doc["edgePredictorEnabled"].as<bool>();
+  }
+
+  if (!doc["edgePredictorThreshold"].isNull())
+  {
+    config.edgePredictorThreshold = constrain(doc["edgePredictorThreshold"].as<float>(), 0.0f, 1.0f);
+  }
+
+  if (!doc["watchdogDeadlineMs"].isNull())
+  {
+    config.watchdogDeadlineMs = constrain(doc["watchdogDeadlineMs"].as<int>(), AROUSAL_WATCHDOG_DEADLINE_MIN_MS, AROUSAL_WATCHDOG_DEADLINE_MAX_MS);
+  }
+
   // Update the config in the arousal manager
   _arousalManager.setConfig(config);
 
@@ -39,6 +39,10 @@ class NogasmHttp
   BLEConnectionState _lastBleState;
   bool _lastArousalActive;
 
+  // serialized /api/devices response and the device snapshot it was built from, only used by the AsyncTCP task
+  String _devicesJson;
+  uint32_t _devicesJsonGeneration = UINT32_MAX;
+
   // References to external dependencies
   fs::FS& _filesystem;
   NogasmBLEManager& _bleManager;
@@ -54,6 +58,7 @@ class NogasmHttp
   // API endpoint handlers - status
   void handleGetStatus(AsyncWebServerRequest* request);
   void handleGetDevices(AsyncWebServerRequest* request);
+  void handleGetConnectionTimings(AsyncWebServerRequest* request);
   void handleDisconnect(AsyncWebServerRequest* request);
   void handleScan(AsyncWebServerRequest* request);
 
@@ -63,6 +68,7 @@ class NogasmHttp
   void handleRotateDirection(AsyncWebServerRequest* request);
   void handleAirLevel(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
   void handleAdjustAir(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+  void handleLinkMapping(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
   void handlePowerOff(AsyncWebServerRequest* request);
 
   // API endpoint handlers - configuration
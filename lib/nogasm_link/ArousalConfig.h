@@ -1,6 +1,17 @@
 #ifndef AROUSAL_CONFIG_H
 #define AROUSAL_CONFIG_H
 
+#include <cstdint>
+
+#define AROUSAL_WATCHDOG_DEADLINE_MIN_MS 50    // shorter trips on ordinary loop jitter
+#define AROUSAL_WATCHDOG_DEADLINE_MAX_MS 5000  // longer leaves the toy running through a real stall
+
+enum class ArousalControlMode
+{
+  EDGE,  // Ramp vibration until the arousal limit is exceeded, then cool off
+  HOLD   // Continuously adjust vibration to hold arousal at a target percentage
+};
+
 struct ArousalConfig
 {
   float arousalDecayRate = 0.990;               // How quickly arousal decays (percentage)
@@ -18,6 +29,18 @@ struct ArousalConfig
   int clenchPressureSensitivity = 20;               // Sensitivity for clench detection
   int clenchTimeMinThresholdMs = 250;               // Minimum time for clench detection (ms)
   int clenchTimeMaxThresholdMs = 3500;              // Maximum time for clench detection (ms)
+
+  ArousalControlMode controlMode = ArousalControlMode::EDGE;  // How vibration speed is driven
+  float holdTargetPercent = 80.0;                             // Arousal percentage to hold in HOLD mode (0-100)
+  float holdKp = 4.0;                                         // Proportional gain (speed per arousal percent)
+  float holdKi = 0.5;                                         // Integral gain (speed per arousal percent second)
+  float holdKd = 2.0;                                         // Derivative gain (speed per arousal percent/second)
+  float holdMaxLevelRate = 4.0;                               // Max vibration change in HOLD mode (levels/second)
+
+  bool edgePredictorEnabled = false;   // Use the edge prediction model as an extra edge trigger
+  float edgePredictorThreshold = 0.8;  // Probability (0-1) at which a predicted edge triggers a cool-off
+
+  int watchdogDeadlineMs = 250;  // Devices are stopped when the control loop misses its ticks this long (ms)
 };
 
 enum class ArousalState
@@ -50,4 +73,29 @@ struct ArousalStateEvent
   long clenchDuration;
 };
 
+// Snapshot of the control loop published once per tick, see ArousalManager::getTelemetry()
+struct ArousalTelemetry
+{
+  bool active;
+  ArousalState state;
+  ArousalControlMode controlMode;
+  float arousalPercent;
+  float pressure;
+  int arousalLimit;
+  int sensitivity;
+  int limitExceededCounter;
+  unsigned long sessionDurationMs;
+  float clenchThreshold;
+  long lastClenchDuration;
+  uint8_t vibrationLevel;  // 0-20
+  unsigned long tickPeriodUs;
+  unsigned long tickJitterUs;
+  bool edgeModelLoaded;
+  float edgeProbability;
+  unsigned long edgeInferenceUs;
+  bool watchdogStalled;  // the control loop watchdog fired and no tick has come since
+  uint32_t watchdogMisses;
+  uint32_t watchdogLongestGapUs;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,214 @@
+#ifndef AROUSAL_ENGINE_H
+#define AROUSAL_ENGINE_H
+
+#include "ArousalConfig.h"
+
+/**
+ * Per-tick constants derived from a runtime ArousalConfig.
+ * Computed once in apply() (called from ArousalManager::setConfig()) instead of on every control tick.
+ */
+class RuntimeArousalParams
+{
+ public:
+  static constexpr bool isFixed()
+  {
+    return false;
+  }
+
+  // the runtime config is the source of truth, nothing to pin
+  static void pin(ArousalConfig&)
+  {
+  }
+
+  void apply(const ArousalConfig& config)
+  {
+    const int frequency = config.frequency > 0 ? config.frequency : 1;
+
+    _frequency = frequency;
+    _maxSpeed = config.maxSpeed;
+    _updatePeriodMs = 1000 / frequency;
+    _coolOffPeriodMs = static_cast<unsigned long>(config.coolTimeSeconds * 1000);
+    _speedIncrement = static_cast<float>(config.maxSpeed) / (static_cast<float>(frequency) * config.rampTimeSeconds);
+    _peakThreshold = static_cast<float>(config.sensitivityThreshold) / 10.0f;
+    _decayRate = config.arousalDecayRate;
+  }
+
+  int frequency() const
+  {
+    return _frequency;
+  }
+
+  int maxSpeed() const
+  {
+    return _maxSpeed;
+  }
+
+  unsigned long updatePeriodMs() const
+  {
+    return _updatePeriodMs;
+  }
+
+  unsigned long coolOffPeriodMs() const
+  {
+    return _coolOffPeriodMs;
+  }
+
+  float speedIncrement() const
+  {
+    return _speedIncrement;
+  }
+
+  float peakThreshold() const
+  {
+    return _peakThreshold;
+  }
+
+  float decayRate() const
+  {
+    return _decayRate;
+  }
+
+ private:
+  int _frequency = 60;
+  int _maxSpeed = 255;
+  unsigned long _updatePeriodMs = 16;
+  unsigned long _coolOffPeriodMs = 15000;
+  float _speedIncrement = 0.085f;
+  float _peakThreshold = 7.0f;
+  float _decayRate = 0.990f;
+};
+
+/**
+ * Compile-time parameters for fixed deployments, the compiler folds these into the control loop.
+ * Floating point template arguments are not available, so times are in ms and the decay rate in permille.
+ */
+template <int Frequency, int MaxSpeed, int RampTimeMs, int CoolTimeMs, int SensitivityThreshold, int DecayRatePermille>
+class FixedArousalParams
+{
+  static_assert(Frequency > 0, "Frequency must be positive");
+  static_assert(RampTimeMs > 0, "Ramp time must be positive");
+
+ public:
+  static constexpr bool isFixed()
+  {
+    return true;
+  }
+
+  // overwrites the baked in fields of a runtime config, so everything that reads the config sees what the engine runs on
+  static void pin(ArousalConfig& config)
+  {
+    config.frequency = Frequency;
+    config.maxSpeed = MaxSpeed;
+    config.rampTimeSeconds = static_cast<float>(RampTimeMs) / 1000.0f;
+    config.coolTimeSeconds = static_cast<float>(CoolTimeMs) / 1000.0f;
+    config.sensitivityThreshold = SensitivityThreshold;
+    config.arousalDecayRate = decayRate();
+  }
+
+  // the values are baked in
+  void apply(const ArousalConfig&)
+  {
+  }
+
+  static constexpr int frequency()
+  {
+    return Frequency;
+  }
+
+  static constexpr int maxSpeed()
+  {
+    return MaxSpeed;
+  }
+
+  static constexpr unsigned long updatePeriodMs()
+  {
+    return 1000 / Frequency;
+  }
+
+  static constexpr unsigned long coolOffPeriodMs()
+  {
+    return CoolTimeMs;
+  }
+
+  static constexpr float speedIncrement()
+  {
+    return static_cast<float>(MaxSpeed) * 1000.0f / (static_cast<float>(Frequency) * static_cast<float>(RampTimeMs));
+  }
+
+  static constexpr float peakThreshold()
+  {
+    return static_cast<float>(SensitivityThreshold) / 10.0f;
+  }
+
+  static constexpr float decayRate()
+  {
+    return static_cast<float>(DecayRatePermille) / 1000.0f;
+  }
+};
+
+/**
+ * The per-tick arousal math of ArousalManager, specialised on its parameter source.
+ * With RuntimeArousalParams the constants are loaded from memory, with FixedArousalParams they are immediates.
+ */
+template <typename Params>
+class ArousalEngine
+{
+ public:
+  // pins the config to what the parameters can represent, then takes its values
+  void configure(ArousalConfig& config)
+  {
+    Params::pin(config);
+    _params.apply(config);
+  }
+
+  const Params& params() const
+  {
+    return _params;
+  }
+
+  float decay(const float arousal) const
+  {
+    return arousal * _params.decayRate();
+  }
+
+  /**
+   * Tracks the rising edge of the pressure signal.
+   * @return the height of a peak that just ended if it exceeds the sensitivity threshold, 0 otherwise
+   */
+  float detectPeak(const float pressure, const float lastPressure, float& peakStart) const
+  {
+    float peak = 0;
+    if (pressure < lastPressure)
+    {
+      if (lastPressure > peakStart && lastPressure - peakStart > _params.peakThreshold())
+      {
+        peak = lastPressure - peakStart;
+      }
+      peakStart = pressure;
+    }
+
+    return peak;
+  }
+
+  float ramp(const float speed) const
+  {
+    return speed + _params.speedIncrement();
+  }
+
+  bool inCoolOff(const unsigned long elapsedSinceLimitMs) const
+  {
+    return elapsedSinceLimitMs < _params.coolOffPeriodMs();
+  }
+
+ private:
+  Params _params;
+};
+
+#ifdef NOGASM_FIXED_AROUSAL_PARAMS
+// e.g. -DNOGASM_FIXED_AROUSAL_PARAMS="60,255,50000,15000,70,990"
+using ArousalParams = FixedArousalParams<NOGASM_FIXED_AROUSAL_PARAMS>;
+#else
+using ArousalParams = RuntimeArousalParams;
+#endif
+
+#endif
@@ -1,9 +1,13 @@
 // ReSharper disable CppExpressionWithoutSideEffects
 #include "ArousalManager.h"
 
-ArousalManager::ArousalManager(PressureSensor& sensor, NogasmBLEManager& bleManager) : _pressureSensor(sensor), _bleManager(bleManager)
+ArousalManager::ArousalManager(PressureSensor& sensor, NogasmBLEManager& bleManager) : _pressureSensor(sensor), _bleManager(bleManager), _watchdog(bleManager)
 {
-  _arousalLimit = _config.maxArousalLimit;
+  _engine.configure(_config);
+  _requestedConfig.write(_config);
+  _edgePredictor.setFrequency(_engine.params().frequency());
+  _watchdog.setDeadline(_config.watchdogDeadlineMs);
+  applyArousalLimit(_config.maxArousalLimit);
 }
 
 void ArousalManager::toggle()
@@ -26,25 +30,43 @@ void ArousalManager::reset()
   _lastVibrationLevel = 0;
   _vibrationSpeed = 0;
   _lastUpdateTime = 0;
+  _lastTickMicros = 0;
+  _tickPeriodUs = 0;
+  _tickJitterUs = 0;
   _limitExceeded = false;
   _limitExceededTime = 0;
   _limitExceededCounter = 0;
+  _clenchActive = false;
+  _edgePredictor.reset();
+  resetHoldController();
 }
 
 void ArousalManager::begin()
 {
   reset();
   _started = true;
-  _sessionStartTime = millis();
+  _sessionStartTime = NogasmClock::millis();
+  _watchdog.arm();
   Util::logDebug("ArousalManager started with pressure limit: %d", _arousalLimit);
   notifyStateChange(ArousalState::IDLE);
+  markTelemetryStale();
 }
 
 void ArousalManager::end()
 {
   _started = false;
-  updateVibrationLevel(0);
+  _watchdog.disarm();
+
+  // always through the stop lane, even when the last level was already 0 a write may still be queued
+  if (_lastVibrationLevel != 0)
+  {
+    notifyStateChange(ArousalState::VIBRATION_CHANGE);
+  }
+  _lastVibrationLevel = 0;
+  _bleManager.emergencyStop();
+
   notifyStateChange(ArousalState::IDLE);
+  markTelemetryStale();
   Util::logDebug("Stopped ArousalManager");
 }
 
@@ -72,7 +94,12 @@ void ArousalManager::notifyStateChange(const ArousalState newState, const long c
 
 String ArousalManager::getCurrentStateString() const
 {
-  switch (_currentState)
+  return getStateString(_currentState);
+}
+
+String ArousalManager::getStateString(const ArousalState state)
+{
+  switch (state)
   {
     case ArousalState::IDLE:
       return "IDLE";
@@ -101,23 +128,70 @@ String ArousalManager::getCurrentStateString() const
   }
 }
 
+void ArousalManager::publishTelemetry()
+{
+  ArousalTelemetry telemetry{};
+  telemetry.active = _started;
+  telemetry.state = _currentState;
+  telemetry.controlMode = _config.controlMode;
+  telemetry.arousalPercent = getArousalPercent();
+  telemetry.pressure = _pressureSensor.getLastSmoothedPressure();
+  telemetry.arousalLimit = _arousalLimit;
+  telemetry.sensitivity = getSensitivity();
+  telemetry.limitExceededCounter = _limitExceededCounter;
+  telemetry.sessionDurationMs = getCurrentSessionDuration();
+  telemetry.clenchThreshold = _config.clenchPressureThreshold;
+  telemetry.lastClenchDuration = _clenchDurationMs;
+  telemetry.vibrationLevel = _lastVibrationLevel;
+  telemetry.tickPeriodUs = _tickPeriodUs;
+  telemetry.tickJitterUs = _tickJitterUs;
+  telemetry.edgeModelLoaded = _edgePredictor.isLoaded();
+  telemetry.edgeProbability = _edgePredictor.getLastProbability();
+  telemetry.edgeInferenceUs = _edgePredictor.getLastInferenceUs();
+  telemetry.watchdogStalled = _watchdog.isStalled();
+  telemetry.watchdogMisses = _watchdog.getMissCount();
+  telemetry.watchdogLongestGapUs = _watchdog.getLongestGapUs();
+
+  _telemetry.write(telemetry);
+}
+
 void ArousalManager::update()
 {
-  if (!_started)
+  // a config from the web task is swapped in between ticks, never while one is half way through
+  if (_configPending.exchange(false, std::memory_order_acquire))
   {
-    return;
+    applyConfig(_requestedConfig.read());
   }
 
-  const unsigned long currentTime = millis();
-  const unsigned long updatePeriod = 1000 / _config.frequency;
-  if (!Util::hasTimeExpired(updatePeriod, _lastUpdateTime))
+  // begin(), end() and the setters may have run on the web task since, only this task writes the snapshot
+  const bool stale = _telemetryStale.exchange(false, std::memory_order_acquire);
+
+  const unsigned long currentTime = NogasmClock::millis();
+  const unsigned long updatePeriod = _engine.params().updatePeriodMs();
+  if (!_started || !Util::hasTimeExpired(updatePeriod, _lastUpdateTime))
   {
+    if (stale)
+    {
+      publishTelemetry();
+    }
     return;
   }
 
-  _arousal *= _config.arousalDecayRate;
+  if (_watchdog.feed())
+  {
+    // the watchdog stopped the devices while the loop was stuck, make this tick send its level again
+    Util::logInfo("ArousalManager::control loop stalled, devices were stopped by the watchdog");
+    _lastVibrationLevel = 0;
+  }
+
+  processTick(currentTime, updatePeriod);
+  publishTelemetry();
+}
+
+void ArousalManager::processTick(const unsigned long currentTime, const unsigned long updatePeriod)
+{
+  _arousal = _engine.decay(_arousal);
 
-  const float speedIncrement = (static_cast<float>(_config.maxSpeed) / (static_cast<float>(_config.frequency) * _config.rampTimeSeconds));
   const float pressure = _pressureSensor.readSmoothedPressure();
 
   if (!_pressureSensor.isReady())
@@ -135,23 +209,19 @@ void ArousalManager::update()
     return;
   }
 
-  if (pressure < _lastPressureValue)
+  const float peak = _engine.detectPeak(pressure, _lastPressureValue, _peakStart);
+  if (peak > 0)
   {
-    if (_lastPressureValue > _peakStart)
-    {
-      const float sensitivityThreshold = static_cast<float>(_config.sensitivityThreshold) / 10.0f;
-      if (_lastPressureValue - _peakStart > sensitivityThreshold)
-      {
-        _arousal += (_lastPressureValue - _peakStart);
-        notifyStateChange(ArousalState::AROUSAL_INCREASE);
-        Util::logDebug("ArousalManager::increase -> arousal=%.2f, limit=%d, increased_by=%.2f", _arousal, _arousalLimit, _lastPressureValue - _peakStart);
-      }
-    }
-    _peakStart = pressure;
+    _arousal += peak;
+    notifyStateChange(ArousalState::AROUSAL_INCREASE);
+    Util::logDebug("ArousalManager::increase -> arousal=%.2f, limit=%d, increased_by=%.2f", _arousal, _arousalLimit, peak);
   }
 
   _lastPressureValue = pressure;
-  _lastUpdateTime = currentTime;
+
+  // keep a fixed cadence by advancing in whole periods, only resync when we fell behind by more than a period
+  const float dtSeconds = measureTick(updatePeriod);
+  _lastUpdateTime = (currentTime - _lastUpdateTime > 2 * updatePeriod) ? currentTime : _lastUpdateTime + updatePeriod;
 
   const long clenchDuration = detectClench(currentTime, pressure);
   if (clenchDuration > 0)
@@ -170,14 +240,96 @@ void ArousalManager::update()
     }
   }
 
-  const unsigned long coolOffPeriodMs = _config.coolTimeSeconds * 1000;
+  const bool edgePredicted = updateEdgePredictor(pressure, clenchDuration);
+
+  if (_config.controlMode == ArousalControlMode::HOLD)
+  {
+    updateHoldControl(dtSeconds);
+  }
+  else
+  {
+    updateEdgeControl(currentTime, updatePeriod, edgePredicted);
+  }
+
+  if (_vibrationSpeed > 0)
+  {
+    const float speed = constrain(_vibrationSpeed, 0, _engine.params().maxSpeed());
+    uint8_t vibrationLevel = speedToLevel(speed);
+
+    // the toy only has 20 levels, don't let the controller dither across a level boundary
+    if (_config.controlMode == ArousalControlMode::HOLD && vibrationLevel != _lastVibrationLevel)
+    {
+      const float levelStep = static_cast<float>(SPEED_VIB_MAX) / SPEED_LEVEL_MAX;
+      if (fabsf(speed - static_cast<float>(levelToSpeed(_lastVibrationLevel))) < (0.5f + HOLD_LEVEL_HYSTERESIS) * levelStep)
+      {
+        vibrationLevel = _lastVibrationLevel;
+      }
+    }
+
+    updateVibrationLevel(vibrationLevel);
+  }
+  else
+  {
+    _vibrationSpeed = 0;
+    updateVibrationLevel(0);
+  }
+}
+
+float ArousalManager::measureTick(const unsigned long updatePeriod)
+{
+  const unsigned long now = NogasmClock::micros();
+  const unsigned long periodUs = updatePeriod * 1000;
+  const unsigned long elapsedUs = _lastTickMicros == 0 ? periodUs : now - _lastTickMicros;
+  _lastTickMicros = now;
+
+  _tickPeriodUs = _tickPeriodUs == 0 ? elapsedUs : _tickPeriodUs + (static_cast<long>(elapsedUs) - static_cast<long>(_tickPeriodUs)) / 8;
+
+  const unsigned long jitterUs = elapsedUs > periodUs ? elapsedUs - periodUs : periodUs - elapsedUs;
+  if (jitterUs > _tickJitterUs)
+  {
+    _tickJitterUs = jitterUs;
+  }
+
+  // a stalled loop should not be fed to the controller as one huge step
+  return constrain(static_cast<float>(elapsedUs) / 1000000.0f, 0.001f, 4.0f * static_cast<float>(updatePeriod) / 1000.0f);
+}
+
+bool ArousalManager::updateEdgePredictor(const float pressure, const long clenchDuration)
+{
+  const bool clenchStarted = clenchDuration > 0 && !_clenchActive;
+  _clenchActive = clenchDuration > 0;
+
+  _edgePredictor.addSample(pressure, clenchStarted);
+  if (!_config.edgePredictorEnabled || !_edgePredictor.isLoaded())
+  {
+    return false;
+  }
+
+  const float probability = _edgePredictor.predict();
+  Util::logTrace("ArousalManager::edge::predict -> probability=%.2f, took=%luus", probability, _edgePredictor.getLastInferenceUs());
+
+  return probability >= _config.edgePredictorThreshold;
+}
+
+bool ArousalManager::loadEdgeModel(fs::FS& filesystem, const char* path)
+{
+  return _edgePredictor.loadModel(filesystem, path);
+}
+
+void ArousalManager::updateEdgeControl(const unsigned long currentTime, const unsigned long updatePeriod, const bool edgePredicted)
+{
   const bool orgasmAllowed = _limitExceededCounter >= _config.targetEdgeCount;
-  const bool inCoolOffPeriod = _limitExceeded && (currentTime - _limitExceededTime < coolOffPeriodMs);
+  const bool inCoolOffPeriod = _limitExceeded && _engine.inCoolOff(currentTime - _limitExceededTime);
 
-  if (_arousal > _arousalLimit)
+  if (_arousal > _arousalLimit || edgePredicted)
   {
     if (!_limitExceeded)
     {
+      if (edgePredicted && _arousal <= _arousalLimit)
+      {
+        Util::logDebug("ArousalManager::edge::predicted -> probability=%.2f", _edgePredictor.getLastProbability());
+      }
+
       _limitExceeded = true;
       _limitExceededTime = currentTime;
       _limitExceededCounter++;
@@ -193,10 +345,10 @@ void ArousalManager::update()
 
         // decay limit each time we exceeded the limit (1.0 to disable this)
         const float newArousalLimit = _arousalLimit * constrain(_config.sensitivityAfterEdgeDecayRate, 0.0f, 1.0f);
-        _arousalLimit = static_cast<int>(newArousalLimit);
+        applyArousalLimit(static_cast<int>(newArousalLimit));
         if (_arousalLimit <= 0)
         {
-          _arousalLimit = map(constrain(_config.minSensitivityWhileDecaying, 10, 255), 0, 255, 0, _pressureSensor.getMaxPressureLimitRaw());
+          applyArousalLimit(map(constrain(_config.minSensitivityWhileDecaying, 10, 255), 0, 255, 0, _pressureSensor.getMaxPressureLimitRaw()));
         }
 
         notifyStateChange(ArousalState::LIMIT_EXCEEDED);
@@ -211,7 +363,7 @@ void ArousalManager::update()
       if (currentTime % 500 <= updatePeriod)
       {
         notifyStateChange(ArousalState::COOL_OFF_ACTIVE);
-        Util::logDebug("ArousalManager::cool-off -> remaining time: %dms", coolOffPeriodMs - (currentTime - _limitExceededTime));
+        Util::logDebug("ArousalManager::cool-off -> remaining time: %dms", _engine.params().coolOffPeriodMs() - (currentTime - _limitExceededTime));
       }
     }
   }
@@ -225,21 +377,100 @@ void ArousalManager::update()
       Util::logDebug("ArousalManager::cool-off::ended -> resuming vibration");
     }
   }
-  else if (_vibrationSpeed < _config.maxSpeed)
+  else if (_vibrationSpeed < _engine.params().maxSpeed())
   {
     Util::logTrace("ArousalManager::vibration ramping -> %.2f", _vibrationSpeed);
-    _vibrationSpeed += speedIncrement;
+    _vibrationSpeed = _engine.ramp(_vibrationSpeed);
   }
+}
 
-  if (_vibrationSpeed > 0)
+void ArousalManager::updateHoldControl(const float dtSeconds)
+{
+  const auto maxSpeed = static_cast<float>(_engine.params().maxSpeed());
+  const float percent = getArousalPercent();
+  const float error = _config.holdTargetPercent - percent;
+
+  // derivative on the measurement so target changes don't kick the output
+  const float percentRate = (percent - _holdLastPercent) / dtSeconds;
+  _holdDerivative += HOLD_DERIVATIVE_SMOOTHING * (percentRate - _holdDerivative);
+  _holdLastPercent = percent;
+
+  const float proportional = _config.holdKp * error;
+  const float derivative = _config.holdKd * _holdDerivative;
+
+  // anti-windup: stop integrating while the output is saturated in the direction of the error
+  const float unclamped = proportional + _holdIntegral + _config.holdKi * error * dtSeconds - derivative;
+  const bool saturated = (unclamped >= maxSpeed && error > 0) || (unclamped <= 0 && error < 0);
+  if (!saturated)
   {
-    const uint8_t vibrationLevel = speedToLevel(constrain(_vibrationSpeed, 0, _config.maxSpeed));
-    updateVibrationLevel(vibrationLevel);
+    _holdIntegral = constrain(_holdIntegral + _config.holdKi * error * dtSeconds, 0.0f, maxSpeed);
   }
-  else
+
+  const float targetSpeed = constrain(proportional + _holdIntegral - derivative, 0.0f, maxSpeed);
+
+  // rate limit the output, the toy only reacts after a BLE round trip so large jumps just overshoot
+  const float maxStep = _config.holdMaxLevelRate * (static_cast<float>(SPEED_VIB_MAX) / SPEED_LEVEL_MAX) * dtSeconds;
+  _vibrationSpeed += constrain(targetSpeed - _vibrationSpeed, -maxStep, maxStep);
+
+  Util::logTrace("ArousalManager::hold -> percent=%.2f, error=%.2f, integral=%.2f, target=%.2f, speed=%.2f",  //
+    percent, error, _holdIntegral, targetSpeed, _vibrationSpeed);
+}
+
+void ArousalManager::resetHoldController()
+{
+  _holdIntegral = 0;
+  _holdDerivative = 0;
+  _holdLastPercent = getArousalPercent();
+}
+
+void ArousalManager::setConfig(const ArousalConfig& config)
+{
+  // pinned here already, so getRequestedConfig() shows what the engine will run on
+  ArousalConfig requested = config;
+  ArousalParams::pin(requested);
+  _requestedConfig.write(requested);
+  _configPending.store(true, std::memory_order_release);
+}
+
+void ArousalManager::applyConfig(const ArousalConfig& config)
+{
+  // a mode switch goes through setControlMode() so the controller state is reset like any other switch
+  const ArousalControlMode mode = _config.controlMode;
+  _config = config;
+  _config.controlMode = mode;
+  setControlMode(config.controlMode);
+
+  _engine.configure(_config);
+  _edgePredictor.setFrequency(_engine.params().frequency());
+  _watchdog.setDeadline(_config.watchdogDeadlineMs);
+  markTelemetryStale();
+}
+
+void ArousalManager::setControlMode(const ArousalControlMode mode)
+{
+  if (mode == _config.controlMode)
   {
-    _vibrationSpeed = 0;
-    updateVibrationLevel(0);
+    return;
+  }
+
+  _config.controlMode = mode;
+  _limitExceeded = false;
+  resetHoldController();
+  markTelemetryStale();
+
+  Util::logDebug("ArousalManager control mode: %s", getControlModeString(mode).c_str());
+}
+
+String ArousalManager::getControlModeString(const ArousalControlMode mode)
+{
+  switch (mode)
+  {
+    case ArousalControlMode::EDGE:
+      return "EDGE";
+    case ArousalControlMode::HOLD:
+      return "HOLD";
+    default:
+      return "UNKNOWN";
   }
 }
 
@@ -259,7 +490,7 @@ long ArousalManager::detectClench(const unsigned long currentTime, const float p
 
   if (pressure > _config.clenchPressureThreshold)
   {
-    _clenchDurationMs = millis() - _clenchStartTime;
+    _clenchDurationMs = NogasmClock::millis() - _clenchStartTime;
     Util::logTrace("ArousalManager::clench::valid -> duration=%dms, pressure=%.2f, threshold=%.2f", _clenchDurationMs, pressure, _config.clenchPressureThreshold);
 
     // autocorrect threshold if clench is longer than the configured maximum
@@ -276,7 +507,7 @@ long ArousalManager::detectClench(const unsigned long currentTime, const float p
     return _clenchDurationMs;
   }
 
-  _clenchStartTime = millis();
+  _clenchStartTime = NogasmClock::millis();
   _clenchDurationMs -= 150;
   if (_clenchDurationMs <= 0)
   {
@@ -311,7 +542,13 @@ void ArousalManager::updateVibrationLevel(const uint8_t level)
 
 float ArousalManager::getArousalPercent() const
 {
-  return constrain(100.0 * _arousal / (float)_arousalLimit, 0, 100);
+  return constrain(_arousal * _arousalPercentScale, 0.0f, 100.0f);
+}
+
+void ArousalManager::applyArousalLimit(const int limit)
+{
+  _arousalLimit = limit;
+  _arousalPercentScale = limit > 0 ? 100.0f / static_cast<float>(limit) : 0.0f;
 }
 
 unsigned int ArousalManager::getPressureLimit() const
@@ -5,11 +5,21 @@
 #include "PressureSensor.h"
 #include "NogasmBLEManager.h"
 #include "ArousalConfig.h"
+#include "ArousalEngine.h"
+#include "EdgePredictor.h"
+#include "ControlWatchdog.h"
 #include "Util.h"
+#include "SeqLock.h"
+#include <atomic>
 
 #define SPEED_LEVEL_MAX 20
 #define SPEED_VIB_MAX 255
 
+// HOLD mode: fraction of a level the speed has to move past a level boundary before the output level changes
+#define HOLD_LEVEL_HYSTERESIS 0.25f
+// HOLD mode: smoothing factor for the derivative term, arousal moves in steps whenever a peak is detected
+#define HOLD_DERIVATIVE_SMOOTHING 0.1f
+
 class ArousalManager
 {
  public:
@@ -53,11 +63,50 @@ class ArousalManager
     return _clenchDurationMs;
   }
 
-  void setConfig(const ArousalConfig& config)
+  // staged for the loop, update() applies it before the next tick. For one caller at a time (setup, then the web task)
+  void setConfig(const ArousalConfig& config);
+
+  // the config as last set, including one update() has not applied yet, safe from any task
+  ArousalConfig getRequestedConfig() const
+  {
+    return _requestedConfig.read();
+  }
+
+  // clears the HOLD controller and any edge in progress when the mode actually changes, loop only
+  void setControlMode(ArousalControlMode mode);
+
+  ArousalControlMode getControlMode() const
+  {
+    return _config.controlMode;
+  }
+
+  static String getControlModeString(ArousalControlMode mode);
+
+  bool loadEdgeModel(fs::FS& filesystem, const char* path);
+
+  const EdgePredictor& getEdgePredictor() const
+  {
+    return _edgePredictor;
+  }
+
+  const ControlWatchdog& getWatchdog() const
+  {
+    return _watchdog;
+  }
+
+  // measured time between control ticks, smoothed (microseconds)
+  unsigned long getTickPeriodUs() const
+  {
+    return _tickPeriodUs;
+  }
+
+  // largest deviation of a single tick from the configured period since begin() (microseconds)
+  unsigned long getTickJitterUs() const
   {
-    _config = config;
+    return _tickJitterUs;
   }
 
+  // the config the loop runs on, loop only
   const ArousalConfig& getConfig() const
   {
     return _config;
@@ -72,7 +121,8 @@ class ArousalManager
 
   void setArousalLimit(const int limit)
   {
-    _arousalLimit = limit;
+    applyArousalLimit(limit);
+    markTelemetryStale();
   }
 
   int getArousalLimit() const
@@ -84,8 +134,9 @@ class ArousalManager
 
   void setSensitivity(const int sensitivity)
   {
-    _arousalLimit = map(sensitivity, 0, 255, 1, _config.maxArousalLimit);
+    applyArousalLimit(map(sensitivity, 0, 255, 1, _config.maxArousalLimit));
     notifyStateChange(ArousalState::AROUSAL_LIMIT_CHANGE);
+    markTelemetryStale();
     Util::logDebug("ArousalManager updated sensitivity: %d", sensitivity);
   }
 
@@ -105,6 +156,16 @@ class ArousalManager
   }
 
   String getCurrentStateString() const;
+  static String getStateString(ArousalState state);
+
+  /**
+   * A consistent copy of the state published by the control loop at the end of each tick.
+   * Safe to call from any task or core, it never touches live state.
+   */
+  ArousalTelemetry getTelemetry() const
+  {
+    return _telemetry.read();
+  }
 
   int getLimitExceededCounter() const
   {
@@ -118,13 +179,18 @@ class ArousalManager
       return 0;
     }
 
-    return millis() - _sessionStartTime;
+    return NogasmClock::millis() - _sessionStartTime;
   }
 
  private:
   PressureSensor& _pressureSensor;
   NogasmBLEManager& _bleManager;
   ArousalConfig _config;
+  SeqLock<ArousalConfig> _requestedConfig;   // written by setConfig() only
+  std::atomic<bool> _configPending{false};  // update() applies _requestedConfig
+  ArousalEngine<ArousalParams> _engine;
+  EdgePredictor _edgePredictor;
+  ControlWatchdog _watchdog;
 
   bool _started = false;
   bool _limitExceeded = false;
@@ -135,6 +201,7 @@ class ArousalManager
 
   int _limitExceededCounter = 0;
   int _arousalLimit = 4000;
+  float _arousalPercentScale = 100.0f / 4000.0f;
   float _arousal = 0;
   float _lastPressureValue = 0;
   float _peakStart = 0;
@@ -143,11 +210,39 @@ class ArousalManager
 
   long _clenchDurationMs = 0;
   unsigned long _clenchStartTime = 0;
+  bool _clenchActive = false;
+
+  // control loop timing
+  unsigned long _lastTickMicros = 0;
+  unsigned long _tickPeriodUs = 0;
+  unsigned long _tickJitterUs = 0;
+
+  // HOLD mode controller state
+  float _holdIntegral = 0;
+  float _holdDerivative = 0;
+  float _holdLastPercent = 0;
 
   ArousalState _currentState = ArousalState::IDLE;
+  SeqLock<ArousalTelemetry> _telemetry;
+  std::atomic<bool> _telemetryStale{false};  // set from any task, the loop republishes
   std::function<void(const ArousalStateEvent&)> _stateChangeCallback = nullptr;
 
   long detectClench(unsigned long currentTime, float pressure);
+  float measureTick(unsigned long updatePeriod);
+  void processTick(unsigned long currentTime, unsigned long updatePeriod);
+  void publishTelemetry();
+  void applyConfig(const ArousalConfig& config);
+
+  // the snapshot has a single writer, callers off the loop task only ask update() to republish it
+  void markTelemetryStale()
+  {
+    _telemetryStale.store(true, std::memory_order_release);
+  }
+  bool updateEdgePredictor(float pressure, long clenchDuration);
+  void updateEdgeControl(unsigned long currentTime, unsigned long updatePeriod, bool edgePredicted);
+  void updateHoldControl(float dtSeconds);
+  void resetHoldController();
+  void applyArousalLimit(int limit);
   void updateVibrationLevel(uint8_t level);
   void notifyStateChange(ArousalState newState, long clenchDuration = 0);
 };
@@ -0,0 +1,101 @@
+#include "ControlWatchdog.h"
+#include "Util.h"
+
+ControlWatchdog::ControlWatchdog(NogasmBLEManager& bleManager) : _bleManager(bleManager) {}
+
+ControlWatchdog::~ControlWatchdog()
+{
+  if (_timer != nullptr)
+  {
+    esp_timer_stop(_timer);
+    esp_timer_delete(_timer);
+  }
+}
+
+void ControlWatchdog::setDeadline(const unsigned long deadlineMs)
+{
+  // applies to the running check right away, the check period follows on the next arm()
+  _deadlineUs.store(deadlineMs * 1000, std::memory_order_relaxed);
+}
+
+void ControlWatchdog::arm()
+{
+  // created on first use, esp_timer is not up yet when the global objects are constructed
+  if (_timer == nullptr)
+  {
+    esp_timer_create_args_t args = {};
+    args.callback = timerCallback;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "control_wdt";
+    args.skip_unhandled_events = true;
+
+    if (esp_timer_create(&args, &_timer) != ESP_OK)
+    {
+      _timer = nullptr;
+      Util::logInfo("ControlWatchdog::timer create failed, control loop not supervised");
+      return;
+    }
+  }
+
+  _lastFeedUs.store(NogasmClock::micros(), std::memory_order_relaxed);
+  _stalled.store(false, std::memory_order_relaxed);
+  _armed.store(true, std::memory_order_release);
+
+  // a quarter of the deadline, so a stall is caught at most 25% late
+  uint32_t periodUs = _deadlineUs.load(std::memory_order_relaxed) / 4;
+  if (periodUs < CONTROL_WATCHDOG_MIN_CHECK_US)
+  {
+    periodUs = CONTROL_WATCHDOG_MIN_CHECK_US;
+  }
+
+  esp_timer_stop(_timer);
+  esp_timer_start_periodic(_timer, periodUs);
+}
+
+void ControlWatchdog::disarm()
+{
+  _armed.store(false, std::memory_order_release);
+  _stalled.store(false, std::memory_order_relaxed);
+
+  if (_timer != nullptr)
+  {
+    esp_timer_stop(_timer);
+  }
+}
+
+bool ControlWatchdog::feed()
+{
+  const uint32_t now = NogasmClock::micros();
+  const uint32_t gapUs = now - _lastFeedUs.exchange(now, std::memory_order_relaxed);
+  if (gapUs > _longestGapUs)
+  {
+    _longestGapUs = gapUs;
+  }
+
+  return _stalled.exchange(false, std::memory_order_acq_rel);
+}
+
+void ControlWatchdog::timerCallback(void* arg)
+{
+  static_cast<ControlWatchdog*>(arg)->check();
+}
+
+void ControlWatchdog::check()
+{
+  if (!_armed.load(std::memory_order_acquire) || _stalled.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+
+  const uint32_t sinceFeedUs = NogasmClock::micros() - _lastFeedUs.load(std::memory_order_relaxed);
+  if (sinceFeedUs < _deadlineUs.load(std::memory_order_relaxed))
+  {
+    return;
+  }
+
+  // one stop per stall, the flag stays up until the loop ticks again
+  _stalled.store(true, std::memory_order_release);
+  _misses.fetch_add(1, std::memory_order_relaxed);
+  _bleManager.emergencyStopFromISR();
+}
@@ -0,0 +1,70 @@
+#ifndef CONTROL_WATCHDOG_H
+#define CONTROL_WATCHDOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+#include "NogasmBLEManager.h"
+
+#define CONTROL_WATCHDOG_MIN_CHECK_US 10000  // never check more often than every 10ms
+
+/**
+ * Silences the devices when the control loop stops ticking, e.g. while loop() is stuck in WiFi setup or a flash write.
+ * An esp_timer checks the time since the last feed() and fires the writer's stop lane once per stall. The timer
+ * side only touches atomics and the ISR-safe stop, everything else stays on the loop.
+ */
+class ControlWatchdog
+{
+ public:
+  explicit ControlWatchdog(NogasmBLEManager& bleManager);
+  ~ControlWatchdog();
+
+  void setDeadline(unsigned long deadlineMs);
+
+  unsigned long getDeadlineMs() const
+  {
+    return _deadlineUs.load(std::memory_order_relaxed) / 1000;
+  }
+
+  // start supervising, the deadline runs from now
+  void arm();
+  void disarm();
+
+  // called on every control tick, true when the watchdog had fired since the previous one
+  bool feed();
+
+  // a stall was caught and the loop has not ticked since
+  bool isStalled() const
+  {
+    return _stalled.load(std::memory_order_acquire);
+  }
+
+  uint32_t getMissCount() const
+  {
+    return _misses.load(std::memory_order_relaxed);
+  }
+
+  // longest time between two feeds, stalls included (microseconds)
+  uint32_t getLongestGapUs() const
+  {
+    return _longestGapUs;
+  }
+
+ private:
+  static void timerCallback(void* arg);
+  void check();
+
+  NogasmBLEManager& _bleManager;
+  esp_timer_handle_t _timer = nullptr;
+
+  std::atomic<bool> _armed{false};
+  std::atomic<bool> _stalled{false};
+  std::atomic<uint32_t> _deadlineUs{250000};
+  std::atomic<uint32_t> _lastFeedUs{0};
+  std::atomic<uint32_t> _misses{0};
+
+  // loop side only
+  uint32_t _longestGapUs = 0;
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "EdgePredictor.h"
+#include <Util.h>
+
+template <typename T>
+static bool readValue(File& file, T& value)
+{
+  return file.read(reinterpret_cast<uint8_t*>(&value), sizeof(T)) == sizeof(T);
+}
+
+bool EdgePredictor::loadModel(fs::FS& filesystem, const char* path)
+{
+  _loaded = false;
+
+  if (!filesystem.exists(path))
+  {
+    Util::logDebug("EdgePredictor::model -> no model at %s", path);
+    return false;
+  }
+
+  File file = filesystem.open(path, "r");
+  if (!file)
+  {
+    Util::logInfo("EdgePredictor::model -> failed to open %s", path);
+    return false;
+  }
+
+  char magic[4];
+  uint8_t version = 0;
+  EdgeModel model;
+
+  bool valid = file.read(reinterpret_cast<uint8_t*>(magic), sizeof(magic)) == sizeof(magic) && memcmp(magic, EDGE_MODEL_MAGIC, sizeof(magic)) == 0;
+  valid = valid && readValue(file, version) && version == EDGE_MODEL_VERSION;
+  valid = valid && readValue(file, model.hiddenCount) && model.hiddenCount <= EDGE_MODEL_MAX_HIDDEN;
+  valid = valid && readValue(file, model.hiddenFracBits) && model.hiddenFracBits < 24;
+  valid = valid && readValue(file, model.outputFracBits) && model.outputFracBits < 24;
+  valid = valid && readValue(file, model.inputMean) && readValue(file, model.inputScale);
+
+  if (valid && model.hiddenCount > 0)
+  {
+    for (int j = 0; valid && j < model.hiddenCount; j++)
+    {
+      valid = readValue(file, model.hiddenWeights[j]);
+    }
+    for (int j = 0; valid && j < model.hiddenCount; j++)
+    {
+      valid = readValue(file, model.hiddenBias[j]);
+    }
+  }
+
+  const int outputCount = model.hiddenCount > 0 ? model.hiddenCount : EDGE_MODEL_INPUTS;
+  valid = valid && file.read(reinterpret_cast<uint8_t*>(model.outputWeights), outputCount) == static_cast<size_t>(outputCount);
+  valid = valid && readValue(file, model.outputBias);
+  file.close();
+
+  if (!valid)
+  {
+    Util::logInfo("EdgePredictor::model -> invalid model file %s", path);
+    return false;
+  }
+
+  _model = model;
+  _loaded = true;
+  Util::logInfo("EdgePredictor::model -> loaded %s (%s, hidden=%d)", path, model.hiddenCount > 0 ? "mlp" : "logistic", model.hiddenCount);
+  return true;
+}
+
+void EdgePredictor::setFrequency(const int frequency)
+{
+  _frequency = static_cast<float>(frequency > 0 ? frequency : 1);
+}
+
+void EdgePredictor::reset()
+{
+  _head = 0;
+  _count = 0;
+  _sum = 0;
+  _sumSquares = 0;
+  _sumWeighted = 0;
+  _sumDiffSquares = 0;
+  _clenchCount = 0;
+  _lastProbability = 0;
+}
+
+void EdgePredictor::addSample(const float pressure, const bool clenchStarted)
+{
+  const auto value = static_cast<int16_t>(constrain(lroundf(pressure), 0L, static_cast<long>(INT16_MAX)));
+
+  if (_count == EDGE_FEATURE_WINDOW)
+  {
+    // drop the oldest sample, every remaining sample moves down one index
+    const int64_t oldest = _samples[_head];
+    const int64_t oldestDiff = _samples[(_head + 1) % EDGE_FEATURE_WINDOW] - oldest;
+
+    _sum -= oldest;
+    _sumSquares -= oldest * oldest;
+    _sumWeighted -= _sum;
+    _sumDiffSquares -= oldestDiff * oldestDiff;
+    _clenchCount -= _clenchFlags[_head];
+
+    _head = (_head + 1) % EDGE_FEATURE_WINDOW;
+    _count--;
+  }
+
+  const uint16_t tail = (_head + _count) % EDGE_FEATURE_WINDOW;
+  if (_count > 0)
+  {
+    const int64_t diff = value - _samples[(tail + EDGE_FEATURE_WINDOW - 1) % EDGE_FEATURE_WINDOW];
+    _sumDiffSquares += diff * diff;
+  }
+
+  _samples[tail] = value;
+  _clenchFlags[tail] = clenchStarted ? 1 : 0;
+
+  _sumWeighted += static_cast<int64_t>(_count) * value;
+  _sum += value;
+  _sumSquares += static_cast<int64_t>(value) * value;
+  _clenchCount += _clenchFlags[tail];
+  _count++;
+}
+
+void EdgePredictor::computeFeatures(float* features) const
+{
+  constexpr float n = EDGE_FEATURE_WINDOW;
+  constexpr float sumIndex = n * (n - 1) / 2;
+  constexpr float sumIndexSquares = (n - 1) * n * (2 * n - 1) / 6;
+
+  const auto sum = static_cast<float>(_sum);
+  const float mean = sum / n;
+
+  // least squares slope over the window, in pressure units per second
+  const float slope = (n * static_cast<float>(_sumWeighted) - sumIndex * sum) / (n * sumIndexSquares - sumIndex * sumIndex);
+  features[0] = slope * _frequency;
+
+  // variance of the window
+  features[1] = static_cast<float>(_sumSquares) / n - mean * mean;
+
+  // clenches per minute
+  features[2] = static_cast<float>(_clenchCount) * 60.0f * _frequency / n;
+
+  // high band energy, mean squared first difference
+  features[3] = static_cast<float>(_sumDiffSquares) / (n - 1);
+}
+
+int16_t EdgePredictor::quantizeInput(const float value, const int index) const
+{
+  const float standardised = (value - _model.inputMean[index]) * _model.inputScale[index] * 256.0f;
+  return static_cast<int16_t>(constrain(lroundf(standardised), static_cast<long>(INT16_MIN), static_cast<long>(INT16_MAX)));
+}
+
+float EdgePredictor::predict()
+{
+  if (!_loaded || _count < EDGE_FEATURE_WINDOW)
+  {
+    _lastProbability = 0;
+    return _lastProbability;
+  }
+
+  const unsigned long start = NogasmClock::micros();
+
+  float features[EDGE_MODEL_INPUTS];
+  computeFeatures(features);
+
+  int16_t inputs[EDGE_MODEL_INPUTS];
+  for (int i = 0; i < EDGE_MODEL_INPUTS; i++)
+  {
+    inputs[i] = quantizeInput(features[i], i);
+  }
+
+  int32_t accumulator = _model.outputBias;
+  if (_model.hiddenCount == 0)
+  {
+    for (int i = 0; i < EDGE_MODEL_INPUTS; i++)
+    {
+      accumulator += static_cast<int32_t>(_model.outputWeights[i]) * inputs[i];
+    }
+  }
+  else
+  {
+    for (int j = 0; j < _model.hiddenCount; j++)
+    {
+      int32_t hidden = _model.hiddenBias[j];
+      for (int i = 0; i < EDGE_MODEL_INPUTS; i++)
+      {
+        hidden += static_cast<int32_t>(_model.hiddenWeights[j][i]) * inputs[i];
+      }
+
+      // back to Q8, ReLU and saturate to an int16 activation
+      hidden = constrain(hidden >> _model.hiddenFracBits, 0, static_cast<int32_t>(INT16_MAX));
+      accumulator += static_cast<int32_t>(_model.outputWeights[j]) * hidden;
+    }
+  }
+
+  // logit in Q8
+  const int32_t logit = accumulator >> _model.outputFracBits;
+  _lastProbability = 1.0f / (1.0f + expf(-static_cast<float>(logit) / 256.0f));
+  _lastInferenceUs = NogasmClock::micros() - start;
+
+  return _lastProbability;
+}
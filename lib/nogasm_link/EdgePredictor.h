@@ -0,0 +1,97 @@
+#ifndef EDGE_PREDICTOR_H
+#define EDGE_PREDICTOR_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define EDGE_MODEL_MAGIC "NGEM"
+#define EDGE_MODEL_VERSION 1
+#define EDGE_MODEL_INPUTS 4       // slope, variance, clench rate, band energy
+#define EDGE_MODEL_MAX_HIDDEN 16  // 0 hidden neurons = logistic regression
+#define EDGE_FEATURE_WINDOW 64    // samples, ~1 second at 60Hz
+
+/**
+ * Model file layout (little endian), written by the offline training script:
+ *
+ *   char    magic[4]                     "NGEM"
+ *   uint8   version                      1
+ *   uint8   hiddenCount                  0 (logistic regression) .. EDGE_MODEL_MAX_HIDDEN
+ *   uint8   hiddenFracBits               fractional bits of the hidden layer weights
+ *   uint8   outputFracBits               fractional bits of the output layer weights
+ *   float   inputMean[4]                 feature standardisation, q = (x - mean) * scale in Q8
+ *   float   inputScale[4]
+ *   int8    hiddenWeights[hidden][4]     only when hiddenCount > 0
+ *   int32   hiddenBias[hidden]           in the accumulator scale (Q8 + hiddenFracBits)
+ *   int8    outputWeights[hidden or 4]
+ *   int32   outputBias                   in the accumulator scale (Q8 + outputFracBits)
+ */
+struct EdgeModel
+{
+  uint8_t hiddenCount = 0;
+  uint8_t hiddenFracBits = 0;
+  uint8_t outputFracBits = 0;
+  float inputMean[EDGE_MODEL_INPUTS] = {};
+  float inputScale[EDGE_MODEL_INPUTS] = {};
+  int8_t hiddenWeights[EDGE_MODEL_MAX_HIDDEN][EDGE_MODEL_INPUTS] = {};
+  int32_t hiddenBias[EDGE_MODEL_MAX_HIDDEN] = {};
+  int8_t outputWeights[EDGE_MODEL_MAX_HIDDEN] = {};
+  int32_t outputBias = 0;
+};
+
+/**
+ * Predicts an approaching edge from features of the pressure stream with a small fixed-point model.
+ * Features are maintained incrementally over a sliding window so each tick costs O(1) plus the model.
+ */
+class EdgePredictor
+{
+ public:
+  bool loadModel(fs::FS& filesystem, const char* path);
+
+  bool isLoaded() const
+  {
+    return _loaded;
+  }
+
+  void setFrequency(int frequency);
+  void reset();
+
+  // feed one control tick, clenchStarted is true on the tick a clench was first detected
+  void addSample(float pressure, bool clenchStarted);
+
+  // runs the model, returns the probability (0-1) of an approaching edge
+  float predict();
+
+  float getLastProbability() const
+  {
+    return _lastProbability;
+  }
+
+  unsigned long getLastInferenceUs() const
+  {
+    return _lastInferenceUs;
+  }
+
+ private:
+  void computeFeatures(float* features) const;
+  int16_t quantizeInput(float value, int index) const;
+
+  EdgeModel _model;
+  bool _loaded = false;
+  float _frequency = 60.0f;
+
+  // sliding window, sums are kept in integers so they don't drift
+  int16_t _samples[EDGE_FEATURE_WINDOW] = {};
+  uint8_t _clenchFlags[EDGE_FEATURE_WINDOW] = {};
+  uint16_t _head = 0;
+  uint16_t _count = 0;
+  int64_t _sum = 0;             // sum(x)
+  int64_t _sumSquares = 0;      // sum(x^2)
+  int64_t _sumWeighted = 0;     // sum(i * x), i = 0 for the oldest sample
+  int64_t _sumDiffSquares = 0;  // sum((x[i] - x[i-1])^2)
+  int _clenchCount = 0;
+
+  float _lastProbability = 0;
+  unsigned long _lastInferenceUs = 0;
+};
+
+#endif
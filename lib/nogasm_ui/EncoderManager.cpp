@@ -53,10 +53,10 @@ void EncoderManager::update()
 
   // Handle button press with debouncing
   const bool currentState = _encoder.isEncoderButtonDown();
-  if (currentState && !_buttonPressed && millis() - _buttonPressTime > BUTTON_DEBOUNCE_MS)
+  if (currentState && !_buttonPressed && NogasmClock::millis() - _buttonPressTime > BUTTON_DEBOUNCE_MS)
   {
     _buttonPressed = true;
-    _buttonPressTime = millis();
+    _buttonPressTime = NogasmClock::millis();
 
     Util::logTrace("EncoderManager::button -> toggling ArousalManager");
     _arousalManager.toggle();
@@ -44,7 +44,7 @@ void RGBManager::begin()
 
 void RGBManager::update()
 {
-  const unsigned long currentTime = millis();
+  const unsigned long currentTime = NogasmClock::millis();
   if (!Util::hasTimeExpired(RGB_UPDATE_PERIOD, _lastUpdateTime))
   {
     return;
@@ -105,7 +105,7 @@ void RGBManager::applyStateConfig(const LEDStateConfig& config)
 
   // Reset animation state
   _isAnimating = (_currentAnimation != AnimationType::NONE);
-  _animationStartTime = millis();
+  _animationStartTime = NogasmClock::millis();
 
   if (!_isAnimating)
   {
@@ -117,7 +117,7 @@ void RGBManager::applyStateConfig(const LEDStateConfig& config)
 
 void RGBManager::restartCurrentAnimation()
 {
-  _animationStartTime = millis();
+  _animationStartTime = NogasmClock::millis();
 }
 
 void RGBManager::setColor(const uint8_t red, const uint8_t green, const uint8_t blue)
@@ -139,7 +139,7 @@ void RGBManager::setBrightness(const uint8_t brightness)
 
 void RGBManager::updateAnimation()
 {
-  const unsigned long currentTime = millis();
+  const unsigned long currentTime = NogasmClock::millis();
   const unsigned long elapsed = currentTime - _animationStartTime;
   const float progress = static_cast<float>(elapsed % _animationDuration) / _animationDuration;
 
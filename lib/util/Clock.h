@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+
+// Real time on the device, inlines straight to the Arduino calls
+struct ArduinoClock
+{
+  static unsigned long millis()
+  {
+    return ::millis();
+  }
+
+  static unsigned long micros()
+  {
+    return ::micros();
+  }
+};
+#endif
+
+// Time only moves when advanced, for deterministic runs on the host
+class ManualClock
+{
+ public:
+  static unsigned long millis()
+  {
+    return static_cast<unsigned long>(now().load(std::memory_order_relaxed) / 1000);
+  }
+
+  static unsigned long micros()
+  {
+    return static_cast<unsigned long>(now().load(std::memory_order_relaxed));
+  }
+
+  static void advanceMillis(const uint64_t ms)
+  {
+    now().fetch_add(ms * 1000, std::memory_order_relaxed);
+  }
+
+  static void advanceMicros(const uint64_t us)
+  {
+    now().fetch_add(us, std::memory_order_relaxed);
+  }
+
+  static void reset(const uint64_t us = 0)
+  {
+    now().store(us, std::memory_order_relaxed);
+  }
+
+ private:
+  static std::atomic<uint64_t>& now()
+  {
+    static std::atomic<uint64_t> value{0};
+    return value;
+  }
+};
+
+// Host time running faster than real time by a configurable factor
+class AcceleratedClock
+{
+ public:
+  static unsigned long millis()
+  {
+    return static_cast<unsigned long>(elapsedUs() / 1000);
+  }
+
+  static unsigned long micros()
+  {
+    return static_cast<unsigned long>(elapsedUs());
+  }
+
+  static void setFactor(const uint32_t factor)
+  {
+    // rebase so time stays monotonic when the factor changes
+    const uint64_t current = elapsedUs();
+    state().offsetUs = current;
+    state().start = std::chrono::steady_clock::now();
+    state().factor = factor > 0 ? factor : 1;
+  }
+
+ private:
+  struct State
+  {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t offsetUs = 0;
+    uint32_t factor = 1000;
+  };
+
+  static State& state()
+  {
+    static State value;
+    return value;
+  }
+
+  static uint64_t elapsedUs()
+  {
+    const auto realUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - state().start).count();
+    return state().offsetUs + static_cast<uint64_t>(realUs) * state().factor;
+  }
+};
+
+// Resolved at compile time so the device build pays nothing for the indirection
+#if defined(NOGASM_MANUAL_CLOCK)
+using NogasmClock = ManualClock;
+#elif defined(NOGASM_ACCELERATED_CLOCK)
+using NogasmClock = AcceleratedClock;
+#else
+using NogasmClock = ArduinoClock;
+#endif
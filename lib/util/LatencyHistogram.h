@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Histogram of latencies in microseconds with four logarithmic buckets per octave (~19% resolution),
+ * below 4 * BASE_US the buckets are BASE_US wide.
+ * Once the window is full all counts are halved, so percentiles follow recent behaviour.
+ * Not thread safe, callers guard it together with whatever produces the samples.
+ */
+class LatencyHistogram
+{
+ public:
+  static constexpr uint32_t BASE_US = 250;  // bucket 0 holds everything below this
+  static constexpr uint8_t BUCKET_COUNT = 72;
+  static constexpr uint32_t WINDOW = 1024;
+
+  void record(const uint32_t us)
+  {
+    _counts[bucketFor(us)]++;
+    if (++_total >= WINDOW)
+    {
+      _total = 0;
+      for (auto& count : _counts)
+      {
+        count /= 2;
+        _total += count;
+      }
+    }
+  }
+
+  void reset()
+  {
+    memset(_counts, 0, sizeof(_counts));
+    _total = 0;
+  }
+
+  uint32_t count() const
+  {
+    return _total;
+  }
+
+  // upper bound of the bucket holding the given percentile (0-100), 0 without samples
+  uint32_t percentile(const uint8_t percent) const
+  {
+    if (_total == 0)
+    {
+      return 0;
+    }
+
+    const uint32_t target = (_total * percent + 99) / 100;
+    uint32_t cumulative = 0;
+    for (uint8_t i = 0; i < BUCKET_COUNT; i++)
+    {
+      cumulative += _counts[i];
+      if (cumulative >= target && cumulative > 0)
+      {
+        return upperBound(i);
+      }
+    }
+
+    return upperBound(BUCKET_COUNT - 1);
+  }
+
+ private:
+  static uint8_t bucketFor(const uint32_t us)
+  {
+    const uint32_t scaled = us / BASE_US;
+    if (scaled == 0)
+    {
+      return 0;
+    }
+
+    // octave from the leading bit, quarter steps from the two bits below it
+    const uint8_t octave = 31 - __builtin_clz(scaled);
+    const uint8_t quarter = octave >= 2 ? (scaled >> (octave - 2)) & 3 : (scaled << (2 - octave)) & 3;
+    const uint32_t bucket = 1 + octave * 4 + quarter;
+    return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+  }
+
+  static uint32_t upperBound(const uint8_t bucket)
+  {
+    if (bucket == 0)
+    {
+      return BASE_US;
+    }
+
+    const uint8_t octave = (bucket - 1) / 4;
+    const uint8_t quarter = (bucket - 1) % 4;
+    if (octave < 2)
+    {
+      // a quarter of these octaves is less than one BASE_US step, each bucket spans a whole step
+      return BASE_US * (((4 + quarter) >> (2 - octave)) + 1);
+    }
+
+    return static_cast<uint32_t>((static_cast<uint64_t>(BASE_US) << (octave - 2)) * (5 + quarter));
+  }
+
+  uint16_t _counts[BUCKET_COUNT] = {};
+  uint32_t _total = 0;
+};
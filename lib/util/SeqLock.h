@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * Single writer, multi reader sequence lock for small POD values.
+ * The writer never blocks, readers retry until they copied the value without a write in between.
+ */
+template <typename T>
+class SeqLock
+{
+ public:
+  void write(const T& value)
+  {
+    const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    _value = value;
+
+    _sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  T read() const
+  {
+    T copy;
+    uint32_t before;
+    uint32_t after;
+    uint32_t attempts = 0;
+
+    do
+    {
+      // the writer may be a lower priority task preempted mid-write on this core, let it finish
+      if (attempts++ > MAX_SPIN_ATTEMPTS)
+      {
+        delay(1);
+      }
+
+      before = _sequence.load(std::memory_order_acquire);
+      copy = _value;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = _sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    return copy;
+  }
+
+  // even and incremented by two for every published value
+  uint32_t sequence() const
+  {
+    return _sequence.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr uint32_t MAX_SPIN_ATTEMPTS = 16;
+
+  std::atomic<uint32_t> _sequence{0};
+  T _value{};
+};
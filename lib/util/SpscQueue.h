@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * Bounded single producer, single consumer queue without locks, e.g. from a stack callback to the main loop.
+ * Values are copied in and out, the producer never waits, push() fails when the queue is full.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+ public:
+  bool push(const T& value)
+  {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) >= Capacity)
+    {
+      return false;
+    }
+
+    _items[tail & (Capacity - 1)] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& value)
+  {
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    value = _items[head & (Capacity - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // only exact when called from one of the two sides while the other is idle
+  size_t size() const
+  {
+    return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+  }
+
+ private:
+  std::atomic<size_t> _head{0};  // written by the consumer
+  std::atomic<size_t> _tail{0};  // written by the producer
+  T _items[Capacity];
+};
@@ -2,7 +2,7 @@
 
 namespace Util
 {
-void logInternal(const int level, const char* format, const va_list args)
+void logInternal(const int level, const char* format, va_list args)
 {
   if (level > NOGASM_LOG_LEVEL)
   {
@@ -54,7 +54,7 @@ void logInfo(const char* format, ...)
 
 bool hasTimeExpired(const unsigned int expiryTimeMillis, const unsigned long lastTimestamp)
 {
-  long elapsedTime = millis() - expiryTimeMillis;
+  long elapsedTime = NogasmClock::millis() - expiryTimeMillis;
   if (elapsedTime < 0)
   {
     // in case the system clock just started
@@ -62,7 +62,7 @@ bool hasTimeExpired(const unsigned int expiryTimeMillis, const unsigned long las
   }
 
   // logTrace("   ->> millis:%d, expiry:%d, elapsed:%d, last:%d, result:%d",  //
-  //   millis(), expiryTimeMillis, elapsedTime, lastTimestamp, elapsedTime > lastTimestamp);
+  //   NogasmClock::millis(), expiryTimeMillis, elapsedTime, lastTimestamp, elapsedTime > lastTimestamp);
   return elapsedTime > lastTimestamp;
 }
 
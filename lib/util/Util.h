@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Arduino.h>
+#include "Clock.h"
 
 // nogasm default log level (0=off, 1=info, 2=debug, 3=trace)
 #define NOGASM_LOG_LEVEL 1
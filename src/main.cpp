@@ -16,6 +16,7 @@
 #define ENABLE_WIFI_WEB_SERVER true
 #define FILESYSTEM LittleFS
 #define CONFIG_FILE "/config.json"
+#define EDGE_MODEL_FILE "/edge_model.bin"
 #define HOST_NAME "NogasmLink"
 
 #define RGB_RED_PIN 25
@@ -62,8 +63,11 @@ void setup()
   setupWifiAndWebServer();
   setupNogasmLink();
 
-  // when the scan completes, all auto(re)connect behavior initializes
-  nogasmBLEManager.startScan(nogasmConfig.getScanDuration());
+  // when the scan completes (or the last device shows up), all auto(re)connect behavior initializes
+  if (!nogasmConfig.getDirectConnect() || !nogasmBLEManager.connectToSavedDevice())
+  {
+    nogasmBLEManager.startScan(nogasmConfig.getScanDuration());
+  }
 }
 
 void setupNogasmLink()
@@ -73,6 +77,10 @@ void setupNogasmLink()
   arousalManager.setConfig(nogasmConfig.getArousalConfig());
   arousalManager.setArousalLimit(nogasmConfig.getArousalLimit());
   arousalManager.onStateChange(onArousalStateChange);
+  arousalManager.loadEdgeModel(FILESYSTEM, EDGE_MODEL_FILE);
+
+  // applies the staged config, the encoder range below depends on it
+  arousalManager.update();
 
   encoderManager.begin();
   pressureSensor.begin();
@@ -123,6 +131,9 @@ void loop()
   arousalManager.update();
   rgbManager.update();
 
+  // short connection intervals only while a session needs them
+  nogasmBLEManager.setSessionActive(arousalManager.isActive());
+
   if (ENABLE_WIFI_WEB_SERVER)
   {
     nogasmHttp.update();
@@ -156,7 +167,7 @@ void onBLEStatusChange(BLEConnectionState state)
       if (device != nullptr)
       {
         rgbManager.setLEDState(LEDState::CONNECTED);
-        nogasmConfig.saveDeviceInfo(device->address.c_str(), device->name.c_str());
+        nogasmConfig.saveDeviceInfo(device->address.c_str(), device->name.c_str(), device->addressType.c_str());
       }
       break;
     }
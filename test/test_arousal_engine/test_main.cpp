@@ -0,0 +1,201 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <ArousalEngine.h>
+
+/**
+ * Cost of the per-tick arousal math with each parameter source, run with `pio test -e native`.
+ * Every tick is its own call like ArousalManager::update(), so nothing is hoisted out of the tick loop and the
+ * constants are loaded (or folded) the way they are on the device.
+ */
+
+#define TEST_TICKS 1000000
+#define TEST_ROUNDS 5
+#define TEST_TRACE_LENGTH 4096
+
+using FixedDefaults = FixedArousalParams<60, 255, 50000, 15000, 70, 990>;
+
+struct TickState
+{
+  float arousal = 0;
+  float lastPressure = 0;
+  float peakStart = 0;
+  float speed = 0;
+  unsigned long peaks = 0;
+  unsigned long coolOffTicks = 0;
+};
+
+static std::vector<float> pressureTrace;
+
+// breathing-like swell with clenches on top, deterministic so every variant sees the same input
+static void buildPressureTrace()
+{
+  uint32_t noise = 12345;
+  pressureTrace.resize(TEST_TRACE_LENGTH);
+  for (int i = 0; i < TEST_TRACE_LENGTH; i++)
+  {
+    noise = noise * 1103515245u + 12345u;
+    const float swell = static_cast<float>(i % 240) * 4.0f;
+    const float clench = i % 97 < 6 ? 40.0f : 0.0f;
+    pressureTrace[i] = 1000.0f + swell + clench + static_cast<float>((noise >> 16) % 8);
+  }
+}
+
+// the rest of the tick as ArousalManager has it, shared by every variant
+static void finishTick(TickState& state, const float pressure, const float peak, const bool coolOff, const float increment,
+  const int maxSpeed)
+{
+  if (peak > 0)
+  {
+    state.arousal += peak;
+    state.peaks++;
+  }
+  state.lastPressure = pressure;
+
+  if (coolOff)
+  {
+    state.coolOffTicks++;
+  }
+  else if (state.speed < static_cast<float>(maxSpeed))
+  {
+    state.speed += increment;
+  }
+  else
+  {
+    state.speed = 0;
+  }
+}
+
+// what update() did before the engine, deriving every constant from the config on each tick
+__attribute__((noinline)) static void recomputeTick(const ArousalConfig& config, TickState& state, const float pressure,
+  const unsigned long elapsedSinceLimitMs)
+{
+  state.arousal *= config.arousalDecayRate;
+  const float speedIncrement = static_cast<float>(config.maxSpeed) / (static_cast<float>(config.frequency) * config.rampTimeSeconds);
+
+  float peak = 0;
+  if (pressure < state.lastPressure)
+  {
+    if (state.lastPressure > state.peakStart)
+    {
+      const float sensitivityThreshold = static_cast<float>(config.sensitivityThreshold) / 10.0f;
+      if (state.lastPressure - state.peakStart > sensitivityThreshold)
+      {
+        peak = state.lastPressure - state.peakStart;
+      }
+    }
+    state.peakStart = pressure;
+  }
+
+  const unsigned long coolOffPeriodMs = config.coolTimeSeconds * 1000;
+  finishTick(state, pressure, peak, elapsedSinceLimitMs < coolOffPeriodMs, speedIncrement, config.maxSpeed);
+}
+
+template <typename Params>
+__attribute__((noinline)) static void engineTick(const ArousalEngine<Params>& engine, TickState& state, const float pressure,
+  const unsigned long elapsedSinceLimitMs)
+{
+  state.arousal = engine.decay(state.arousal);
+  const float peak = engine.detectPeak(pressure, state.lastPressure, state.peakStart);
+  finishTick(state, pressure, peak, engine.inCoolOff(elapsedSinceLimitMs), engine.params().speedIncrement(),
+    engine.params().maxSpeed());
+}
+
+struct TickResult
+{
+  double nsPerTick;
+  TickState state;
+};
+
+// the fastest of a few rounds, the host has other things to do too
+template <typename Tick>
+static TickResult timeTicks(Tick tick)
+{
+  TickResult result = {0, {}};
+  for (int round = 0; round < TEST_ROUNDS; round++)
+  {
+    TickState state;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < TEST_TICKS; i++)
+    {
+      // a limit was hit every 30 s of ticks at 60 Hz, the first 15 s of each are cool-off
+      tick(state, pressureTrace[i % TEST_TRACE_LENGTH], static_cast<unsigned long>(i % 1800) * 16);
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / TEST_TICKS;
+    result.nsPerTick = round == 0 ? ns : std::min(result.nsPerTick, ns);
+    result.state = state;
+  }
+
+  return result;
+}
+
+static void assertSameOutput(const TickState& expected, const TickState& actual)
+{
+  TEST_ASSERT_EQUAL_FLOAT(expected.arousal, actual.arousal);
+  TEST_ASSERT_EQUAL_FLOAT(expected.speed, actual.speed);
+  TEST_ASSERT_EQUAL(expected.peaks, actual.peaks);
+  TEST_ASSERT_EQUAL(expected.coolOffTicks, actual.coolOffTicks);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_fixed_params_pin_the_config_to_their_values()
+{
+  ArousalConfig config;
+  config.frequency = 100;
+  config.rampTimeSeconds = 10.0f;
+
+  ArousalEngine<FixedDefaults> engine;
+  engine.configure(config);
+
+  TEST_ASSERT_EQUAL(60, config.frequency);
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, config.rampTimeSeconds);
+  TEST_ASSERT_EQUAL_FLOAT(0.990f, config.arousalDecayRate);
+}
+
+void test_every_parameter_source_gives_the_same_ticks()
+{
+  ArousalConfig config;
+
+  ArousalConfig runtimeConfig = config;
+  ArousalEngine<RuntimeArousalParams> runtime;
+  runtime.configure(runtimeConfig);
+
+  ArousalConfig fixedConfig = config;
+  ArousalEngine<FixedDefaults> fixed;
+  fixed.configure(fixedConfig);
+
+  const TickResult recomputed = timeTicks([&config](TickState& state, const float pressure, const unsigned long elapsed)
+    { recomputeTick(config, state, pressure, elapsed); });
+  const TickResult runtimeResult = timeTicks([&runtime](TickState& state, const float pressure, const unsigned long elapsed)
+    { engineTick(runtime, state, pressure, elapsed); });
+  const TickResult fixedResult = timeTicks([&fixed](TickState& state, const float pressure, const unsigned long elapsed)
+    { engineTick(fixed, state, pressure, elapsed); });
+
+  char message[160];
+  snprintf(message, sizeof(message), "recomputed %.2f ns/tick, runtime params %.2f ns/tick, fixed params %.2f ns/tick",
+    recomputed.nsPerTick, runtimeResult.nsPerTick, fixedResult.nsPerTick);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_GREATER_THAN(0u, recomputed.state.peaks);
+  TEST_ASSERT_GREATER_THAN(0u, recomputed.state.coolOffTicks);
+  assertSameOutput(recomputed.state, runtimeResult.state);
+  assertSameOutput(recomputed.state, fixedResult.state);
+}
+
+int main(int argc, char** argv)
+{
+  buildPressureTrace();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_fixed_params_pin_the_config_to_their_values);
+  RUN_TEST(test_every_parameter_source_gives_the_same_ticks);
+  return UNITY_END();
+}
@@ -0,0 +1,279 @@
+#include <unity.h>
+#include <chrono>
+#include <thread>
+#include <Clock.h>
+#include <FS.h>
+#include <NogasmBLEManager.h>
+#include <SimulatedNimBLE.h>
+
+/**
+ * NogasmBLEManager and LovenseProtocol against simulated toys, run with `pio test -e native`.
+ * Simulated time only moves in step(), so the numbers are in toy time and repeat from run to run.
+ */
+
+#define TEST_TOY_ADDRESS "c4:4f:33:00:00:01"
+#define TEST_STEP_MS 1
+
+static fs::FS filesystem;
+static NogasmConfig config(filesystem, "/config.json");
+static NogasmBLEManager* bleManager = nullptr;
+
+// one millisecond of toy time, the writer thread gets a moment of host time to keep up
+static void step()
+{
+  ManualClock::advanceMillis(TEST_STEP_MS);
+  SimulatedBLE::process();
+  bleManager->update();
+  std::this_thread::sleep_for(std::chrono::microseconds(20));
+}
+
+// steps until done() holds, the toy time it took or -1 after timeoutMs
+template <typename Predicate>
+static long runUntil(Predicate done, const unsigned long timeoutMs)
+{
+  const unsigned long start = NogasmClock::millis();
+  while (!done())
+  {
+    if (NogasmClock::millis() - start >= timeoutMs)
+    {
+      return -1;
+    }
+    step();
+  }
+
+  return static_cast<long>(NogasmClock::millis() - start);
+}
+
+static bool isLinkConnected()
+{
+  return bleManager->getStatusSnapshot().links[0].state == BLE_CONNECTED;
+}
+
+// scans, auto-connects to the only toy and waits until the device type query was answered
+static SimulatedLovenseToy& connectToy(const SimulatedToyConfig& toyConfig)
+{
+  SimulatedLovenseToy& toy = SimulatedBLE::addToy(toyConfig);
+  bleManager->startScan(1000);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([]() { return isLinkConnected() && bleManager->getStatusSnapshot().links[0].model[0] != '\0'; }, 5000));
+  TEST_ASSERT_TRUE(toy.isConnected());
+  return toy;
+}
+
+// the connect test pulse is level 1, it has to be over before the first change counts
+static void waitForTestPulse(const SimulatedLovenseToy& toy)
+{
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([&toy]() { return toy.getCommandCount() > 0 && toy.getVibration() == 0; }, BLE_TEST_PULSE_MS * 2));
+}
+
+void setUp()
+{
+  // the writer task cannot be stopped, like on the device every manager lives until the process ends
+  SimulatedBLE::reset();
+  bleManager = new NogasmBLEManager(config);
+  bleManager->begin("nogasm-test");
+}
+
+void tearDown()
+{
+  bleManager->disconnectAll();
+  runUntil([]() { return !bleManager->isConnectedState(); }, 1000);
+  config.setAcknowledgedWrites(false);
+}
+
+void test_connects_to_the_scanned_toy()
+{
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  const SimulatedLovenseToy& toy = connectToy(toyConfig);
+
+  const LinkStatus link = bleManager->getStatusSnapshot().links[0];
+  TEST_ASSERT_EQUAL(1u, toy.getConnectCount());
+  TEST_ASSERT_EQUAL_STRING("LVS-Lush3", link.name);
+  TEST_ASSERT_EQUAL(85, link.batteryLevel);
+}
+
+void test_reconnects_after_a_dropped_link()
+{
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  SimulatedLovenseToy& toy = connectToy(toyConfig);
+
+  SimulatedBLE::dropConnection(toy);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([]() { return !isLinkConnected(); }, 100));
+  const long reconnectMs = runUntil(isLinkConnected, 30000);
+
+  char message[64];
+  snprintf(message, sizeof(message), "reconnected after %ld ms", reconnectMs);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, reconnectMs);
+  TEST_ASSERT_EQUAL(2u, toy.getConnectCount());
+  TEST_ASSERT_GREATER_THAN(0u, bleManager->getStatusSnapshot().links[0].lastRecoveryMs);
+}
+
+void test_reconnect_backs_off_then_gives_up()
+{
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  SimulatedLovenseToy& toy = connectToy(toyConfig);
+
+  // the toy refuses every attempt, without a session the fast attempts are all there is
+  toy.setConnectFailPercent(100);
+  SimulatedBLE::dropConnection(toy);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([]() { return bleManager->getStatusSnapshot().links[0].state == BLE_FAILED; }, 30000));
+
+  // 0 is the most recent attempt, every wait is longer than the one before
+  const LinkStatus link = bleManager->getStatusSnapshot().links[0];
+  TEST_ASSERT_EQUAL(BLE_RECONNECT_FAST_ATTEMPTS, link.reconnectHistoryCount);
+  unsigned long lastGap = 0;
+  for (int h = link.reconnectHistoryCount - 2; h >= 0; h--)
+  {
+    TEST_ASSERT_FALSE(link.reconnectHistory[h].success);
+    const unsigned long gap = link.reconnectHistory[h].startedAt - link.reconnectHistory[h + 1].startedAt;
+    TEST_ASSERT_GREATER_THAN(lastGap, gap);
+    lastGap = gap;
+  }
+  TEST_ASSERT_EQUAL(1u, toy.getConnectCount());
+}
+
+void test_session_keeps_retrying_on_the_slow_tier()
+{
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  SimulatedLovenseToy& toy = connectToy(toyConfig);
+  bleManager->setSessionActive(true);
+
+  toy.setConnectFailPercent(100);
+  SimulatedBLE::dropConnection(toy);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([]() { return bleManager->getStatusSnapshot().links[0].reconnectSlow; }, 30000));
+
+  // the toy comes back, the next slow attempt picks it up
+  toy.setConnectFailPercent(0);
+  const long reconnectMs = runUntil(isLinkConnected, BLE_RECONNECT_SLOW_DELAY_MS * 2);
+
+  char message[64];
+  snprintf(message, sizeof(message), "back on the slow tier after %ld ms", reconnectMs);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, reconnectMs);
+  TEST_ASSERT_EQUAL(2u, toy.getConnectCount());
+  bleManager->setSessionActive(false);
+}
+
+void test_every_level_change_reaches_the_toy()
+{
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  toyConfig.replyLatencyMinUs = 5000;
+  toyConfig.replyLatencyMaxUs = 15000;
+  const SimulatedLovenseToy& toy = connectToy(toyConfig);
+  waitForTestPulse(toy);
+
+  const uint32_t commandsBefore = toy.getCommandCount();
+  const unsigned long start = NogasmClock::millis();
+  const int changes = 200;
+  for (int i = 0; i < changes; i++)
+  {
+    const uint8_t level = static_cast<uint8_t>(i % 20 + 1);
+    TEST_ASSERT_TRUE(bleManager->setVibrationLevel(level));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([&toy, level]() { return toy.getVibration() == level; }, 500));
+  }
+
+  const unsigned long elapsedMs = NogasmClock::millis() - start;
+
+  // lets the last write settle, the toy counts it under the simulation's lock
+  runUntil([]() { return false; }, 50);
+
+  char message[96];
+  snprintf(message, sizeof(message), "%d level changes in %lu ms, %.1f per second", changes, elapsedMs, changes * 1000.0 / elapsedMs);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(static_cast<uint32_t>(changes), toy.getCommandCount() - commandsBefore);
+  TEST_ASSERT_EQUAL(0u, toy.getLostCount());
+}
+
+void test_a_burst_of_levels_coalesces_into_the_last()
+{
+  config.setAcknowledgedWrites(true);
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  toyConfig.replyLatencyMinUs = 5000;
+  toyConfig.replyLatencyMaxUs = 15000;
+  const SimulatedLovenseToy& toy = connectToy(toyConfig);
+  waitForTestPulse(toy);
+
+  const BLECommandWriter& writer = bleManager->getCommandWriter();
+  const uint32_t commandsBefore = toy.getCommandCount();
+  const uint32_t coalescedBefore = writer.getCoalescedCount();
+
+  // no steps in between, so no replies come in: the window fills and every newer level replaces the waiting one
+  const int changes = 100;
+  uint8_t level = 0;
+  for (int i = 0; i < changes; i++)
+  {
+    level = static_cast<uint8_t>(i % 20 + 1);
+    TEST_ASSERT_TRUE(bleManager->setVibrationLevel(level));
+  }
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([&toy, level]() { return toy.getVibration() == level; }, 500));
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([level]() { return bleManager->getStatusSnapshot().links[0].confirmedVibration == level; }, 1000));
+
+  const uint32_t written = toy.getCommandCount() - commandsBefore;
+  const uint32_t coalesced = writer.getCoalescedCount() - coalescedBefore;
+
+  char message[96];
+  snprintf(message, sizeof(message), "%d level changes, %u written, %u coalesced", changes, written, coalesced);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_GREATER_THAN(0u, coalesced);
+  TEST_ASSERT_LESS_THAN(static_cast<uint32_t>(changes), written);
+}
+
+void test_lost_replies_are_resent_until_the_level_is_confirmed()
+{
+  config.setAcknowledgedWrites(true);
+  SimulatedToyConfig toyConfig;
+  toyConfig.address = TEST_TOY_ADDRESS;
+  toyConfig.replyLatencyMinUs = 5000;
+  toyConfig.replyLatencyMaxUs = 15000;
+  SimulatedLovenseToy& toy = connectToy(toyConfig);
+  waitForTestPulse(toy);
+
+  // the toy still acts on every command, only the OK goes missing
+  toy.setLossPercent(30);
+
+  const BLECommandWriter& writer = bleManager->getCommandWriter();
+  const uint32_t retransmitsBefore = writer.getRetransmitCount();
+  const int changes = 20;
+  uint8_t level = 0;
+  for (int i = 0; i < changes; i++)
+  {
+    level = static_cast<uint8_t>(i % 20 + 1);
+    TEST_ASSERT_TRUE(bleManager->setVibrationLevel(level));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([&toy, level]() { return toy.getVibration() == level; }, 500));
+  }
+
+  TEST_ASSERT_GREATER_OR_EQUAL(0, runUntil([level]() { return bleManager->getStatusSnapshot().links[0].confirmedVibration == level; }, 2000));
+
+  const uint32_t retransmits = writer.getRetransmitCount() - retransmitsBefore;
+
+  char message[96];
+  snprintf(message, sizeof(message), "%u replies lost, %u levels resent", toy.getLostCount(), retransmits);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_GREATER_THAN(0u, toy.getLostCount());
+  TEST_ASSERT_GREATER_THAN(0u, retransmits);
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_connects_to_the_scanned_toy);
+  RUN_TEST(test_reconnects_after_a_dropped_link);
+  RUN_TEST(test_reconnect_backs_off_then_gives_up);
+  RUN_TEST(test_session_keeps_retrying_on_the_slow_tier);
+  RUN_TEST(test_every_level_change_reaches_the_toy);
+  RUN_TEST(test_a_burst_of_levels_coalesces_into_the_last);
+  RUN_TEST(test_lost_replies_are_resent_until_the_level_is_confirmed);
+  return UNITY_END();
+}
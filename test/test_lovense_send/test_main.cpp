@@ -0,0 +1,163 @@
+#include <unity.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <Clock.h>
+#include <LovenseProtocol.h>
+#include <SimulatedNimBLE.h>
+
+/**
+ * Cost of one level command on the send path, run with `pio test -e native`.
+ * The client never connects, so every write stops at the simulator's link check; the table and the formatted
+ * encoding are timed through that same write, setVibration() on its own with everything the protocol does per command.
+ */
+
+#define TEST_COMMANDS 200000
+#define TEST_ROUNDS 5
+
+// every operator new in the process counts, the test runs on one thread
+static volatile unsigned long allocations = 0;
+
+void* operator new(const size_t size)
+{
+  allocations++;
+  void* memory = malloc(size != 0 ? size : 1);
+  if (memory == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+  free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+  free(memory);
+}
+
+static NimBLEClient* client = nullptr;
+static NimBLERemoteCharacteristic* txCharacteristic = nullptr;
+
+struct SendResult
+{
+  double nsPerCommand;
+  unsigned long allocations;
+};
+
+// the fastest of a few rounds, the host has other things to do too
+template <typename Send>
+static SendResult timeSends(Send send)
+{
+  SendResult result = {0, 0};
+  const unsigned long allocationsBefore = allocations;
+  for (int round = 0; round < TEST_ROUNDS; round++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < TEST_COMMANDS; i++)
+    {
+      send(static_cast<uint8_t>(i % 21));
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / TEST_COMMANDS;
+    result.nsPerCommand = round == 0 ? ns : std::min(result.nsPerCommand, ns);
+  }
+  result.allocations = allocations - allocationsBefore;
+
+  return result;
+}
+
+void setUp()
+{
+  SimulatedBLE::reset();
+  client = NimBLEDevice::createClient();
+  txCharacteristic = new NimBLERemoteCharacteristic(client, "0000fff2-0000-1000-8000-00805f9b34fb", 0x0e, true, false);
+}
+
+void tearDown()
+{
+  delete txCharacteristic;
+  NimBLEDevice::deleteClient(client);
+}
+
+// the command as setVibration() built it before the tables
+static std::string formatVibrate(const uint8_t level)
+{
+  return "Vibrate:" + std::to_string(level) + ";";
+}
+
+void test_table_commands_match_the_formatted_ones()
+{
+  for (uint8_t level = 0; level <= 20; level++)
+  {
+    const LovenseCommand& command = LovenseProtocol::vibrateCommand(level);
+    TEST_ASSERT_EQUAL_STRING(formatVibrate(level).c_str(), std::string(command.text, command.length).c_str());
+  }
+}
+
+void test_table_encoding_against_formatting_through_the_same_write()
+{
+  // both hand their bytes to the same writeValue() overload, only the encoding differs
+  const SendResult table = timeSends(
+    [](const uint8_t level)
+    {
+      const LovenseCommand& command = LovenseProtocol::vibrateCommand(level);
+      txCharacteristic->writeValue(reinterpret_cast<const uint8_t*>(command.text), command.length);
+    });
+  const SendResult formatted = timeSends(
+    [](const uint8_t level)
+    {
+      const std::string command = formatVibrate(level);
+      txCharacteristic->writeValue(reinterpret_cast<const uint8_t*>(command.data()), command.length());
+    });
+
+  // the encoding on its own, "Vibrate:20;" fits std::string's inline buffer on the host, an allocating string
+  // implementation (Arduino String, older libstdc++) pays for the heap on top
+  volatile size_t sink = 0;
+  const SendResult tableEncode = timeSends([&sink](const uint8_t level) { sink = sink + LovenseProtocol::vibrateCommand(level).length; });
+  const SendResult formatEncode = timeSends([&sink](const uint8_t level) { sink = sink + formatVibrate(level).length(); });
+
+  char message[192];
+  snprintf(message, sizeof(message),
+    "encode and write: table %.1f ns, formatted %.1f ns (%lu allocations); encode only: table %.1f ns, formatted %.1f ns",
+    table.nsPerCommand, formatted.nsPerCommand, formatted.allocations, tableEncode.nsPerCommand, formatEncode.nsPerCommand);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL(0u, table.allocations);
+  TEST_ASSERT_EQUAL(0u, tableEncode.allocations);
+}
+
+void test_set_vibration_never_allocates()
+{
+  LovenseProtocol protocol;
+  protocol.setTxCharacteristic(txCharacteristic);
+  TEST_ASSERT_TRUE(protocol.isReady());
+
+  // one round first so nothing lazily set up is counted
+  for (uint8_t level = 0; level <= 20; level++)
+  {
+    protocol.setVibration(level);
+  }
+
+  // the whole send path, pending reply queue and latency bookkeeping included
+  const SendResult sent = timeSends([&protocol](const uint8_t level) { protocol.setVibration(level); });
+
+  char message[96];
+  snprintf(message, sizeof(message), "setVibration() %.1f ns/command", sent.nsPerCommand);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL(0u, sent.allocations);
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_table_commands_match_the_formatted_ones);
+  RUN_TEST(test_table_encoding_against_formatting_through_the_same_write);
+  RUN_TEST(test_set_vibration_never_allocates);
+  return UNITY_END();
+}